@@ -0,0 +1,497 @@
+/* PChat
+ * Copyright (C) 2026 PChat-IRC contributors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <string.h>
+#include <stdlib.h>
+
+#include "pchat.h"
+#include "banindex.h"
+#include "userlist.h"
+#include "util.h"
+
+struct ban_index
+{
+	GHashTable *masks;		/* "<mode><mask>" -> ban_mask */
+	GHashTable *by_host;	/* literal host -> GSList of ban_mask */
+	GHashTable *by_nick;	/* literal nick, wildcard host -> GSList of ban_mask */
+	GSList *wild;			/* everything else */
+	guint loading;			/* list modes whose 367-style list is being received */
+};
+
+static guint
+banindex_mode_bit (char mode)
+{
+	switch (mode)
+	{
+	case 'b':
+		return 1;
+	case 'e':
+		return 2;
+	case 'I':
+		return 4;
+	case 'q':
+		return 8;
+	}
+	return 0;
+}
+
+char
+banindex_mode_for_numeric (int rplcode)
+{
+	switch (rplcode)
+	{
+	case 367: case 368:
+		return 'b';
+	case 348: case 349:
+		return 'e';
+	case 346: case 347:
+		return 'I';
+	case 728: case 729:
+		return 'q';
+	}
+	return 0;
+}
+
+static gboolean
+banindex_name_equal (gconstpointer a, gconstpointer b)
+{
+	return rfc_casecmp (a, b) == 0;
+}
+
+static GHashTable *
+banindex_table_new (void)
+{
+	return g_hash_table_new_full ((GHashFunc) str_ihash, banindex_name_equal, g_free, NULL);
+}
+
+static struct ban_index *
+banindex_get (session *sess)
+{
+	struct ban_index *idx = sess->banindex;
+
+	if (!idx)
+	{
+		idx = g_new0 (struct ban_index, 1);
+		idx->masks = banindex_table_new ();
+		idx->by_host = banindex_table_new ();
+		idx->by_nick = banindex_table_new ();
+		sess->banindex = idx;
+	}
+
+	return idx;
+}
+
+static gboolean
+has_wildcard (const char *str)
+{
+	return strpbrk (str, "*?") != NULL;
+}
+
+/* "*" matches anything, so we store it as NULL and skip the test */
+static char *
+compile_part (const char *start, gsize len, unsigned int *wild)
+{
+	char *part;
+
+	if (len == 0 || (len == 1 && start[0] == '*'))
+		return NULL;
+
+	part = g_strndup (start, len);
+	*wild = has_wildcard (part);
+	return part;
+}
+
+static void
+banindex_compile (ban_mask *ban, const char *mask)
+{
+	const char *bang, *at;
+	unsigned int wild;
+
+	/* $a:account / ~a:account extbans; other extbans can't be
+	   evaluated on the client and never match */
+	if ((mask[0] == '$' || mask[0] == '~') && mask[1])
+	{
+		if (mask[1] == 'a' && (mask[2] == ':' || mask[2] == 0))
+			ban->account = g_strdup (mask[2] ? mask + 3 : "*");
+		else
+			ban->extban = TRUE;
+		return;
+	}
+
+	bang = strchr (mask, '!');
+	at = strchr (mask, '@');
+	if (bang && at && at < bang)
+		bang = NULL;
+
+	if (!bang && !at)
+	{
+		/* a bare "nick" means nick!*@* */
+		wild = FALSE;
+		ban->nick = compile_part (mask, strlen (mask), &wild);
+		ban->nick_wild = wild;
+		return;
+	}
+
+	if (bang)
+	{
+		wild = FALSE;
+		ban->nick = compile_part (mask, bang - mask, &wild);
+		ban->nick_wild = wild;
+		mask = bang + 1;
+	}
+
+	if (at)
+	{
+		wild = FALSE;
+		ban->user = compile_part (mask, at - mask, &wild);
+		ban->user_wild = wild;
+		wild = FALSE;
+		ban->host = compile_part (at + 1, strlen (at + 1), &wild);
+		ban->host_wild = wild;
+	}
+	else
+	{
+		wild = FALSE;
+		ban->user = compile_part (mask, strlen (mask), &wild);
+		ban->user_wild = wild;
+	}
+}
+
+static void
+ban_mask_free (ban_mask *ban)
+{
+	g_free (ban->mask);
+	g_free (ban->setter);
+	g_free (ban->nick);
+	g_free (ban->user);
+	g_free (ban->host);
+	g_free (ban->account);
+	g_free (ban);
+}
+
+static void
+bucket_add (GHashTable *table, const char *key, ban_mask *ban)
+{
+	GSList *bucket = g_hash_table_lookup (table, key);
+
+	g_hash_table_insert (table, g_strdup (key), g_slist_prepend (bucket, ban));
+}
+
+static void
+bucket_remove (GHashTable *table, const char *key, ban_mask *ban)
+{
+	GSList *bucket = g_slist_remove (g_hash_table_lookup (table, key), ban);
+
+	if (bucket)
+		g_hash_table_insert (table, g_strdup (key), bucket);
+	else
+		g_hash_table_remove (table, key);
+}
+
+static void
+banindex_link (struct ban_index *idx, ban_mask *ban)
+{
+	if (ban->host && !ban->host_wild)
+		bucket_add (idx->by_host, ban->host, ban);
+	else if (ban->nick && !ban->nick_wild && !ban->host)
+		bucket_add (idx->by_nick, ban->nick, ban);
+	else
+		idx->wild = g_slist_prepend (idx->wild, ban);
+}
+
+static void
+banindex_unlink (struct ban_index *idx, ban_mask *ban)
+{
+	if (ban->host && !ban->host_wild)
+		bucket_remove (idx->by_host, ban->host, ban);
+	else if (ban->nick && !ban->nick_wild && !ban->host)
+		bucket_remove (idx->by_nick, ban->nick, ban);
+	else
+		idx->wild = g_slist_remove (idx->wild, ban);
+}
+
+void
+banindex_add (session *sess, char mode, const char *mask, const char *setter, time_t when)
+{
+	struct ban_index *idx;
+	ban_mask *ban;
+	char *key;
+
+	if (!banindex_mode_bit (mode) || !*mask)
+		return;
+
+	idx = banindex_get (sess);
+	key = g_strdup_printf ("%c%s", mode, mask);
+
+	ban = g_hash_table_lookup (idx->masks, key);
+	if (ban)
+	{
+		/* already known, just refresh who set it and when */
+		g_free (key);
+		g_free (ban->setter);
+		ban->setter = g_strdup (setter);
+		ban->when = when;
+		return;
+	}
+
+	ban = g_new0 (ban_mask, 1);
+	ban->mask = g_strdup (mask);
+	ban->setter = g_strdup (setter);
+	ban->when = when;
+	ban->mode = mode;
+	banindex_compile (ban, mask);
+
+	g_hash_table_insert (idx->masks, key, ban);
+	banindex_link (idx, ban);
+}
+
+void
+banindex_remove (session *sess, char mode, const char *mask)
+{
+	struct ban_index *idx = sess->banindex;
+	ban_mask *ban;
+	char *key;
+
+	if (!idx)
+		return;
+
+	key = g_strdup_printf ("%c%s", mode, mask);
+	ban = g_hash_table_lookup (idx->masks, key);
+	if (ban)
+	{
+		g_hash_table_remove (idx->masks, key);
+		banindex_unlink (idx, ban);
+		ban_mask_free (ban);
+	}
+	g_free (key);
+}
+
+static void
+banindex_remove_mode (struct ban_index *idx, char mode)
+{
+	GHashTableIter iter;
+	gpointer value;
+	ban_mask *ban;
+
+	g_hash_table_iter_init (&iter, idx->masks);
+	while (g_hash_table_iter_next (&iter, NULL, &value))
+	{
+		ban = value;
+		if (ban->mode == mode)
+		{
+			g_hash_table_iter_remove (&iter);
+			banindex_unlink (idx, ban);
+			ban_mask_free (ban);
+		}
+	}
+}
+
+/* A list reply replaces whatever we knew about that mode */
+
+void
+banindex_list_entry (session *sess, char mode, const char *mask, const char *setter, time_t when)
+{
+	struct ban_index *idx;
+	guint bit = banindex_mode_bit (mode);
+
+	if (!bit)
+		return;
+
+	idx = banindex_get (sess);
+	if (!(idx->loading & bit))
+	{
+		banindex_remove_mode (idx, mode);
+		idx->loading |= bit;
+	}
+
+	banindex_add (sess, mode, mask, setter, when);
+}
+
+void
+banindex_list_end (session *sess, char mode)
+{
+	struct ban_index *idx;
+	guint bit = banindex_mode_bit (mode);
+
+	if (!bit)
+		return;
+
+	idx = banindex_get (sess);
+	if (!(idx->loading & bit))
+		banindex_remove_mode (idx, mode);	/* the list is empty */
+	idx->loading &= ~bit;
+}
+
+static void
+free_bucket (gpointer key, gpointer value, gpointer userdata)
+{
+	g_slist_free (value);
+}
+
+void
+banindex_free (session *sess)
+{
+	struct ban_index *idx = sess->banindex;
+	GHashTableIter iter;
+	gpointer value;
+
+	if (!idx)
+		return;
+
+	g_hash_table_iter_init (&iter, idx->masks);
+	while (g_hash_table_iter_next (&iter, NULL, &value))
+		ban_mask_free (value);
+
+	g_hash_table_foreach (idx->by_host, free_bucket, NULL);
+	g_hash_table_foreach (idx->by_nick, free_bucket, NULL);
+	g_hash_table_destroy (idx->masks);
+	g_hash_table_destroy (idx->by_host);
+	g_hash_table_destroy (idx->by_nick);
+	g_slist_free (idx->wild);
+	g_free (idx);
+	sess->banindex = NULL;
+}
+
+static gboolean
+part_matches (const char *part, unsigned int wild, const char *value)
+{
+	if (!part)
+		return TRUE;
+	if (!value)
+		return FALSE;
+	if (wild)
+		return match (part, value);
+	return rfc_casecmp (part, value) == 0;
+}
+
+gboolean
+banindex_mask_matches (session *sess, const ban_mask *ban, struct User *user)
+{
+	char ident[128];
+	const char *host = NULL;
+	const char *at;
+
+	if (ban->extban)
+		return FALSE;
+
+	if (ban->account)
+	{
+		if (!user->account || !strcmp (user->account, "*"))
+			return FALSE;
+		return ban->account[0] == '*' && !ban->account[1] ? TRUE :
+				 match (ban->account, user->account);
+	}
+
+	if (!part_matches (ban->nick, ban->nick_wild, user->nick))
+		return FALSE;
+
+	if (!ban->user && !ban->host)
+		return TRUE;
+
+	/* user->hostname is "ident@host" */
+	ident[0] = 0;
+	if (user->hostname && (at = strchr (user->hostname, '@')))
+	{
+		g_strlcpy (ident, user->hostname, MIN (sizeof (ident), (gsize) (at - user->hostname) + 1));
+		host = at + 1;
+	}
+	else if (!user->hostname)
+		return FALSE;	/* we don't know enough about this user */
+
+	return part_matches (ban->user, ban->user_wild, ident) &&
+			 part_matches (ban->host, ban->host_wild, host);
+}
+
+struct users_matching_ctx
+{
+	session *sess;
+	ban_mask *ban;
+	GSList *result;
+};
+
+static int
+users_matching_cb (const void *key, void *data)
+{
+	struct users_matching_ctx *ctx = data;
+	struct User *user = (struct User *) key;
+
+	if (banindex_mask_matches (ctx->sess, ctx->ban, user))
+		ctx->result = g_slist_prepend (ctx->result, user);
+
+	return TRUE;
+}
+
+/* returns a list of struct User in the channel matched by mask, free with g_slist_free() */
+
+GSList *
+banindex_users_matching (session *sess, const char *mask)
+{
+	struct users_matching_ctx ctx;
+	ban_mask *ban;
+
+	if (!sess->usertree)
+		return NULL;
+
+	ban = g_new0 (ban_mask, 1);
+	banindex_compile (ban, mask);
+
+	ctx.sess = sess;
+	ctx.ban = ban;
+	ctx.result = NULL;
+	tree_foreach (sess->usertree, users_matching_cb, &ctx);
+
+	ban_mask_free (ban);
+	return g_slist_reverse (ctx.result);
+}
+
+static GSList *
+bans_matching_list (session *sess, GSList *list, struct User *user, char mode, GSList *result)
+{
+	ban_mask *ban;
+
+	for (; list; list = list->next)
+	{
+		ban = list->data;
+		if ((!mode || ban->mode == mode) && banindex_mask_matches (sess, ban, user))
+			result = g_slist_prepend (result, ban);
+	}
+
+	return result;
+}
+
+/* returns the ban_mask entries (of the given mode, or all if 0) that match
+   user; only the bucket for the user's host and nick and the wildcard masks
+   need checking. Free with g_slist_free(). */
+
+GSList *
+banindex_bans_matching (session *sess, struct User *user, char mode)
+{
+	struct ban_index *idx = sess->banindex;
+	GSList *result = NULL;
+	const char *host;
+
+	if (!idx)
+		return NULL;
+
+	if (user->hostname && (host = strchr (user->hostname, '@')))
+		result = bans_matching_list (sess, g_hash_table_lookup (idx->by_host, host + 1), user, mode, result);
+	result = bans_matching_list (sess, g_hash_table_lookup (idx->by_nick, user->nick), user, mode, result);
+	result = bans_matching_list (sess, idx->wild, user, mode, result);
+
+	return result;
+}
@@ -0,0 +1,58 @@
+/* PChat
+ * Copyright (C) 2026 PChat-IRC contributors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#ifndef PCHAT_BANINDEX_H
+#define PCHAT_BANINDEX_H
+
+/* Per-channel index of ban, exempt, invite and quiet masks, kept up to
+   date from the 367/348/346/728 lists and from MODE changes, so that
+   "who does this mask hit" and "which masks hit this user" don't need
+   every mask matched against every user. */
+
+struct User;
+
+typedef struct ban_mask
+{
+	char *mask;
+	char *setter;
+	time_t when;
+	char mode;			/* 'b', 'e', 'I' or 'q' */
+
+	/* mask compiled into nick!user@host parts; NULL means "*" */
+	char *nick;
+	char *user;
+	char *host;
+	char *account;		/* for $a:/~a: extbans, "*" for any account */
+	unsigned int nick_wild:1;	/* part contains * or ?, needs match() */
+	unsigned int user_wild:1;
+	unsigned int host_wild:1;
+	unsigned int extban:1;	/* an extban we can't evaluate */
+} ban_mask;
+
+void banindex_add (session *sess, char mode, const char *mask, const char *setter, time_t when);
+void banindex_remove (session *sess, char mode, const char *mask);
+void banindex_list_entry (session *sess, char mode, const char *mask, const char *setter, time_t when);
+void banindex_list_end (session *sess, char mode);
+void banindex_free (session *sess);
+char banindex_mode_for_numeric (int rplcode);
+
+gboolean banindex_mask_matches (session *sess, const ban_mask *ban, struct User *user);
+GSList *banindex_users_matching (session *sess, const char *mask);
+GSList *banindex_bans_matching (session *sess, struct User *user, char mode);
+
+#endif
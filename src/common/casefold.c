@@ -0,0 +1,408 @@
+/* PChat
+ * Copyright (C) 2026 PChat-IRC contributors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <string.h>
+
+#include "casefold.h"
+#include "util.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || (defined(__i386__) && defined(__SSE2__))
+#define CASEFOLD_SSE2
+#include <emmintrin.h>
+#if defined(__GNUC__) || defined(__clang__)
+#define CASEFOLD_AVX2
+#include <immintrin.h>
+#endif
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#define CASEFOLD_PAGE 4096
+
+/* last byte of the folded range for each CASEMAP_*; the first is always 'A' */
+static const unsigned char fold_hi[] = { '^', ']', 'Z' };
+
+static inline unsigned char
+fold_byte (unsigned char c, unsigned char hi)
+{
+	return (unsigned char) (c - 'A') <= (unsigned char) (hi - 'A') ? c + 0x20 : c;
+}
+
+static inline unsigned char
+fold_hi_for (int casemap)
+{
+	return (casemap >= 0 && casemap < (int) G_N_ELEMENTS (fold_hi)) ? fold_hi[casemap] : '^';
+}
+
+static inline int
+first_set (unsigned int mask)
+{
+#ifdef _MSC_VER
+	unsigned long i;
+
+	_BitScanForward (&i, mask);
+	return (int) i;
+#else
+	return __builtin_ctz (mask);
+#endif
+}
+
+/* TRUE if a width-byte load at p stays in p's page, so reading past the
+ * terminating NUL can't fault */
+static inline gboolean
+load_ok (const unsigned char *p, gsize width)
+{
+	return ((gsize) p & (CASEFOLD_PAGE - 1)) <= CASEFOLD_PAGE - width;
+}
+
+/* the tail rfc_casecmp always had: first differing or terminating byte */
+static int
+cmp_scalar (const unsigned char *a, const unsigned char *b, unsigned char hi)
+{
+	while (*a && *b)
+	{
+		int c1 = fold_byte (*a, hi);
+		int c2 = fold_byte (*b, hi);
+
+		if (c1 != c2)
+			return c1 - c2;
+		a++;
+		b++;
+	}
+	return ((int) (char) *a) - ((int) (char) *b);
+}
+
+static int
+ncmp_scalar (const unsigned char *a, const unsigned char *b, int n, unsigned char hi)
+{
+	while (*a && *b && n > 0)
+	{
+		int c1 = fold_byte (*a, hi);
+		int c2 = fold_byte (*b, hi);
+
+		if (c1 != c2)
+			return c1 - c2;
+		n--;
+		a++;
+		b++;
+	}
+	return (n == 0) ? 0 : fold_byte (*a, hi) - fold_byte (*b, hi);
+}
+
+static void
+copy_scalar (unsigned char *dst, const unsigned char *src, gsize len, unsigned char hi)
+{
+	gsize i;
+
+	for (i = 0; i < len; i++)
+		dst[i] = fold_byte (src[i], hi);
+}
+
+#ifdef CASEFOLD_SSE2
+
+/* x + 0x3f maps 'A' to -128, so one signed compare finds 'A'..hi */
+static inline __m128i
+fold_sse2 (__m128i x, __m128i bias, __m128i limit)
+{
+	__m128i in = _mm_cmplt_epi8 (_mm_add_epi8 (x, bias), limit);
+
+	return _mm_add_epi8 (x, _mm_and_si128 (in, _mm_set1_epi8 (0x20)));
+}
+
+/* advances *a and *b to the first folded difference or NUL; FALSE if it
+ * stopped at a page edge instead */
+static inline gboolean
+scan_sse2 (const unsigned char **pa, const unsigned char **pb, int *n, unsigned char hi)
+{
+	const __m128i bias = _mm_set1_epi8 (0x80 - 'A');
+	const __m128i limit = _mm_set1_epi8 ((char) (0x80 + hi - 'A' + 1));
+	const __m128i zero = _mm_setzero_si128 ();
+	const unsigned char *a = *pa, *b = *pb;
+	gboolean found = FALSE;
+
+	while ((!n || *n >= 16) && load_ok (a, 16) && load_ok (b, 16))
+	{
+		__m128i va = _mm_loadu_si128 ((const __m128i *) a);
+		__m128i vb = _mm_loadu_si128 ((const __m128i *) b);
+		__m128i eq = _mm_cmpeq_epi8 (fold_sse2 (va, bias, limit), fold_sse2 (vb, bias, limit));
+		unsigned int stop = (_mm_movemask_epi8 (eq) ^ 0xffff) | _mm_movemask_epi8 (_mm_cmpeq_epi8 (va, zero));
+
+		if (stop)
+		{
+			int i = first_set (stop);
+
+			a += i;
+			b += i;
+			if (n)
+				*n -= i;
+			found = TRUE;
+			break;
+		}
+		a += 16;
+		b += 16;
+		if (n)
+			*n -= 16;
+	}
+
+	*pa = a;
+	*pb = b;
+	return found;
+}
+
+static int
+cmp_sse2 (const unsigned char *a, const unsigned char *b, unsigned char hi)
+{
+	/* at a page edge, step one byte and try again */
+	while (!scan_sse2 (&a, &b, NULL, hi))
+	{
+		int c1 = fold_byte (*a, hi);
+		int c2 = fold_byte (*b, hi);
+
+		if (!*a || !*b || c1 != c2)
+			break;
+		a++;
+		b++;
+	}
+	return cmp_scalar (a, b, hi);
+}
+
+static int
+ncmp_sse2 (const unsigned char *a, const unsigned char *b, int n, unsigned char hi)
+{
+	while (n >= 16 && !scan_sse2 (&a, &b, &n, hi))
+	{
+		if (n < 16)
+			break;
+		if (!*a || !*b || fold_byte (*a, hi) != fold_byte (*b, hi))
+			break;
+		a++;
+		b++;
+		n--;
+	}
+	return ncmp_scalar (a, b, n, hi);
+}
+
+static void
+copy_sse2 (unsigned char *dst, const unsigned char *src, gsize len, unsigned char hi)
+{
+	const __m128i bias = _mm_set1_epi8 (0x80 - 'A');
+	const __m128i limit = _mm_set1_epi8 ((char) (0x80 + hi - 'A' + 1));
+	gsize i = 0;
+
+	for (; i + 16 <= len; i += 16)
+	{
+		__m128i v = _mm_loadu_si128 ((const __m128i *) (src + i));
+		_mm_storeu_si128 ((__m128i *) (dst + i), fold_sse2 (v, bias, limit));
+	}
+	copy_scalar (dst + i, src + i, len - i, hi);
+}
+
+#endif /* CASEFOLD_SSE2 */
+
+#ifdef CASEFOLD_AVX2
+
+__attribute__ ((target ("avx2")))
+static inline __m256i
+fold_avx2 (__m256i x, __m256i bias, __m256i limit)
+{
+	__m256i in = _mm256_cmpgt_epi8 (limit, _mm256_add_epi8 (x, bias));
+
+	return _mm256_add_epi8 (x, _mm256_and_si256 (in, _mm256_set1_epi8 (0x20)));
+}
+
+__attribute__ ((target ("avx2")))
+static int
+cmp_avx2 (const unsigned char *a, const unsigned char *b, unsigned char hi)
+{
+	const __m256i bias = _mm256_set1_epi8 (0x80 - 'A');
+	const __m256i limit = _mm256_set1_epi8 ((char) (0x80 + hi - 'A' + 1));
+	const __m256i zero = _mm256_setzero_si256 ();
+
+	while (load_ok (a, 32) && load_ok (b, 32))
+	{
+		__m256i va = _mm256_loadu_si256 ((const __m256i *) a);
+		__m256i vb = _mm256_loadu_si256 ((const __m256i *) b);
+		__m256i eq = _mm256_cmpeq_epi8 (fold_avx2 (va, bias, limit), fold_avx2 (vb, bias, limit));
+		unsigned int stop = ~(unsigned int) _mm256_movemask_epi8 (eq) |
+								  (unsigned int) _mm256_movemask_epi8 (_mm256_cmpeq_epi8 (va, zero));
+
+		if (stop)
+		{
+			int i = first_set (stop);
+			return cmp_scalar (a + i, b + i, hi);
+		}
+		a += 32;
+		b += 32;
+	}
+	/* near a page edge: the 16-byte path finishes it */
+	return cmp_sse2 (a, b, hi);
+}
+
+__attribute__ ((target ("avx2")))
+static void
+copy_avx2 (unsigned char *dst, const unsigned char *src, gsize len, unsigned char hi)
+{
+	const __m256i bias = _mm256_set1_epi8 (0x80 - 'A');
+	const __m256i limit = _mm256_set1_epi8 ((char) (0x80 + hi - 'A' + 1));
+	gsize i = 0;
+
+	for (; i + 32 <= len; i += 32)
+	{
+		__m256i v = _mm256_loadu_si256 ((const __m256i *) (src + i));
+		_mm256_storeu_si256 ((__m256i *) (dst + i), fold_avx2 (v, bias, limit));
+	}
+	copy_sse2 (dst + i, src + i, len - i, hi);
+}
+
+#endif /* CASEFOLD_AVX2 */
+
+static const char *impl_name;
+static int cmp_resolve (const unsigned char *a, const unsigned char *b, unsigned char hi);
+static int ncmp_resolve (const unsigned char *a, const unsigned char *b, int n, unsigned char hi);
+static void copy_resolve (unsigned char *dst, const unsigned char *src, gsize len, unsigned char hi);
+
+/* start at the resolvers, which pick the best versions on first use; a
+ * race here only means two threads store the same pointers */
+static int (*impl_cmp) (const unsigned char *, const unsigned char *, unsigned char) = cmp_resolve;
+static int (*impl_ncmp) (const unsigned char *, const unsigned char *, int, unsigned char) = ncmp_resolve;
+static void (*impl_copy) (unsigned char *, const unsigned char *, gsize, unsigned char) = copy_resolve;
+
+static void
+casefold_resolve (void)
+{
+	const char *name = "scalar";
+	int (*cmp) (const unsigned char *, const unsigned char *, unsigned char) = cmp_scalar;
+	int (*ncmp) (const unsigned char *, const unsigned char *, int, unsigned char) = ncmp_scalar;
+	void (*copy) (unsigned char *, const unsigned char *, gsize, unsigned char) = copy_scalar;
+
+#ifdef CASEFOLD_SSE2
+	name = "sse2";
+	cmp = cmp_sse2;
+	ncmp = ncmp_sse2;
+	copy = copy_sse2;
+#endif
+#ifdef CASEFOLD_AVX2
+	if (__builtin_cpu_supports ("avx2"))
+	{
+		name = "avx2";
+		cmp = cmp_avx2;
+		copy = copy_avx2;		/* n-limited compares are short; sse2 does */
+	}
+#endif
+
+	impl_name = name;
+	impl_cmp = cmp;
+	impl_ncmp = ncmp;
+	impl_copy = copy;
+}
+
+static int
+cmp_resolve (const unsigned char *a, const unsigned char *b, unsigned char hi)
+{
+	casefold_resolve ();
+	return impl_cmp (a, b, hi);
+}
+
+static int
+ncmp_resolve (const unsigned char *a, const unsigned char *b, int n, unsigned char hi)
+{
+	casefold_resolve ();
+	return impl_ncmp (a, b, n, hi);
+}
+
+static void
+copy_resolve (unsigned char *dst, const unsigned char *src, gsize len, unsigned char hi)
+{
+	casefold_resolve ();
+	impl_copy (dst, src, len, hi);
+}
+
+int
+casefold_cmp (const char *s1, const char *s2, int casemap)
+{
+	return impl_cmp ((const unsigned char *) s1, (const unsigned char *) s2, fold_hi_for (casemap));
+}
+
+int
+casefold_ncmp (const char *s1, const char *s2, int n, int casemap)
+{
+	return impl_ncmp ((const unsigned char *) s1, (const unsigned char *) s2, n, fold_hi_for (casemap));
+}
+
+/* dst may be src */
+void
+casefold_copy (char *dst, const char *src, gsize len, int casemap)
+{
+	impl_copy ((unsigned char *) dst, (const unsigned char *) src, len, fold_hi_for (casemap));
+}
+
+const char *
+casefold_impl (void)
+{
+	if (!impl_name)
+		casefold_resolve ();
+	return impl_name;
+}
+
+#define ONES G_GUINT64_CONSTANT (0x0101010101010101)
+#define HIGHS G_GUINT64_CONSTANT (0x8080808080808080)
+
+/* rfc1459-folds eight bytes at once: a byte's high bit is set after adding
+ * 0x80 - lo exactly when it is >= lo, with no carry into its neighbour as
+ * long as the byte's own high bit was cleared first */
+static inline guint64
+fold_word (guint64 w)
+{
+	guint64 low7 = w & ~HIGHS;
+	guint64 ge = low7 + ONES * (0x80 - 'A');
+	guint64 gt = low7 + ONES * (0x80 - '^' - 1);
+
+	return w | ((ge & ~gt & ~w & HIGHS) >> 2);
+}
+
+guint
+casefold_hash (gconstpointer key)
+{
+	const char *s = key;
+	gsize len = strlen (s);
+	guint64 h = G_GUINT64_CONSTANT (0xcbf29ce484222325) ^ len;
+	guint64 w;
+
+	for (; len >= 8; s += 8, len -= 8)
+	{
+		memcpy (&w, s, 8);
+		h = ((h << 5 | h >> 59) ^ fold_word (w)) * G_GUINT64_CONSTANT (0x517cc1b727220a95);
+	}
+	if (len)
+	{
+		w = 0;
+		while (len--)
+			w = w << 8 | (unsigned char) s[len];
+		h = ((h << 5 | h >> 59) ^ fold_word (w)) * G_GUINT64_CONSTANT (0x517cc1b727220a95);
+	}
+
+	return (guint) (h ^ (h >> 32));
+}
+
+gboolean
+casefold_equal (gconstpointer a, gconstpointer b)
+{
+	return casefold_cmp (a, b, CASEMAP_RFC1459) == 0;
+}
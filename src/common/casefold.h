@@ -0,0 +1,42 @@
+/* PChat
+ * Copyright (C) 2026 PChat-IRC contributors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/* Case-insensitive compare, fold and hash for nicks and channel names.
+ *
+ * All three IRC casemappings fold a single byte range onto itself + 0x20:
+ * ascii A-Z, strict-rfc1459 A-Z[\], rfc1459 A-Z[\]^. That is cheap to do
+ * 16 or 32 bytes at a time, so the compares use SSE2 or AVX2 when the CPU
+ * has them (picked once at runtime) and a byte loop otherwise. Results are
+ * identical to the byte-at-a-time rfc_casecmp/rfc_ncasecmp they replace. */
+
+#ifndef PCHAT_CASEFOLD_H
+#define PCHAT_CASEFOLD_H
+
+#include <glib.h>
+
+int casefold_cmp (const char *s1, const char *s2, int casemap);
+int casefold_ncmp (const char *s1, const char *s2, int n, int casemap);
+void casefold_copy (char *dst, const char *src, gsize len, int casemap);
+
+/* rfc1459-folded, so names equal under any casemapping hash alike */
+guint casefold_hash (gconstpointer key);
+gboolean casefold_equal (gconstpointer a, gconstpointer b);
+
+const char *casefold_impl (void);
+
+#endif
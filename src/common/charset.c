@@ -0,0 +1,232 @@
+/* PChat
+ * Copyright (C) 2026 PChat-IRC contributors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "pchat.h"
+#include "charset.h"
+#include "text.h"
+
+struct charset_table
+{
+	/* UTF-8 for each byte value, undefined bytes hold U+FFFD; 0x00-0x7F
+	   are always themselves and are copied by the ASCII path instead */
+	guchar utf8[256][3];
+	guchar len[256];
+};
+
+/* Encodings known to be single-byte and ASCII compatible. Anything else,
+   and anything iconv disagrees with when the table is built, stays on
+   iconv. Compared after dropping '-' and '_' and ignoring case. */
+static const char * const single_byte_names[] =
+{
+	"ISO88591", "ISO88592", "ISO88593", "ISO88594", "ISO88595",
+	"ISO88596", "ISO88597", "ISO88598", "ISO88599", "ISO885910",
+	"ISO885911", "ISO885913", "ISO885914", "ISO885915", "ISO885916",
+	"LATIN1", "LATIN2", "LATIN9",
+	"CP1250", "CP1251", "CP1252", "CP1253", "CP1254",
+	"CP1255", "CP1256", "CP1257", "CP1258",
+	"WINDOWS1250", "WINDOWS1251", "WINDOWS1252", "WINDOWS1253", "WINDOWS1254",
+	"WINDOWS1255", "WINDOWS1256", "WINDOWS1257", "WINDOWS1258",
+	"KOI8R", "KOI8U", "CP866", "CP437", "CP850", "TIS620",
+	NULL
+};
+
+static GHashTable *charset_tables;	/* normalized name -> charset_table, or NULL if unsuitable */
+
+static char *
+charset_normalize (const char *encoding)
+{
+	char *name = g_malloc (strlen (encoding) + 1);
+	char *p = name;
+
+	for (; *encoding; encoding++)
+	{
+		if (*encoding != '-' && *encoding != '_')
+			*p++ = g_ascii_toupper (*encoding);
+	}
+	*p = 0;
+
+	return name;
+}
+
+/* Build the table by asking iconv for each high byte once, so the result
+   is exactly what the iconv path would have produced. */
+static charset_table *
+charset_table_build (const char *encoding)
+{
+	charset_table *table;
+	GIConv conv;
+	gchar *out;
+	gsize out_len;
+	guchar c;
+	int i;
+
+	conv = g_iconv_open ("UTF-8", encoding);
+	if (conv == (GIConv) -1)
+		return NULL;
+
+	table = g_new0 (charset_table, 1);
+
+	for (i = 0; i < 256; i++)
+	{
+		c = i;
+		out = g_convert_with_iconv ((const gchar *) &c, 1, conv, NULL, &out_len, NULL);
+		g_iconv (conv, NULL, NULL, NULL, NULL);
+
+		if (i < 0x80)
+		{
+			/* must be ASCII compatible for the fast path */
+			if (!out || out_len != 1 || (guchar) out[0] != c)
+				goto fail;
+		}
+		else if (out && out_len >= 1 && out_len <= 3)
+		{
+			memcpy (table->utf8[i], out, out_len);
+			table->len[i] = out_len;
+		}
+		else if (out)
+		{
+			/* outside the BMP; not a simple single-byte charset */
+			goto fail;
+		}
+		else
+		{
+			memcpy (table->utf8[i], unicode_fallback_string, 3);
+			table->len[i] = 3;
+		}
+		g_free (out);
+	}
+
+	g_iconv_close (conv);
+	return table;
+
+fail:
+	g_free (out);
+	g_free (table);
+	g_iconv_close (conv);
+	return NULL;
+}
+
+const charset_table *
+charset_table_lookup (const char *encoding)
+{
+	charset_table *table;
+	char *name;
+	int i;
+
+	if (!encoding)
+		return NULL;
+
+	name = charset_normalize (encoding);
+
+	if (!charset_tables)
+		charset_tables = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+	else if (g_hash_table_lookup_extended (charset_tables, name, NULL, (gpointer *) &table))
+	{
+		g_free (name);
+		return table;
+	}
+
+	table = NULL;
+	for (i = 0; single_byte_names[i]; i++)
+	{
+		if (strcmp (name, single_byte_names[i]) == 0)
+		{
+			table = charset_table_build (encoding);
+			break;
+		}
+	}
+
+	/* remember failures too, so iconv isn't probed on every reconnect */
+	g_hash_table_insert (charset_tables, name, table);
+	return table;
+}
+
+/* length of the run of ASCII bytes at the start of p */
+static gsize
+charset_ascii_span (const guchar *p, gsize len)
+{
+	gsize i = 0;
+
+#ifdef __SSE2__
+	int mask;
+
+	for (; i + 16 <= len; i += 16)
+	{
+		mask = _mm_movemask_epi8 (_mm_loadu_si128 ((const __m128i *) (p + i)));
+		if (mask)
+			return i + g_bit_nth_lsf (mask, -1);
+	}
+#else
+	guint64 word;
+
+	for (; i + 8 <= len; i += 8)
+	{
+		memcpy (&word, p + i, 8);
+		if (word & G_GUINT64_CONSTANT (0x8080808080808080))
+			break;
+	}
+#endif
+
+	while (i < len && p[i] < 0x80)
+		i++;
+
+	return i;
+}
+
+/* Same contract as text_convert_invalid(): returns a newly allocated,
+   nul terminated UTF-8 string, with the length stored in len_out. */
+gchar *
+charset_decode (const charset_table *table, const gchar *text, gssize len, gsize *len_out)
+{
+	const guchar *src = (const guchar *) text;
+	gchar *result, *dest;
+	gsize pos, run;
+
+	if (len == -1)
+		len = strlen (text);
+
+	/* each byte becomes at most 3 bytes of UTF-8 */
+	result = dest = g_malloc (len * 3 + 1);
+
+	pos = 0;
+	while (pos < (gsize) len)
+	{
+		run = charset_ascii_span (src + pos, len - pos);
+		memcpy (dest, src + pos, run);
+		dest += run;
+		pos += run;
+
+		for (; pos < (gsize) len && src[pos] >= 0x80; pos++)
+		{
+			memcpy (dest, table->utf8[src[pos]], 3);
+			dest += table->len[src[pos]];
+		}
+	}
+	*dest = 0;
+
+	if (len_out)
+		*len_out = dest - result;
+
+	return result;
+}
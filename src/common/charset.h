@@ -0,0 +1,32 @@
+/* PChat
+ * Copyright (C) 2026 PChat-IRC contributors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#ifndef PCHAT_CHARSET_H
+#define PCHAT_CHARSET_H
+
+/* Decoding for single-byte server encodings (ISO-8859-x, CP125x, KOI8-x...)
+   without going through iconv: every byte maps to a fixed UTF-8 sequence,
+   so one 256-entry table does the whole job. Multi-byte and stateful
+   encodings return NULL from charset_table_lookup() and keep using iconv. */
+
+typedef struct charset_table charset_table;
+
+const charset_table *charset_table_lookup (const char *encoding);
+gchar *charset_decode (const charset_table *table, const gchar *text, gssize len, gsize *len_out);
+
+#endif
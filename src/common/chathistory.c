@@ -0,0 +1,275 @@
+/* PChat
+ * Copyright (C) 2026 PChat-IRC contributors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <string.h>
+#include <time.h>
+
+#include "pchat.h"
+#include "chathistory.h"
+#include "fe.h"
+#include "inbound.h"
+#include "server.h"
+#include "pchatc.h"
+
+#define CHATHISTORY_PAGE 50			/* messages per request */
+#define CHATHISTORY_SEEN_MAX 4096	/* msgids remembered per session */
+#define CHATHISTORY_RETRY 30			/* seconds before an unanswered request is retried */
+
+struct chathistory
+{
+	GHashTable *seen;			/* msgid -> msgid, shown in this session */
+	GQueue seen_order;		/* oldest first, to cap seen */
+	char *oldest_msgid;		/* reference for the next BEFORE request */
+	time_t oldest_stamp;
+	time_t pending;			/* when a BEFORE request was sent, 0 if none */
+	char *prepend_ref;		/* BATCH reference of the reply to that request */
+	int batch_lines;			/* lines received in the prepend_ref batch */
+	unsigned int exhausted:1;	/* nothing older on the server */
+};
+
+static struct chathistory *
+chathistory_get (session *sess)
+{
+	struct chathistory *hist = sess->chathistory;
+
+	if (!hist)
+	{
+		hist = g_new0 (struct chathistory, 1);
+		hist->seen = g_hash_table_new (g_str_hash, g_str_equal);
+		g_queue_init (&hist->seen_order);
+		sess->chathistory = hist;
+	}
+
+	return hist;
+}
+
+void
+chathistory_free (session *sess)
+{
+	struct chathistory *hist = sess->chathistory;
+
+	if (!hist)
+		return;
+
+	g_hash_table_destroy (hist->seen);
+	g_queue_clear_full (&hist->seen_order, g_free);
+	g_free (hist->oldest_msgid);
+	g_free (hist->prepend_ref);
+	g_free (hist);
+	sess->chathistory = NULL;
+}
+
+/* note a message shown in sess, from the server, a history page or the
+   scrollback file, and keep track of the oldest one for paging */
+void
+chathistory_remember (session *sess, const char *msgid, time_t stamp)
+{
+	struct chathistory *hist;
+	char *id;
+
+	if (!msgid && !stamp)
+		return;
+
+	hist = chathistory_get (sess);
+
+	if (msgid && !g_hash_table_contains (hist->seen, msgid))
+	{
+		id = g_strdup (msgid);
+		g_hash_table_add (hist->seen, id);
+		g_queue_push_tail (&hist->seen_order, id);
+
+		if (g_queue_get_length (&hist->seen_order) > CHATHISTORY_SEEN_MAX)
+		{
+			id = g_queue_pop_head (&hist->seen_order);
+			g_hash_table_remove (hist->seen, id);
+			g_free (id);
+		}
+	}
+
+	if (stamp && (!hist->oldest_stamp || stamp < hist->oldest_stamp))
+	{
+		hist->oldest_stamp = stamp;
+		g_free (hist->oldest_msgid);
+		hist->oldest_msgid = g_strdup (msgid);
+	}
+}
+
+static session *
+chathistory_find_target (server *serv, const char *target)
+{
+	session *sess;
+	char *name, *space;
+
+	name = g_strdup (target);
+	space = strchr (name, ' ');
+	if (space)
+		*space = 0;
+
+	sess = find_channel (serv, name);
+	if (!sess)
+		sess = find_dialog (serv, name);
+
+	g_free (name);
+	return sess;
+}
+
+/* TRUE if the line being processed belongs to a chathistory batch for
+   sess, i.e. it's a replayed message rather than live traffic. The
+   decision is made from the line's own batch tag, so live lines that
+   arrive while a page is open are still treated as new. */
+gboolean
+chathistory_backlog (session *sess)
+{
+	server *serv = sess->server;
+	const char *type, *params;
+
+	if (!serv || !serv->current_batch ||
+		 !inbound_batch_info (serv, serv->current_batch, &type, &params) ||
+		 strcmp (type, "chathistory") != 0)
+		return FALSE;
+
+	return chathistory_find_target (serv, params) == sess;
+}
+
+/* TRUE if the line being processed is part of an older page, to be
+   shown above the existing text */
+gboolean
+chathistory_prepending (session *sess)
+{
+	server *serv = sess->server;
+
+	return serv && serv->current_batch && sess->chathistory &&
+			 sess->chathistory->prepend_ref &&
+			 strcmp (serv->current_batch, sess->chathistory->prepend_ref) == 0;
+}
+
+/* called for each line tagged with a batch; TRUE if it's a history
+   message this session has already shown */
+gboolean
+chathistory_filter (server *serv, const message_tags_data *tags_data)
+{
+	const char *type, *params;
+	session *sess;
+
+	if (!inbound_batch_info (serv, tags_data->batch, &type, &params) ||
+		 strcmp (type, "chathistory") != 0)
+		return FALSE;
+
+	sess = chathistory_find_target (serv, params);
+	if (!sess)
+		return FALSE;
+
+	if (sess->chathistory && sess->chathistory->prepend_ref &&
+		 strcmp (tags_data->batch, sess->chathistory->prepend_ref) == 0)
+		sess->chathistory->batch_lines++;
+
+	return tags_data->msgid && sess->chathistory &&
+			 g_hash_table_contains (sess->chathistory->seen, tags_data->msgid);
+}
+
+static int
+chathistory_page_size (server *serv)
+{
+	if (serv->chathistory_limit > 0 && serv->chathistory_limit < CHATHISTORY_PAGE)
+		return serv->chathistory_limit;
+	return CHATHISTORY_PAGE;
+}
+
+void
+chathistory_request_latest (session *sess)
+{
+	server *serv = sess->server;
+
+	if (!serv->have_chathistory || !serv->connected)
+		return;
+
+	tcp_sendf (serv, "CHATHISTORY LATEST %s * %d\r\n", sess->channel,
+				  chathistory_page_size (serv));
+}
+
+/* the user scrolled to the top of sess: fetch the page before the
+   oldest message we have */
+void
+chathistory_request_before (session *sess)
+{
+	server *serv = sess->server;
+	struct chathistory *hist;
+	char stamp[64];
+	time_t now;
+
+	if (!serv->have_chathistory || !serv->connected || !sess->channel[0] ||
+		 sess->type == SESS_SERVER)
+		return;
+
+	hist = chathistory_get (sess);
+	now = time (0);
+	if (hist->exhausted || (hist->pending && now - hist->pending < CHATHISTORY_RETRY))
+		return;
+
+	if (hist->oldest_msgid)
+	{
+		tcp_sendf (serv, "CHATHISTORY BEFORE %s msgid=%s %d\r\n", sess->channel,
+					  hist->oldest_msgid, chathistory_page_size (serv));
+	}
+	else if (hist->oldest_stamp)
+	{
+		strftime (stamp, sizeof (stamp), "%Y-%m-%dT%H:%M:%S.000Z",
+					 gmtime (&hist->oldest_stamp));
+		tcp_sendf (serv, "CHATHISTORY BEFORE %s timestamp=%s %d\r\n", sess->channel,
+					  stamp, chathistory_page_size (serv));
+	}
+	else
+	{
+		/* nothing shown yet; the latest page is the one before "now" */
+		chathistory_request_latest (sess);
+		return;
+	}
+
+	hist->pending = now;
+}
+
+void
+chathistory_batch_start (server *serv, const char *ref, const char *target)
+{
+	session *sess = chathistory_find_target (serv, target);
+	struct chathistory *hist;
+
+	if (!sess || !(hist = sess->chathistory) || !hist->pending || hist->prepend_ref)
+		return;
+
+	/* the reply to a BEFORE request: print it above what's shown */
+	hist->prepend_ref = g_strdup (ref);
+	hist->batch_lines = 0;
+	fe_text_history_begin (sess);
+}
+
+void
+chathistory_batch_end (server *serv, const char *ref, const char *target)
+{
+	session *sess = chathistory_find_target (serv, target);
+	struct chathistory *hist;
+
+	if (!sess || !(hist = sess->chathistory) || g_strcmp0 (hist->prepend_ref, ref) != 0)
+		return;
+
+	fe_text_history_end (sess);
+	g_clear_pointer (&hist->prepend_ref, g_free);
+	hist->pending = 0;
+	if (hist->batch_lines < chathistory_page_size (serv))
+		hist->exhausted = TRUE;
+}
@@ -0,0 +1,39 @@
+/* PChat
+ * Copyright (C) 2026 PChat-IRC contributors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#ifndef PCHAT_CHATHISTORY_H
+#define PCHAT_CHATHISTORY_H
+
+#include "proto-irc.h"
+
+/* IRCv3 draft/chathistory: the latest page of a channel is fetched on
+   join, older pages when the user scrolls to the top of the buffer.
+   Messages are deduplicated by msgid against what the session has
+   already shown, including its scrollback file. */
+
+void chathistory_remember (session *sess, const char *msgid, time_t stamp);
+gboolean chathistory_backlog (session *sess);
+gboolean chathistory_prepending (session *sess);
+gboolean chathistory_filter (server *serv, const message_tags_data *tags_data);
+void chathistory_request_latest (session *sess);
+void chathistory_request_before (session *sess);
+void chathistory_batch_start (server *serv, const char *ref, const char *target);
+void chathistory_batch_end (server *serv, const char *ref, const char *target);
+void chathistory_free (session *sess);
+
+#endif
@@ -512,7 +512,10 @@ dcc_chat_line (struct DCC *dcc, char *line)
 	char portbuf[32];
 	message_tags_data no_tags = MESSAGE_TAGS_DATA_INIT;
 
-	line = text_convert_invalid (line, -1, dcc->serv->read_converter, unicode_fallback_string, NULL);
+	/* the server's reader thread decodes through the same converter */
+	g_mutex_lock (&dcc->serv->io_lock);
+	line = server_decode_line (dcc->serv, line, -1, NULL);
+	g_mutex_unlock (&dcc->serv->io_lock);
 
 	sess = find_dialog (dcc->serv, dcc->nick);
 	if (!sess)
@@ -87,11 +87,16 @@ int fe_is_chanwindow (struct server *serv);
 void fe_add_chan_list (struct server *serv, char *chan, char *users,
 							  char *topic);
 void fe_chan_list_end (struct server *serv);
-gboolean fe_add_ban_list (struct session *sess, char *mask, char *who, char *when, int rplcode);
+gboolean fe_add_ban_list (struct session *sess, char *mask, char *who, char *when, time_t stamp, int rplcode);
 gboolean fe_ban_list_end (struct session *sess, int rplcode);
 void fe_notify_update (char *name);
 void fe_notify_ask (char *name, char *networks);
 void fe_text_clear (struct session *sess, int lines);
+void fe_text_history_begin (struct session *sess);
+void fe_text_history_end (struct session *sess);
+void fe_print_history (struct session *sess, char *text, time_t stamp);
+void fe_text_batch_begin (struct session *sess);
+void fe_text_batch_end (struct session *sess);
 void fe_close_window (struct session *sess);
 void fe_progressbar_start (struct session *sess);
 void fe_progressbar_end (struct server *serv);
@@ -103,6 +108,8 @@ void fe_userlist_rehash (struct session *sess, struct User *user);
 void fe_userlist_update (struct session *sess, struct User *user);
 void fe_userlist_numbers (struct session *sess);
 void fe_userlist_clear (struct session *sess);
+void fe_userlist_batch_begin (struct session *sess);
+void fe_userlist_batch_end (struct session *sess);
 void fe_userlist_set_selected (struct session *sess);
 void fe_uselect (session *sess, char *word[], int do_clear, int scroll_to);
 void fe_dcc_add (struct DCC *dcc);
@@ -47,6 +47,8 @@
 #include "ctcp.h"
 #include "pchatc.h"
 #include "chanopt.h"
+#include "banindex.h"
+#include "chathistory.h"
 
 
 void
@@ -61,15 +63,12 @@ clear_channel (session *sess)
 	}
 	sess->channel[0] = 0;
 	sess->doing_who = FALSE;
+	userlist_who_discard (sess);
 	sess->done_away_check = FALSE;
 
 	log_close (sess);
 
-	if (sess->current_modes)
-	{
-		g_free (sess->current_modes);
-		sess->current_modes = NULL;
-	}
+	chan_modes_clear (sess);
 
 	if (sess->mode_timeout_tag)
 	{
@@ -77,6 +76,8 @@ clear_channel (session *sess)
 		sess->mode_timeout_tag = 0;
 	}
 
+	banindex_free (sess);
+
 	fe_clear_channel (sess);
 	userlist_clear (sess);
 	fe_set_nonchannel (sess, FALSE);
@@ -412,8 +413,10 @@ inbound_action (session *sess, char *chan, char *from, char *ip, char *text,
 		EMIT_SIGNAL_TIMESTAMP (XP_TE_UACTION, sess, from, text, nickchar, idtext,
 									  0, tags_data->timestamp);
 	else if (!privaction)
-		EMIT_SIGNAL_TIMESTAMP (XP_TE_CHANACTION, sess, from, text, nickchar,
-									  idtext, 0, tags_data->timestamp);
+	{
+		text_emit_speaker (XP_TE_CHANACTION, sess, user, from, text, nickchar,
+								 idtext, tags_data->timestamp);
+	}
 	else if (sess->type == SESS_DIALOG)
 		EMIT_SIGNAL_TIMESTAMP (XP_TE_DPRIVACTION, sess, from, text, idtext, NULL,
 									  0, tags_data->timestamp);
@@ -429,6 +432,7 @@ inbound_chanmsg (server *serv, session *sess, char *chan, char *from,
 {
 	struct User *user;
 	int hilight = FALSE;
+	int backlog;
 	char nickchar[2] = "\000";
 	char idtext[64];
 
@@ -447,7 +451,10 @@ inbound_chanmsg (server *serv, session *sess, char *chan, char *from,
 			return;
 	}
 
-	if (sess != current_tab)
+	/* a page of history being replayed isn't news */
+	backlog = chathistory_backlog (sess);
+
+	if (sess != current_tab && !backlog)
 	{
 		sess->tab_state |= TAB_STATE_NEW_MSG;
 		lastact_update (sess);
@@ -475,7 +482,7 @@ inbound_chanmsg (server *serv, session *sess, char *chan, char *from,
 
 	inbound_make_idtext (serv, idtext, sizeof (idtext), id);
 
-	if (is_hilight (from, text, sess, serv))
+	if (!backlog && is_hilight (from, text, sess, serv))
 		hilight = TRUE;
 
 	if (sess->type == SESS_DIALOG)
@@ -485,8 +492,10 @@ inbound_chanmsg (server *serv, session *sess, char *chan, char *from,
 		EMIT_SIGNAL_TIMESTAMP (XP_TE_HCHANMSG, sess, from, text, nickchar, idtext,
 									  0, tags_data->timestamp);
 	else
-		EMIT_SIGNAL_TIMESTAMP (XP_TE_CHANMSG, sess, from, text, nickchar, idtext,
-									  0, tags_data->timestamp);
+	{
+		text_emit_speaker (XP_TE_CHANMSG, sess, user, from, text, nickchar, idtext,
+								 tags_data->timestamp);
+	}
 }
 
 void
@@ -645,6 +654,8 @@ inbound_ujoin (server *serv, char *chan, char *nick, char *ip,
 	EMIT_SIGNAL_TIMESTAMP (XP_TE_UJOIN, sess, nick, chan, ip, NULL, 0,
 								  tags_data->timestamp);
 
+	chathistory_request_latest (sess);
+
 	if (prefs.pchat_irc_who_join)
 	{
 		/* sends WHO #channel */
@@ -786,11 +797,322 @@ inbound_topicnew (server *serv, char *nick, char *chan, char *topic,
 	}
 }
 
+/* IRCv3 BATCH. Netsplit and netjoin batches are held until "BATCH -ref"
+   and then applied a channel at a time, printing one summary line per
+   channel instead of one QUIT or JOIN per user. Lines in other batch
+   types are processed as they arrive. */
+
+#define BATCH_FREEZE_MIN 16		/* fewer changes than this are cheaper done per user */
+#define BATCH_NICKS_MAX 400		/* bytes of nick list shown in a summary */
+
+struct irc_batch
+{
+	char *type;
+	char *params;
+	GSList *members;		/* struct batch_member, newest first */
+};
+
+struct batch_member
+{
+	char *nick;
+	char *ip;
+	char *chan;				/* netjoin only */
+	char *account;
+	char *realname;
+	char *reason;			/* netsplit only */
+};
+
+static void
+batch_member_free (struct batch_member *member)
+{
+	g_free (member->nick);
+	g_free (member->ip);
+	g_free (member->chan);
+	g_free (member->account);
+	g_free (member->realname);
+	g_free (member->reason);
+	g_free (member);
+}
+
+static void
+batch_free (struct irc_batch *batch)
+{
+	g_slist_free_full (batch->members, (GDestroyNotify) batch_member_free);
+	g_free (batch->type);
+	g_free (batch->params);
+	g_free (batch);
+}
+
+void
+inbound_batch_start (server *serv, char *ref, char *type, char *params)
+{
+	struct irc_batch *batch;
+
+	if (!*ref)
+		return;
+
+	if (!serv->batches)
+		serv->batches = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+															(GDestroyNotify) batch_free);
+
+	if (*params == ':')
+		params++;
+
+	batch = g_new0 (struct irc_batch, 1);
+	batch->type = g_ascii_strdown (type, -1);
+	batch->params = g_strdup (params);
+	g_hash_table_replace (serv->batches, g_strdup (ref), batch);
+
+	if (!strcmp (batch->type, "chathistory"))
+		chathistory_batch_start (serv, ref, batch->params);
+}
+
+/* type and parameters of the open batch ref, FALSE if there's none */
+gboolean
+inbound_batch_info (server *serv, const char *ref, const char **type, const char **params)
+{
+	struct irc_batch *batch;
+
+	if (!ref || !serv->batches || !(batch = g_hash_table_lookup (serv->batches, ref)))
+		return FALSE;
+
+	*type = batch->type;
+	*params = batch->params;
+	return TRUE;
+}
+
+void
+inbound_batch_clear (server *serv)
+{
+	g_clear_pointer (&serv->batches, g_hash_table_destroy);
+}
+
+/* the open batch of the given type this message belongs to, if any */
+static struct irc_batch *
+batch_find (server *serv, const message_tags_data *tags_data, const char *type)
+{
+	struct irc_batch *batch;
+
+	if (!tags_data->batch || !serv->batches)
+		return NULL;
+
+	batch = g_hash_table_lookup (serv->batches, tags_data->batch);
+	if (batch && !strcmp (batch->type, type))
+		return batch;
+
+	return NULL;
+}
+
+static void
+batch_nick_append (GString *nicks, const char *nick)
+{
+	if (nicks->len >= BATCH_NICKS_MAX)
+	{
+		if (nicks->str[nicks->len - 1] != '.')
+			g_string_append (nicks, ", ...");
+		return;
+	}
+	if (nicks->len)
+		g_string_append (nicks, ", ");
+	g_string_append (nicks, nick);
+}
+
+static void
+batch_apply_netsplit (server *serv, struct irc_batch *batch,
+							 const message_tags_data *tags_data)
+{
+	GSList *sessions, *list, *m, *users;
+	session *sess;
+	struct batch_member *member;
+	struct User *user;
+	GString *nicks;
+	char count[16];
+	int was_on_front_session = FALSE;
+
+	/* plugin hooks run below may close sessions, which unlinks them
+	   from sess_list, so walk a copy and skip any that have gone */
+	sessions = g_slist_copy (sess_list);
+	for (list = sessions; list; list = list->next)
+	{
+		sess = list->data;
+		if (!is_session (sess) || sess->server != serv)
+			continue;
+		if (sess == current_sess)
+			was_on_front_session = TRUE;
+
+		if (sess->type == SESS_DIALOG)
+		{
+			for (m = batch->members; m && is_session (sess); m = m->next)
+			{
+				member = m->data;
+				if (!serv->p_cmp (sess->channel, member->nick))
+					EMIT_SIGNAL_TIMESTAMP (XP_TE_QUIT, sess, member->nick, member->reason,
+												  member->ip, NULL, 0, tags_data->timestamp);
+			}
+			continue;
+		}
+
+		/* plugins still get a Quit per user, only the display is summarised */
+		for (m = batch->members; m && is_session (sess); m = m->next)
+		{
+			member = m->data;
+			if (userlist_find (sess, member->nick))
+				text_emit_hidden (XP_TE_QUIT, sess, member->nick, member->reason,
+										member->ip, NULL, tags_data->timestamp);
+		}
+		if (!is_session (sess))
+			continue;
+
+		users = NULL;
+		for (m = batch->members; m; m = m->next)
+		{
+			member = m->data;
+			if ((user = userlist_find (sess, member->nick)))
+				users = g_slist_prepend (users, user);
+		}
+		if (!users)
+			continue;
+
+		users = g_slist_reverse (users);
+		if (g_slist_length (users) >= BATCH_FREEZE_MIN)
+			userlist_freeze (sess);
+
+		nicks = g_string_new (NULL);
+		for (m = users; m; m = m->next)
+		{
+			user = m->data;
+			batch_nick_append (nicks, user->nick);
+		}
+		g_snprintf (count, sizeof (count), "%u", g_slist_length (users));
+
+		for (m = users; m; m = m->next)
+			userlist_remove_user (sess, m->data);
+		g_slist_free (users);
+		userlist_thaw (sess);
+
+		EMIT_SIGNAL_TIMESTAMP (XP_TE_NETSPLIT, sess, batch->params, count, nicks->str,
+									  NULL, 0, tags_data->timestamp);
+		g_string_free (nicks, TRUE);
+	}
+	g_slist_free (sessions);
+
+	for (m = batch->members; m; m = m->next)
+	{
+		member = m->data;
+		notify_set_offline (serv, member->nick, was_on_front_session, tags_data);
+	}
+}
+
+static void
+batch_apply_netjoin (server *serv, struct irc_batch *batch,
+							const message_tags_data *tags_data)
+{
+	GHashTable *by_sess;
+	GHashTableIter iter;
+	GSList *m, *members;
+	session *sess;
+	struct batch_member *member;
+	GString *nicks;
+	char count[16];
+
+	/* group the JOINs by channel */
+	by_sess = g_hash_table_new (NULL, NULL);
+	for (m = batch->members; m; m = m->next)
+	{
+		member = m->data;
+		sess = find_channel (serv, member->chan);
+		if (!sess)
+			continue;
+		members = g_hash_table_lookup (by_sess, sess);
+		g_hash_table_insert (by_sess, sess, g_slist_prepend (members, member));
+	}
+
+	g_hash_table_iter_init (&iter, by_sess);
+	while (g_hash_table_iter_next (&iter, (gpointer *) &sess, (gpointer *) &members))
+	{
+		members = g_slist_reverse (members);
+
+		/* plugins still get a Join per user, only the display is summarised */
+		for (m = members; m && is_session (sess); m = m->next)
+		{
+			member = m->data;
+			text_emit_hidden (XP_TE_JOIN, sess, member->nick, member->chan, member->ip,
+									member->account, tags_data->timestamp);
+		}
+		if (!is_session (sess))
+		{
+			g_slist_free (members);
+			continue;
+		}
+
+		if (g_slist_length (members) >= BATCH_FREEZE_MIN)
+			userlist_freeze (sess);
+
+		nicks = g_string_new (NULL);
+		for (m = members; m; m = m->next)
+		{
+			member = m->data;
+			userlist_add (sess, member->nick, member->ip, member->account,
+							  member->realname, tags_data);
+			batch_nick_append (nicks, member->nick);
+		}
+		userlist_thaw (sess);
+
+		g_snprintf (count, sizeof (count), "%u", g_slist_length (members));
+		EMIT_SIGNAL_TIMESTAMP (XP_TE_NETJOIN, sess, batch->params, count, nicks->str,
+									  NULL, 0, tags_data->timestamp);
+		g_string_free (nicks, TRUE);
+		g_slist_free (members);
+	}
+
+	g_hash_table_destroy (by_sess);
+}
+
+void
+inbound_batch_end (server *serv, char *ref, const message_tags_data *tags_data)
+{
+	struct irc_batch *batch;
+	gpointer key;
+
+	if (!serv->batches ||
+		 !g_hash_table_lookup_extended (serv->batches, ref, &key, (gpointer *) &batch))
+		return;
+
+	g_hash_table_steal (serv->batches, ref);
+	batch->members = g_slist_reverse (batch->members);
+
+	if (!strcmp (batch->type, "netsplit"))
+		batch_apply_netsplit (serv, batch, tags_data);
+	else if (!strcmp (batch->type, "netjoin"))
+		batch_apply_netjoin (serv, batch, tags_data);
+	else if (!strcmp (batch->type, "chathistory"))
+		chathistory_batch_end (serv, ref, batch->params);
+
+	g_free (key);
+	batch_free (batch);
+}
+
 void
 inbound_join (server *serv, char *chan, char *user, char *ip, char *account,
 				  char *realname, const message_tags_data *tags_data)
 {
-	session *sess = find_channel (serv, chan);
+	struct irc_batch *batch;
+	struct batch_member *member;
+	session *sess;
+
+	if ((batch = batch_find (serv, tags_data, "netjoin")))
+	{
+		member = g_new0 (struct batch_member, 1);
+		member->nick = g_strdup (user);
+		member->ip = g_strdup (ip);
+		member->chan = g_strdup (chan);
+		member->account = g_strdup (account);
+		member->realname = g_strdup (realname);
+		batch->members = g_slist_prepend (batch->members, member);
+		return;
+	}
+
+	sess = find_channel (serv, chan);
 	if (sess)
 	{
 		EMIT_SIGNAL_TIMESTAMP (XP_TE_JOIN, sess, user, chan, ip, account, 0,
@@ -853,8 +1175,20 @@ inbound_quit (server *serv, char *nick, char *ip, char *reason,
 	GSList *list = sess_list;
 	session *sess;
 	struct User *user;
+	struct irc_batch *batch;
+	struct batch_member *member;
 	int was_on_front_session = FALSE;
 
+	if ((batch = batch_find (serv, tags_data, "netsplit")))
+	{
+		member = g_new0 (struct batch_member, 1);
+		member->nick = g_strdup (nick);
+		member->ip = g_strdup (ip);
+		member->reason = g_strdup (reason);
+		batch->members = g_slist_prepend (batch->members, member);
+		return;
+	}
+
 	while (list)
 	{
 		sess = (session *) list->data;
@@ -1481,7 +1815,9 @@ inbound_user_info (session *sess, char *chan, char *user, char *host,
 	if (chan)
 	{
 		who_sess = find_channel (serv, chan);
-		if (who_sess)
+		if (who_sess && who_sess->doing_who)
+			userlist_who_add (who_sess, nick, uhost, realname, servname, account, away);
+		else if (who_sess)
 			userlist_add_hostname (who_sess, nick, uhost, realname, servname, account, away);
 		else
 		{
@@ -1537,7 +1873,9 @@ inbound_banlist (session *sess, time_t stamp, char *chan, char *mask,
 		goto nowindow;
 	}
 
-	if (!fe_add_ban_list (sess, mask, banner, time_str, rplcode))
+	banindex_list_entry (sess, banindex_mode_for_numeric (rplcode), mask, banner, stamp);
+
+	if (!fe_add_ban_list (sess, mask, banner, time_str, stamp, rplcode))
 	{
 nowindow:
 
@@ -1549,6 +1887,19 @@ nowindow:
 	return TRUE;
 }
 
+/* end of a 367/348/346/728 list; returns the channel's session or NULL */
+
+session *
+inbound_banlist_end (server *serv, char *chan, int rplcode)
+{
+	session *sess = find_channel (serv, chan);
+
+	if (sess)
+		banindex_list_end (sess, banindex_mode_for_numeric (rplcode));
+
+	return sess;
+}
+
 /* execute 1 end-of-motd command */
 
 static int
@@ -1705,6 +2056,12 @@ inbound_toggle_caps (server *serv, const char *extensions_str, gboolean enable)
 			serv->have_awaynotify = enable;
 		else if (!strcmp (extension, "account-tag"))
 			serv->have_account_tag = enable;
+		else if (!strcmp (extension, "batch"))
+			serv->have_batch = enable;
+		else if (!strcmp (extension, "draft/chathistory"))
+			serv->have_chathistory = enable;
+		else if (!strcmp (extension, "draft/multiline"))
+			serv->have_multiline = enable;
 		else if (!strcmp (extension, "sasl"))
 		{
 			serv->have_sasl = enable;
@@ -1766,6 +2123,10 @@ static const char * const supported_caps[] = {
 	"invite-notify",
 	"account-tag",
 	"extended-monitor",
+	"batch",
+	"message-tags",
+	"draft/chathistory",
+	"draft/multiline",
 
 	/* ZNC */
 	"znc.in/server-time-iso",
@@ -1833,6 +2194,31 @@ get_supported_mech (server *serv, const char *list)
 	return ret;
 }
 
+/* draft/multiline=max-bytes=4096[,max-lines=24] */
+
+static void
+inbound_multiline_limits (server *serv, const char *value)
+{
+	char **keys;
+	gsize i;
+
+	serv->multiline_max_bytes = 0;
+	serv->multiline_max_lines = 0;
+
+	if (!value)
+		return;
+
+	keys = g_strsplit (value, ",", 0);
+	for (i = 0; keys[i]; i++)
+	{
+		if (g_str_has_prefix (keys[i], "max-bytes="))
+			serv->multiline_max_bytes = atoi (keys[i] + 10);
+		else if (g_str_has_prefix (keys[i], "max-lines="))
+			serv->multiline_max_lines = atoi (keys[i] + 10);
+	}
+	g_strfreev (keys);
+}
+
 void
 inbound_cap_ls (server *serv, char *nick, char *extensions_str,
 					 const message_tags_data *tags_data)
@@ -1895,6 +2281,9 @@ inbound_cap_ls (server *serv, char *nick, char *extensions_str,
 			continue;
 		}
 
+		if (!g_strcmp0 (extension, "draft/multiline"))
+			inbound_multiline_limits (serv, value);
+
 		for (x = 0; x < G_N_ELEMENTS(supported_caps); ++x)
 		{
 			if (!g_strcmp0 (extension, supported_caps[x]))
@@ -1992,34 +2381,10 @@ plain_authenticate (server *serv, char *user, char *password)
 }
 
 #ifdef USE_SSL
-/*
- * Sends AUTHENTICATE messages to log in via SCRAM.
- */
 static void
-scram_authenticate (server *serv, const char *data, const char *digest,
-					const char *user, const char *password)
+scram_send (server *serv, scram_status status, char *output, size_t output_len)
 {
-	char *encoded, *decoded, *output;
-	scram_status status;
-	size_t output_len;
-	gsize decoded_len;
-
-	if (serv->scram_session == NULL)
-	{
-		serv->scram_session = scram_session_create (digest, user, password);
-
-		if (serv->scram_session == NULL)
-		{
-			PrintTextf (serv->server_session, _("Could not create SCRAM session with digest %s"), digest);
-			g_warning ("Could not create SCRAM session with digest %s", digest);
-			tcp_sendf (serv, "AUTHENTICATE *\r\n");
-			return;
-		}
-	}
-
-	decoded = (char *)g_base64_decode (data, &decoded_len);
-	status = scram_process (serv->scram_session, decoded, &output, &output_len);
-	g_free (decoded);
+	char *encoded;
 
 	if (status == SCRAM_IN_PROGRESS)
 	{
@@ -2027,7 +2392,6 @@ scram_authenticate (server *serv, const char *data, const char *digest,
 		encoded = g_base64_encode ((guchar *) output, output_len);
 		tcp_sendf (serv, "AUTHENTICATE %s\r\n", encoded);
 		g_free (encoded);
-		g_free (output);
 	}
 	else if (status == SCRAM_SUCCESS)
 	{
@@ -2048,6 +2412,65 @@ scram_authenticate (server *serv, const char *data, const char *digest,
 
 		g_clear_pointer (&serv->scram_session, scram_session_free);
 	}
+	/* SCRAM_PENDING: the key derivation thread calls scram_ready */
+
+	g_free (output);
+}
+
+/* The session is freed with the server and on disconnect, which detaches
+ * it from the derivation thread, so serv is still valid here. */
+static void
+scram_ready (scram_session *session, void *user_data)
+{
+	server *serv = user_data;
+	scram_status status;
+	char *output;
+	size_t output_len;
+
+	/* nothing to answer on a connection that's gone */
+	if (!serv->connected)
+	{
+		g_clear_pointer (&serv->scram_session, scram_session_free);
+		return;
+	}
+
+	status = scram_process (session, NULL, &output, &output_len);
+	scram_send (serv, status, output, output_len);
+}
+
+/*
+ * Sends AUTHENTICATE messages to log in via SCRAM.
+ */
+static void
+scram_authenticate (server *serv, const char *data, const char *digest,
+					const char *user, const char *password)
+{
+	ircnet *net = serv->network;
+	char *decoded, *output;
+	scram_status status;
+	size_t output_len;
+	gsize decoded_len;
+
+	if (serv->scram_session == NULL)
+	{
+		serv->scram_session = scram_session_create (digest, user, password,
+																  net ? net->name : serv->servername,
+																  scram_ready, serv);
+
+		if (serv->scram_session == NULL)
+		{
+			PrintTextf (serv->server_session, _("Could not create SCRAM session with digest %s"), digest);
+			g_warning ("Could not create SCRAM session with digest %s", digest);
+			tcp_sendf (serv, "AUTHENTICATE *\r\n");
+			return;
+		}
+	}
+
+	decoded = (char *)g_base64_decode (data, &decoded_len);
+	status = scram_process (serv->scram_session, decoded, &output, &output_len);
+	g_free (decoded);
+
+	scram_send (serv, status, output, output_len);
 }
 #endif
 
@@ -2097,6 +2520,9 @@ void
 inbound_sasl_error (server *serv)
 {
 #ifdef USE_SSL
+	/* a rejected proof may come from stale cached keys */
+	if (serv->scram_session)
+		scram_session_forget (serv->scram_session);
     g_clear_pointer (&serv->scram_session, scram_session_free);
 #endif
 	/* Just abort, not much we can do */
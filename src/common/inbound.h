@@ -61,6 +61,11 @@ void inbound_foundip (session *sess, char *ip,
 int inbound_banlist (session *sess, time_t stamp, char *chan, char *mask, 
 							char *banner, int is_exemption,
 							const message_tags_data *tags_data);
+session *inbound_banlist_end (server *serv, char *chan, int rplcode);
+void inbound_batch_start (server *serv, char *ref, char *type, char *params);
+void inbound_batch_end (server *serv, char *ref, const message_tags_data *tags_data);
+void inbound_batch_clear (server *serv);
+gboolean inbound_batch_info (server *serv, const char *ref, const char **type, const char **params);
 void inbound_ping_reply (session *sess, char *timestring, char *from,
 								 const message_tags_data *tags_data);
 void inbound_nameslist (server *serv, char *chan, char *names,
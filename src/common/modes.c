@@ -28,6 +28,7 @@
 #include "fe.h"
 #include "util.h"
 #include "inbound.h"
+#include "banindex.h"
 #ifdef HAVE_STRINGS_H
 #include <strings.h>
 #endif
@@ -54,6 +55,20 @@ static void mode_print_grouped (session *sess, char *nick, mode_run *mr,
 										  const message_tags_data *tags_data);
 static int mode_chanmode_type (server * serv, char mode);
 
+/* server->mode_class: CHANMODES type + 1 (0 if not listed), plus a flag
+   for PREFIX modes */
+#define MODE_CLASS_TYPE 0x07
+#define MODE_CLASS_NICK 0x08
+
+/* session->mode_args element */
+struct chan_mode_arg
+{
+	char mode;
+	char *arg;
+};
+
+#define MODE_BIT_SET(sess, m) ((sess)->mode_bits[(m) >> 5] & (1u << ((m) & 31)))
+
 
 /* word[] - list of nicks.
    wpos   - index into word[]. Where nicks really start.
@@ -179,6 +194,47 @@ get_nick_prefix (server * serv, unsigned int access)
 	return 0;
 }
 
+/* where a prefix char stands among the server's PREFIX levels */
+
+int
+get_prefix_rank (server *serv, char prefix)
+{
+	char *pre;
+	int level;
+
+	/* these ones are hardcoded */
+	switch (prefix)
+	{
+		case 0: return USER_RANK_NONE;
+		case '+': return USER_RANK_VOICE;
+		case '%': return USER_RANK_HALFOP;
+		case '@': return USER_RANK_OP;
+	}
+
+	/* find out how many levels above Op this user is */
+	pre = strchr (serv->nick_prefixes, '@');
+	if (pre && pre != serv->nick_prefixes)
+	{
+		pre--;
+		level = 0;
+		while (1)
+		{
+			if (pre[0] == prefix)
+			{
+				if (level < 3)
+					return USER_RANK_OWNER + level;
+				break;	/* 4+, no icons */
+			}
+			level++;
+			if (pre == serv->nick_prefixes)
+				break;
+			pre--;
+		}
+	}
+
+	return USER_RANK_OTHER;
+}
+
 /* returns the access bitfield for a nickname. E.g.
 	@nick would return 000010 in binary
 	%nick would return 000100 in binary
@@ -236,134 +292,118 @@ mode_access (server * serv, char mode, char *prefix)
 	return -1;
 }
 
+static void
+chan_mode_arg_free (struct chan_mode_arg *ma)
+{
+	g_free (ma->arg);
+}
+
 static void
 record_chan_mode (session *sess, char sign, char mode, char *arg)
 {
 	/* Somebody needed to acutally update sess->current_modes, needed to
 		play nice with bouncers, and less mode calls. Also keeps modes up
-		to date for scripts */
-	server *serv = sess->server;
-	GString *current = g_string_new(sess->current_modes);
-	gint mode_pos = -1;
-	gchar *current_char = current->str;
-	gint modes_length;
-	gint argument_num = 0;
-	gint argument_offset = 0;
-	gint argument_length = 0;
-	int i = 0;
-	gchar *arguments_start;
-
-	/* find out if the mode currently exists */
-	arguments_start = g_strstr_len(current->str	, -1, " ");
-	if (arguments_start) {
-		modes_length = arguments_start - current->str;
-	}
-	else {
-		modes_length = current->len;
-		/* set this to the end of the modes */
-		arguments_start = current->str + current->len;
-	}
-
-	while (mode_pos == -1 && i < modes_length)
-	{
-		if (*current_char == mode)
-		{
-			mode_pos = i;
-		}
-		else
-		{
-			i++;
-			current_char++;
-		}
-	}
+		to date for scripts. The string is only rendered when read. */
+	guchar m = mode;
+	struct chan_mode_arg ma, *cur;
+	guint i;
 
-	/* if the mode currently exists and has an arg, need to know where
-	 * (including leading space) */
-	if (mode_pos != -1 && mode_has_arg(serv, '+', mode))
+	/* find an existing parameter */
+	cur = NULL;
+	for (i = 0; sess->mode_args && i < sess->mode_args->len; i++)
 	{
-		current_char = current->str;
-
-		i = 0;
-		while (i <= mode_pos)
+		if (g_array_index (sess->mode_args, struct chan_mode_arg, i).mode == mode)
 		{
-			if (mode_has_arg(serv, '+', *current_char))
-				argument_num++;
-			current_char++;
-			i++;
+			cur = &g_array_index (sess->mode_args, struct chan_mode_arg, i);
+			break;
 		}
+	}
 
-		/* check through arguments for where to start */
-		current_char = arguments_start;
-		i = 0;
-		while (i < argument_num && *current_char != '\0')
-		{
-			if (*current_char == ' ')
-				i++;
-			if (i != argument_num)
-				current_char++;
-		}
-		argument_offset = current_char - current->str;
+	if (sign == '+')
+	{
+		sess->mode_bits[m >> 5] |= 1u << (m & 31);
 
-		/* how long the existing argument is for this key
-		 * important for malloc and strncpy */
-		if (i == argument_num)
+		if (mode_has_arg (sess->server, sign, mode))
 		{
-			argument_length++;
-			current_char++;
-			while (*current_char != '\0' && *current_char != ' ')
+			if (cur)
+			{
+				g_free (cur->arg);
+				cur->arg = g_strdup (arg);
+			}
+			else
 			{
-				argument_length++;
-				current_char++;
+				if (!sess->mode_args)
+				{
+					sess->mode_args = g_array_new (FALSE, FALSE, sizeof (struct chan_mode_arg));
+					g_array_set_clear_func (sess->mode_args, (GDestroyNotify) chan_mode_arg_free);
+				}
+				ma.mode = mode;
+				ma.arg = g_strdup (arg);
+				g_array_append_val (sess->mode_args, ma);
 			}
 		}
 	}
+	else if (sign == '-' && MODE_BIT_SET (sess, m))
+	{
+		sess->mode_bits[m >> 5] &= ~(1u << (m & 31));
+		if (cur)
+			g_array_remove_index (sess->mode_args, i);
+	}
+	else
+		return;
 
-	/* two cases, adding and removing a mode, handled differently */
-	if (sign == '+')
+	sess->modes_known = TRUE;
+	g_clear_pointer (&sess->current_modes, g_free);
+}
+
+/* "+modes args" for the channel, NULL if nothing is known yet */
+
+char *
+chan_modes_get (session *sess)
+{
+	GString *str;
+	struct chan_mode_arg *ma;
+	guint m, i;
+
+	if (sess->current_modes || !sess->modes_known)
+		return sess->current_modes;
+
+	str = g_string_new ("+");
+	for (m = 1; m < 256; m++)
 	{
-		if (mode_pos != -1)
-		{
-			/* if it already exists, only need to do something (change)
-			 * if there should be a param */
-			if (mode_has_arg(serv, sign, mode))
-			{
-				/* leave the old space there */
-				current = g_string_erase(current, argument_offset+1, argument_length-1);
-				current = g_string_insert(current, argument_offset+1, arg);
+		if (MODE_BIT_SET (sess, m))
+			g_string_append_c (str, m);
+	}
 
-				g_free(sess->current_modes);
-				sess->current_modes = g_string_free(current, FALSE);
-			}
-		}
-		/* mode wasn't there before */
-		else
+	/* parameters in the same order as their mode chars */
+	for (m = 1; m < 256 && sess->mode_args; m++)
+	{
+		if (!MODE_BIT_SET (sess, m))
+			continue;
+		for (i = 0; i < sess->mode_args->len; i++)
 		{
-			/* insert the new mode character */
-			current = g_string_insert_c(current, modes_length, mode);
-
-			/* add the argument, with space if there is one */
-			if (mode_has_arg(serv, sign, mode))
+			ma = &g_array_index (sess->mode_args, struct chan_mode_arg, i);
+			if (ma->mode == (char) m)
 			{
-				current = g_string_append_c(current, ' ');
-				current = g_string_append(current, arg);
+				g_string_append_c (str, ' ');
+				g_string_append (str, ma->arg);
+				break;
 			}
-
-			g_free(sess->current_modes);
-			sess->current_modes = g_string_free(current, FALSE);
 		}
 	}
-	else if (sign == '-' && mode_pos != -1)
-	{
-		/* remove the argument first if it has one*/
-		if (mode_has_arg(serv, '+', mode))
-			current = g_string_erase(current, argument_offset, argument_length);
 
-		/* remove the mode character */
-		current = g_string_erase(current, mode_pos, 1);
+	sess->current_modes = g_string_free (str, FALSE);
+	return sess->current_modes;
+}
 
-		g_free(sess->current_modes);
-		sess->current_modes = g_string_free(current, FALSE);
-	}
+void
+chan_modes_clear (session *sess)
+{
+	memset (sess->mode_bits, 0, sizeof (sess->mode_bits));
+	if (sess->mode_args)
+		g_array_set_size (sess->mode_args, 0);
+	sess->modes_known = FALSE;
+	g_clear_pointer (&sess->current_modes, g_free);
 }
 
 static char *
@@ -397,8 +437,9 @@ handle_single_mode (mode_run *mr, char sign, char mode, char *nick,
 	session *sess;
 	server *serv = mr->serv;
 	char outbuf[4];
-	char *cm = serv->chanmodes;
-	gboolean supportsq = FALSE;
+	gboolean supportsq;
+	/* replayed modes (bouncer playback, chathistory) carry their own time */
+	time_t set_at = tags_data->timestamp ? tags_data->timestamp : time (0);
 
 	outbuf[0] = sign;
 	outbuf[1] = 0;
@@ -414,26 +455,23 @@ handle_single_mode (mode_run *mr, char sign, char mode, char *nick,
 	}
 
 	/* is this a nick mode? */
-	if (strchr (serv->nick_modes, mode))
+	if (serv->mode_class[(guchar) mode] & MODE_CLASS_NICK)
 	{
 		/* update the user in the userlist */
 		userlist_update_mode (sess, /*nickname */ arg, mode, sign);
 	} else
 	{
-		if (!is_324 && !sess->ignore_mode && mode_chanmode_type(serv, mode) >= 1)
+		/* 324 replaces the whole set, see handle_mode(). It only lists
+			modes that are set, so keep ones CHANMODES doesn't mention too,
+			as plain flags (mode_has_arg() gives them no parameter). */
+		if ((is_324 || !sess->ignore_mode) && mode_chanmode_type(serv, mode) >= 1)
 			record_chan_mode (sess, sign, mode, arg);
+		else if (is_324 && mode_chanmode_type(serv, mode) == -1)
+			record_chan_mode (sess, sign, mode, NULL);
 	}
 
-	/* Is q a chanmode on this server? */
-	if (cm)
-		while (*cm)
-		{
-			if (*cm == ',')
-				break;
-			if (*cm == 'q')
-				supportsq = TRUE;
-			cm++;
-		}
+	/* Is q a list chanmode (type A) on this server? */
+	supportsq = mode_chanmode_type (serv, 'q') == 0;
 
 	switch (sign)
 	{
@@ -470,16 +508,19 @@ handle_single_mode (mode_run *mr, char sign, char mode, char *nick,
 				mr->voice = mode_cat (mr->voice, arg);
 			return;
 		case 'b':
+			banindex_add (sess, mode, arg, nick, set_at);
 			if (!quiet)
 				EMIT_SIGNAL_TIMESTAMP (XP_TE_CHANBAN, sess, nick, arg, NULL, NULL,
 											  0, tags_data->timestamp);
 			return;
 		case 'e':
+			banindex_add (sess, mode, arg, nick, set_at);
 			if (!quiet)
 				EMIT_SIGNAL_TIMESTAMP (XP_TE_CHANEXEMPT, sess, nick, arg, NULL,
 											  NULL, 0, tags_data->timestamp);
 			return;
 		case 'I':
+			banindex_add (sess, mode, arg, nick, set_at);
 			if (!quiet)
 				EMIT_SIGNAL_TIMESTAMP (XP_TE_CHANINVITE, sess, nick, arg, NULL, NULL,
 											  0, tags_data->timestamp);
@@ -487,6 +528,7 @@ handle_single_mode (mode_run *mr, char sign, char mode, char *nick,
 		case 'q':
 			if (!supportsq)
 				break; /* +q is owner on this server */
+			banindex_add (sess, mode, arg, nick, set_at);
 			if (!quiet)
 				EMIT_SIGNAL_TIMESTAMP (XP_TE_CHANQUIET, sess, nick, arg, NULL, NULL, 0,
 								 tags_data->timestamp);
@@ -526,16 +568,19 @@ handle_single_mode (mode_run *mr, char sign, char mode, char *nick,
 				mr->devoice = mode_cat (mr->devoice, arg);
 			return;
 		case 'b':
+			banindex_remove (sess, mode, arg);
 			if (!quiet)
 				EMIT_SIGNAL_TIMESTAMP (XP_TE_CHANUNBAN, sess, nick, arg, NULL, NULL,
 											  0, tags_data->timestamp);
 			return;
 		case 'e':
+			banindex_remove (sess, mode, arg);
 			if (!quiet)
 				EMIT_SIGNAL_TIMESTAMP (XP_TE_CHANRMEXEMPT, sess, nick, arg, NULL,
 											  NULL, 0, tags_data->timestamp);
 			return;
 		case 'I':
+			banindex_remove (sess, mode, arg);
 			if (!quiet)
 				EMIT_SIGNAL_TIMESTAMP (XP_TE_CHANRMINVITE, sess, nick, arg, NULL,
 											  NULL, 0, tags_data->timestamp);
@@ -543,6 +588,7 @@ handle_single_mode (mode_run *mr, char sign, char mode, char *nick,
 		case 'q':
 			if (!supportsq)
 				break; /* -q is owner on this server */
+			banindex_remove (sess, mode, arg);
 			if (!quiet)
 				EMIT_SIGNAL_TIMESTAMP (XP_TE_CHANUNQUIET, sess, nick, arg, NULL,
 											  NULL, 0, tags_data->timestamp);
@@ -580,7 +626,7 @@ mode_has_arg (server * serv, char sign, char mode)
 	int type;
 
 	/* if it's a nickmode, it must have an arg */
-	if (strchr (serv->nick_modes, mode))
+	if (serv->mode_class[(guchar) mode] & MODE_CLASS_NICK)
 		return 1;
 
 	type = mode_chanmode_type (serv, mode);
@@ -604,27 +650,33 @@ mode_has_arg (server * serv, char sign, char mode)
 static int
 mode_chanmode_type (server * serv, char mode)
 {
-	/* see what numeric 005 CHANMODES=xxx said */
-	char *cm = serv->chanmodes;
-	int type = 0;
-	int found = 0;
+	return (int) (serv->mode_class[(guchar) mode] & MODE_CLASS_TYPE) - 1;
+}
+
+/* rebuild the per-char lookup table after CHANMODES or PREFIX changed */
 
-	while (*cm && !found)
+void
+mode_class_update (server *serv)
+{
+	char *cm;
+	int type = 1;
+
+	memset (serv->mode_class, 0, sizeof (serv->mode_class));
+
+	/* see what numeric 005 CHANMODES=xxx said, first mention wins */
+	for (cm = serv->chanmodes; cm && *cm; cm++)
 	{
 		if (*cm == ',')
 		{
-			type++;
-		} else if (*cm == mode)
-		{
-			found = 1;
+			if (type < MODE_CLASS_TYPE)
+				type++;
 		}
-		cm++;
+		else if (!(serv->mode_class[(guchar) *cm] & MODE_CLASS_TYPE))
+			serv->mode_class[(guchar) *cm] |= type;
 	}
-	if (found)
-		return type;
-	/* not found? -1 */
-	else
-		return -1;
+
+	for (cm = serv->nick_modes; cm && *cm; cm++)
+		serv->mode_class[(guchar) *cm] |= MODE_CLASS_NICK;
 }
 
 static void
@@ -718,8 +770,8 @@ handle_mode (server * serv, char *word[], char *word_eol[],
 
 	if (numeric_324 && !using_front_tab)
 	{
-		g_free (sess->current_modes);
-		sess->current_modes = g_strdup (word_eol[offset+1]);
+		chan_modes_clear (sess);
+		sess->modes_known = TRUE;
 	}
 
 	sign = *modes;
@@ -871,6 +923,7 @@ inbound_005 (server * serv, char *word[], const message_tags_data *tags_data)
 		{
 			g_free (serv->chanmodes);
 			serv->chanmodes = g_strdup (tokvalue);
+			mode_class_update (serv);
 		} else if (g_strcmp0 (tokname, "PREFIX") == 0)
 		{
 			pre = strchr (tokvalue, ')');
@@ -881,6 +934,8 @@ inbound_005 (server * serv, char *word[], const message_tags_data *tags_data)
 				g_free (serv->nick_modes);
 				serv->nick_prefixes = g_strdup (pre + 1);
 				serv->nick_modes = g_strdup (tokvalue + 1);
+				mode_class_update (serv);
+				userlist_rerank (serv);
 			} else
 			{
 				/* bad! some ircds don't give us the modes. */
@@ -892,9 +947,15 @@ inbound_005 (server * serv, char *word[], const message_tags_data *tags_data)
 		} else if (g_strcmp0 (tokname, "WATCH") == 0)
 		{
 			serv->supports_watch = tokadding;
+			if (!serv->supports_monitor)
+				serv->watch_limit = tokadding ? atoi (tokvalue) : 0;
 		} else if (g_strcmp0 (tokname, "MONITOR") == 0)
 		{
 			serv->supports_monitor = tokadding;
+			serv->watch_limit = tokadding ? atoi (tokvalue) : 0;
+		} else if (g_strcmp0 (tokname, "CHATHISTORY") == 0)
+		{
+			serv->chathistory_limit = tokadding ? atoi (tokvalue) : 0;
 		} else if (g_strcmp0 (tokname, "NETWORK") == 0)
 		{
 			if (serv->server_session->type == SESS_SERVER && strlen (tokvalue))
@@ -906,7 +967,12 @@ inbound_005 (server * serv, char *word[], const message_tags_data *tags_data)
 		} else if (g_strcmp0 (tokname, "CASEMAPPING") == 0)
 		{
 			if (g_strcmp0 (tokvalue, "ascii") == 0)
+			{
 				serv->p_cmp = (void *)g_ascii_strcasecmp;
+				serv->casemapping = CASEMAP_ASCII;
+			}
+			else if (g_strcmp0 (tokvalue, "strict-rfc1459") == 0)
+				serv->casemapping = CASEMAP_STRICT_RFC1459;
 		} else if (g_strcmp0 (tokname, "CHARSET") == 0)
 		{
 			if (g_ascii_strcasecmp (tokvalue, "UTF-8") == 0)
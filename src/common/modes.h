@@ -24,11 +24,15 @@
 
 int is_channel (server *serv, char *chan);
 char get_nick_prefix (server *serv, unsigned int access);
+int get_prefix_rank (server *serv, char prefix);
 unsigned int nick_access (server *serv, char *nick, int *modechars);
 int mode_access (server *serv, char mode, char *prefix);
 void inbound_005 (server *serv, char *word[], const message_tags_data *tags_data);
 void handle_mode (server *serv, char *word[], char *word_eol[], char *nick,
 						int numeric_324, const message_tags_data *tags_data);
+void mode_class_update (server *serv);
+char *chan_modes_get (session *sess);
+void chan_modes_clear (session *sess);
 void send_channel_modes (session *sess, char *tbuf, char *word[], int start, int end, char sign, char mode, int modes_per_line);
 
 #endif
@@ -0,0 +1,325 @@
+/* PChat
+ * Copyright (C) 2026 PChat-IRC contributors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#ifndef WIN32
+#include <sys/select.h>
+#include <sys/time.h>
+#include <errno.h>
+#endif
+
+#define WANTSOCKET
+#include "inet.h"
+
+#include "pchat.h"
+#include "netreader.h"
+#include "outbound.h"
+#include "server.h"
+#include "fe.h"
+#include "trace.h"
+#ifdef USE_SSL
+#include "ssl.h"
+#endif
+
+#define NETREADER_POLL_MS 100		/* how long a stop request can go unnoticed */
+#define NETREADER_BATCH 256		/* lines handled per main loop dispatch */
+#define NETREADER_BACKLOG 8192	/* queued lines before the reader waits */
+
+/* one line from the server, ready for the protocol handler */
+struct server_line
+{
+	char *line;						/* decoded UTF-8, as received (for the rawlog) */
+	gsize len;
+	char *tags;						/* message tags without the '@', or NULL */
+	char *body;						/* points into line past the tags; NULL to drop */
+	char *pdibuf;
+	char *word[PDIWORDS+1];
+	char *word_eol[PDIWORDS+1];
+	int error;						/* with failed: socket error, 0 for EOF */
+	unsigned int failed:1;
+};
+
+struct netreader
+{
+	server *serv;					/* the thread only reads; never freed before it's joined */
+	GThread *thread;
+	GAsyncQueue *queue;			/* struct server_line, reader -> main loop */
+	gint ref;
+	gint stop;						/* set by netreader_stop */
+	gint scheduled;				/* a dispatch is pending on the main loop */
+	gboolean stopped;				/* main loop side: ignore anything still queued */
+	char linebuf[8704];			/* RFC says 512 chars including \r\n, IRCv3 message tags add 8191, plus the NUL byte */
+	int pos;							/* current position in linebuf */
+};
+
+static void
+server_line_free (struct server_line *rec)
+{
+	g_free (rec->line);
+	g_free (rec->tags);
+	g_free (rec->pdibuf);
+	g_free (rec);
+}
+
+static struct netreader *
+netreader_ref (struct netreader *nr)
+{
+	g_atomic_int_inc (&nr->ref);
+	return nr;
+}
+
+static void
+netreader_unref (gpointer data)
+{
+	struct netreader *nr = data;
+
+	if (!g_atomic_int_dec_and_test (&nr->ref))
+		return;
+
+	g_async_queue_unref (nr->queue);
+	g_free (nr);
+}
+
+/* main loop side */
+
+static void
+netreader_deliver (server *serv, struct server_line *rec)
+{
+	if (rec->failed)
+	{
+		server_read_failed (serv, rec->error);
+		return;
+	}
+
+	fe_add_rawlog (serv, rec->line, rec->len, FALSE);
+
+	if (rec->body)
+		serv->p_inline_words (serv, rec->body, rec->tags, rec->word, rec->word_eol);
+}
+
+static gboolean
+netreader_dispatch (gpointer data)
+{
+	struct netreader *nr = data;
+	struct server_line *rec;
+	int n;
+
+	/* a bounded batch per call, so one busy server can't starve the GUI */
+	for (n = 0; n < NETREADER_BATCH && !nr->stopped; n++)
+	{
+		rec = g_async_queue_try_pop (nr->queue);
+		if (!rec)
+			break;
+		netreader_deliver (nr->serv, rec);
+		server_line_free (rec);
+	}
+
+	if (nr->stopped)
+		return FALSE;
+	if (g_async_queue_length (nr->queue) > 0)
+		return TRUE;
+
+	g_atomic_int_set (&nr->scheduled, 0);
+
+	/* the reader may have queued a line after the last pop but before
+	   the flag was cleared, without scheduling another dispatch */
+	if (g_async_queue_length (nr->queue) > 0 &&
+		 g_atomic_int_compare_and_exchange (&nr->scheduled, 0, 1))
+		return TRUE;
+
+	return FALSE;
+}
+
+/* reader thread side */
+
+static void
+netreader_push (struct netreader *nr, struct server_line *rec)
+{
+	g_async_queue_push (nr->queue, rec);
+
+	if (g_atomic_int_compare_and_exchange (&nr->scheduled, 0, 1))
+		g_idle_add_full (G_PRIORITY_DEFAULT, netreader_dispatch,
+							  netreader_ref (nr), netreader_unref);
+}
+
+static void
+netreader_line (struct netreader *nr)
+{
+	server *serv = nr->serv;
+	struct server_line *rec;
+	char *sep;
+
+	rec = g_new0 (struct server_line, 1);
+
+	g_mutex_lock (&serv->io_lock);
+	rec->line = server_decode_line (serv, nr->linebuf, nr->pos, &rec->len);
+	g_mutex_unlock (&serv->io_lock);
+
+	rec->body = rec->line;
+	if (rec->line[0] == '@')
+	{
+		sep = strchr (rec->line, ' ');
+		if (sep)
+		{
+			rec->tags = g_strndup (rec->line + 1, sep - rec->line - 1);
+			rec->body = sep + 1;
+		}
+		else
+			rec->body = NULL;
+	}
+
+	if (rec->body)
+	{
+		rec->pdibuf = g_malloc (rec->len + 1);
+		process_data_init (rec->pdibuf, rec->body, rec->word, rec->word_eol, FALSE, FALSE);
+		/* Python relies on this */
+		rec->word[PDIWORDS] = NULL;
+		rec->word_eol[PDIWORDS] = NULL;
+	}
+
+	netreader_push (nr, rec);
+}
+
+static void
+netreader_split (struct netreader *nr, const char *lbuf, int len)
+{
+	int i;
+
+	for (i = 0; i < len; i++)
+	{
+		switch (lbuf[i])
+		{
+		case '\r':
+			break;
+
+		case '\n':
+			nr->linebuf[nr->pos] = 0;
+			netreader_line (nr);
+			nr->pos = 0;
+			break;
+
+		default:
+			nr->linebuf[nr->pos] = lbuf[i];
+			if (nr->pos >= (sizeof (nr->linebuf) - 1))
+				fprintf (stderr,
+							"*** HEXCHAT WARNING: Buffer overflow - non-compliant server!\n");
+			else
+				nr->pos++;
+		}
+	}
+}
+
+static gpointer
+netreader_thread (gpointer data)
+{
+	struct netreader *nr = data;
+	server *serv = nr->serv;
+	struct server_line *rec;
+	struct timeval tv;
+	fd_set rfds;
+	char lbuf[2050];
+	int len, error, blocked;
+	gint64 span;
+
+	trace_thread_name ("netreader");
+
+	while (!g_atomic_int_get (&nr->stop))
+	{
+		/* don't run ahead of the main loop without bound; the rest can
+			wait in the kernel's socket buffer */
+		if (g_async_queue_length (nr->queue) > NETREADER_BACKLOG)
+		{
+			g_usleep (NETREADER_POLL_MS * 100);
+			continue;
+		}
+
+		FD_ZERO (&rfds);
+		FD_SET (serv->sok, &rfds);
+		tv.tv_sec = 0;
+		tv.tv_usec = NETREADER_POLL_MS * 1000;
+		if (select (serv->sok + 1, &rfds, NULL, NULL, &tv) < 1)
+			continue;	/* timeout or EINTR; real errors show up in recv */
+
+		/* drain it: TLS may hold decrypted data the socket won't signal */
+		while (!g_atomic_int_get (&nr->stop))
+		{
+			span = trace_begin ();
+			g_mutex_lock (&serv->io_lock);
+#ifdef USE_SSL
+			if (!serv->ssl)
+#endif
+				len = recv (serv->sok, lbuf, sizeof (lbuf) - 2, 0);
+#ifdef USE_SSL
+			else
+				len = pchat_ssl_recv (serv->ssl, lbuf, sizeof (lbuf) - 2);
+#endif
+			blocked = len < 0 && would_block ();
+			error = len < 0 && !blocked ? sock_error () : 0;
+			g_mutex_unlock (&serv->io_lock);
+
+			if (blocked)
+				break;
+
+			if (len < 1)
+			{
+				rec = g_new0 (struct server_line, 1);
+				rec->failed = TRUE;
+				rec->error = error;
+				netreader_push (nr, rec);
+				return NULL;
+			}
+
+			netreader_split (nr, lbuf, len);
+			trace_end ("server_read", span);
+		}
+	}
+
+	return NULL;
+}
+
+struct netreader *
+netreader_start (server *serv)
+{
+	struct netreader *nr;
+
+	nr = g_new0 (struct netreader, 1);
+	nr->serv = serv;
+	nr->ref = 1;
+	nr->queue = g_async_queue_new_full ((GDestroyNotify) server_line_free);
+	nr->thread = g_thread_new ("pchat-netreader", netreader_thread, nr);
+
+	return nr;
+}
+
+/* Main loop only. Waits (at most NETREADER_POLL_MS) for the thread to
+   finish, after which the socket and TLS session may be closed. Lines
+   still queued are dropped, as they were never seen by the server code. */
+
+void
+netreader_stop (struct netreader *nr)
+{
+	if (!nr)
+		return;
+
+	g_atomic_int_set (&nr->stop, 1);
+	g_thread_join (nr->thread);
+	nr->stopped = TRUE;
+	netreader_unref (nr);
+}
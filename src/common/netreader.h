@@ -0,0 +1,36 @@
+/* PChat
+ * Copyright (C) 2026 PChat-IRC contributors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#ifndef PCHAT_NETREADER_H
+#define PCHAT_NETREADER_H
+
+/* One thread per connected server does the socket reads (and TLS), the
+   line splitting, the charset conversion and the word splitting, and
+   queues the finished lines for the main loop. Everything that touches
+   sessions, state or plugins still runs on the main thread, so plugins
+   see the same single-threaded API as before.
+
+   While a reader runs, serv->ssl and the read converter are shared with
+   it: use them only while holding serv->io_lock. */
+
+struct netreader;
+
+struct netreader *netreader_start (server *serv);
+void netreader_stop (struct netreader *nr);
+
+#endif
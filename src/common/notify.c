@@ -43,6 +43,63 @@
 GSList *notify_list = 0;
 int notify_tag = 0;
 
+/* casefolded name -> GSList of struct notify, so the JOIN/QUIT/NICK
+   paths don't have to walk the whole notify_list */
+static GHashTable *notify_index = NULL;
+
+/* one ISON request waiting for its 303 reply */
+struct ison_round
+{
+	time_t sent;
+	GSList *names;
+};
+
+#define ISON_ROUND_TIMEOUT 60	/* seconds before an unanswered round is dropped */
+
+
+static gboolean
+notify_name_equal (gconstpointer a, gconstpointer b)
+{
+	return rfc_casecmp (a, b) == 0;
+}
+
+static void
+notify_index_add (struct notify *notify)
+{
+	GSList *bucket;
+
+	if (!notify_index)
+		notify_index = g_hash_table_new_full ((GHashFunc) str_ihash, notify_name_equal, g_free, NULL);
+
+	bucket = g_hash_table_lookup (notify_index, notify->name);
+	g_hash_table_insert (notify_index, g_strdup (notify->name), g_slist_prepend (bucket, notify));
+}
+
+static void
+notify_index_remove (struct notify *notify)
+{
+	GSList *bucket;
+
+	if (!notify_index)
+		return;
+
+	bucket = g_slist_remove (g_hash_table_lookup (notify_index, notify->name), notify);
+	if (bucket)
+		g_hash_table_insert (notify_index, g_strdup (notify->name), bucket);
+	else
+		g_hash_table_remove (notify_index, notify->name);
+}
+
+/* all entries whose name could match under any casemapping; callers
+   still compare with serv->p_cmp */
+static GSList *
+notify_index_lookup (const char *name)
+{
+	if (!notify_index)
+		return NULL;
+
+	return g_hash_table_lookup (notify_index, name);
+}
 
 static char *
 despacify_dup (char *str)
@@ -180,7 +237,7 @@ notify_load (void)
 static struct notify_per_server *
 notify_find (server *serv, char *nick)
 {
-	GSList *list = notify_list;
+	GSList *list = notify_index_lookup (nick);
 	struct notify_per_server *servnot;
 	struct notify *notify;
 
@@ -188,16 +245,13 @@ notify_find (server *serv, char *nick)
 	{
 		notify = (struct notify *) list->data;
 
-		servnot = notify_find_server_entry (notify, serv);
-		if (!servnot)
+		if (!serv->p_cmp (notify->name, nick))
 		{
-			list = list->next;
-			continue;
+			servnot = notify_find_server_entry (notify, serv);
+			if (servnot)
+				return servnot;
 		}
 
-		if (!serv->p_cmp (notify->name, nick))
-			return servnot;
-
 		list = list->next;
 	}
 
@@ -336,6 +390,32 @@ notify_set_online_list (server * serv, char *users,
 	}
 }
 
+/* how many entries are currently MONITORed/WATCHed on this server */
+
+static int
+notify_watch_count (server *serv)
+{
+	GSList *list = notify_list;
+	GSList *slist;
+	struct notify_per_server *servnot;
+	int count = 0;
+
+	while (list)
+	{
+		slist = ((struct notify *) list->data)->server_list;
+		while (slist)
+		{
+			servnot = slist->data;
+			if (servnot->server == serv && servnot->watched)
+				count++;
+			slist = slist->next;
+		}
+		list = list->next;
+	}
+
+	return count;
+}
+
 static void
 notify_watch (server * serv, char *nick, int add)
 {
@@ -358,13 +438,27 @@ notify_watch (server * serv, char *nick, int add)
 static void
 notify_watch_all (struct notify *notify, int add)
 {
+	struct notify_per_server *servnot;
 	server *serv;
 	GSList *list = serv_list;
 	while (list)
 	{
 		serv = list->data;
 		if (serv->connected && serv->end_of_motd && notify_do_network (notify, serv))
-			notify_watch (serv, notify->name, add);
+		{
+			if (!add)
+				notify_watch (serv, notify->name, FALSE);
+			else if (serv->supports_monitor || serv->supports_watch)
+			{
+				/* past the server's limit this nick is left to ISON */
+				servnot = notify_find_server_entry (notify, serv);
+				if (servnot && (!serv->watch_limit || notify_watch_count (serv) < serv->watch_limit))
+				{
+					notify_watch (serv, notify->name, TRUE);
+					servnot->watched = TRUE;
+				}
+			}
+		}
 		list = list->next;
 	}
 }
@@ -372,24 +466,25 @@ notify_watch_all (struct notify *notify, int add)
 static void
 notify_flush_watches (server * serv, GSList *from, GSList *end)
 {
-	char tbuf[512];
+	GString *buf;
 	GSList *list;
 	struct notify *notify;
 
-	serv->supports_monitor ? g_strlcpy (tbuf, "MONITOR + ", sizeof (tbuf)) : g_strlcpy (tbuf, "WATCH", sizeof (tbuf));
+	buf = g_string_new (serv->supports_monitor ? "MONITOR + " : "WATCH");
 
 	list = from;
 	while (list != end)
 	{
 		notify = list->data;
-		if (serv->supports_monitor)
-			g_strlcat (tbuf, ",", sizeof(tbuf));
-		else
-			g_strlcat (tbuf, " +", sizeof(tbuf));
-		g_strlcat (tbuf, notify->name, sizeof(tbuf));
+		if (!serv->supports_monitor)
+			g_string_append (buf, " +");
+		else if (list != from)
+			g_string_append_c (buf, ',');
+		g_string_append (buf, notify->name);
 		list = list->next;
 	}
-	serv->p_raw (serv, tbuf);
+	serv->p_raw (serv, buf->str);
+	g_string_free (buf, TRUE);
 }
 
 /* called when logging in. e.g. when End of motd. */
@@ -398,25 +493,35 @@ void
 notify_send_watches (server * serv)
 {
 	struct notify *notify;
+	struct notify_per_server *servnot;
 	const int format_len = serv->supports_monitor ? 1 : 2; /* just , for monitor or + and space for watch */
 	GSList *list;
 	GSList *point;
 	GSList *send_list = NULL;
 	int len = 0;
+	int count = 0;
 
-	/* Only get the list for this network */
+	/* Only get the list for this network, and no more than the
+	   MONITOR=/WATCH= limit the server advertised */
 	list = notify_list;
 	while (list)
 	{
 		notify = list->data;
 
-		if (notify_do_network (notify, serv))
+		if (serv->watch_limit && count >= serv->watch_limit)
+			break;
+
+		servnot = notify_find_server_entry (notify, serv);
+		if (servnot)
 		{
-			send_list = g_slist_append (send_list, notify);
+			servnot->watched = TRUE;
+			send_list = g_slist_prepend (send_list, notify);
+			count++;
 		}
 
 		list = list->next;
 	}
+	send_list = g_slist_reverse (send_list);
 
 	/* Now send that list in batches */
 	point = list = send_list;
@@ -444,87 +549,177 @@ notify_send_watches (server * serv)
 	g_slist_free (send_list);
 }
 
-/* called when receiving a ISON 303 - should this func go? */
+static void
+notify_ison_round_free (struct ison_round *round)
+{
+	g_slist_free_full (round->names, g_free);
+	g_free (round);
+}
+
+/* forget outstanding ISON rounds, e.g. on (re)connect */
 
 void
-notify_markonline (server *serv, char *word[], const message_tags_data *tags_data)
+notify_ison_clear (server *serv)
 {
-	struct notify *notify;
+	g_slist_free_full (serv->ison_rounds, (GDestroyNotify) notify_ison_round_free);
+	serv->ison_rounds = NULL;
+}
+
+/* drop rounds the server never answered, oldest first. Returns TRUE
+   if a round is still waiting for its reply. */
+
+static gboolean
+notify_ison_expire (server *serv)
+{
+	struct ison_round *round;
+	time_t now = time (0);
+
+	while (serv->ison_rounds)
+	{
+		round = serv->ison_rounds->data;
+		if (now - round->sent < ISON_ROUND_TIMEOUT)
+			return TRUE;
+		serv->ison_rounds = g_slist_delete_link (serv->ison_rounds, serv->ison_rounds);
+		notify_ison_round_free (round);
+	}
+
+	return FALSE;
+}
+
+/* called when a server disconnects or reconnects: nothing is on its
+   MONITOR/WATCH list any more, and no ISON reply is coming */
+
+void
+notify_server_reset (server *serv)
+{
+	GSList *list, *slist;
 	struct notify_per_server *servnot;
-	GSList *list = notify_list;
-	int i, seen;
 
-	while (list)
+	for (list = notify_list; list; list = list->next)
 	{
-		notify = (struct notify *) list->data;
-		servnot = notify_find_server_entry (notify, serv);
-		if (!servnot)
+		for (slist = ((struct notify *) list->data)->server_list; slist; slist = slist->next)
 		{
-			list = list->next;
-			continue;
+			servnot = slist->data;
+			if (servnot->server == serv)
+				servnot->watched = FALSE;
 		}
-		i = 4;
-		seen = FALSE;
-		while (*word[i])
+	}
+
+	notify_ison_clear (serv);
+}
+
+/* called when receiving a ISON 303. Each reply answers the oldest
+   outstanding round, so anyone asked about in that round but missing
+   from the reply has gone offline. */
+
+void
+notify_markonline (server *serv, char *reply, const message_tags_data *tags_data)
+{
+	struct notify_per_server *servnot;
+	struct ison_round *round = NULL;
+	GSList *list;
+	char **online;
+	int i, seen;
+
+	online = g_strsplit (reply, " ", 0);
+
+	for (i = 0; online[i]; i++)
+	{
+		if (!online[i][0])
+			continue;
+		servnot = notify_find (serv, online[i]);
+		if (servnot)
+			notify_announce_online (serv, servnot, servnot->notify->name, tags_data);
+	}
+
+	/* a reply we didn't ask for (e.g. /quote ISON) can't tell us who left */
+	if (serv->ison_rounds)
+	{
+		round = serv->ison_rounds->data;
+		serv->ison_rounds = g_slist_delete_link (serv->ison_rounds, serv->ison_rounds);
+	}
+
+	if (round)
+	{
+		for (list = round->names; list; list = list->next)
 		{
-			if (!serv->p_cmp (notify->name, word[i]))
-			{
-				seen = TRUE;
-				notify_announce_online (serv, servnot, notify->name, tags_data);
-				break;
-			}
-			i++;
-			/* Note: word[] is a PDIWORDS (32) element array, which limits ISON response
-			   parsing to about 27 nicks. This only affects legacy servers that don't
-			   support WATCH or MONITOR commands. Most modern IRC servers support these
-			   commands, which don't have this limitation. See notify_checklist(). */
-			if (i > PDIWORDS - 5)
+			seen = FALSE;
+			for (i = 0; online[i]; i++)
 			{
-				break;
+				if (!serv->p_cmp (list->data, online[i]))
+				{
+					seen = TRUE;
+					break;
+				}
 			}
+
+			servnot = notify_find (serv, list->data);
+			if (!seen && servnot && servnot->ison)
+				notify_announce_offline (serv, servnot, servnot->notify->name, FALSE, tags_data);
 		}
-		if (!seen && servnot->ison)
-		{
-			notify_announce_offline (serv, servnot, notify->name, FALSE, tags_data);
-		}
-		list = list->next;
+		notify_ison_round_free (round);
 	}
+
+	g_strfreev (online);
 	fe_notify_update (0);
 }
 
-/* yuck! Old routine for ISON notify */
+/* Old routine for ISON notify, used for servers without MONITOR/WATCH
+   and for entries that didn't fit in the server's MONITOR/WATCH list.
+   A long list is split over several ISON lines; each one is remembered
+   so its 303 reply can be matched up for offline detection. */
+
+static void
+notify_ison_send (server *serv, GString *buf, GSList *names)
+{
+	struct ison_round *round;
+
+	round = g_new0 (struct ison_round, 1);
+	round->sent = time (0);
+	round->names = g_slist_reverse (names);
+	serv->ison_rounds = g_slist_append (serv->ison_rounds, round);
+
+	serv->p_raw (serv, buf->str);
+}
 
 static void
 notify_checklist_for_server (server *serv)
 {
-	char outbuf[512];
+	GString *buf;
 	struct notify *notify;
+	struct notify_per_server *servnot;
 	GSList *list = notify_list;
-	int i = 0;
+	GSList *names = NULL;
+
+	/* still waiting for replies to the previous check */
+	if (notify_ison_expire (serv))
+		return;
 
-	g_strlcpy (outbuf, "ISON ", sizeof (outbuf));
+	buf = g_string_new ("ISON");
 	while (list)
 	{
 		notify = list->data;
-		if (notify_do_network (notify, serv))
+		servnot = notify_find_server_entry (notify, serv);
+		if (servnot && !servnot->watched)
 		{
-			i++;
-			g_strlcat (outbuf, notify->name, sizeof (outbuf));
-			g_strlcat (outbuf, " ", sizeof (outbuf));
-			if (strlen (outbuf) > 460)
+			/* we can't send more than 512 bytes to the server, start a new round */
+			if (names && buf->len + strlen (notify->name) + 1 > 460)
 			{
-				/* LAME: we can't send more than 512 bytes to the server, but     *
-				 * if we split it in two packets, our offline detection wouldn't  *
-				 work                                                           */
-				/*fprintf (stderr, _("*** PCHAT WARNING: notify list too large.\n"));*/
-				break;
+				notify_ison_send (serv, buf, names);
+				g_string_assign (buf, "ISON");
+				names = NULL;
 			}
+			g_string_append_c (buf, ' ');
+			g_string_append (buf, notify->name);
+			names = g_slist_prepend (names, g_strdup (notify->name));
 		}
 		list = list->next;
 	}
 
-	if (i)
-		serv->p_raw (serv, outbuf);
+	if (names)
+		notify_ison_send (serv, buf, names);
+
+	g_string_free (buf, TRUE);
 }
 
 int
@@ -536,7 +731,7 @@ notify_checklist (void)	/* check ISON list */
 	while (list)
 	{
 		serv = list->data;
-		if (serv->connected && serv->end_of_motd && !serv->supports_watch && !serv->supports_monitor)
+		if (serv->connected && serv->end_of_motd)
 		{
 			notify_checklist_for_server (serv);
 		}
@@ -583,7 +778,7 @@ notify_deluser (char *name)
 {
 	struct notify *notify;
 	struct notify_per_server *servnot;
-	GSList *list = notify_list;
+	GSList *list = notify_index_lookup (name);
 
 	while (list)
 	{
@@ -591,6 +786,7 @@ notify_deluser (char *name)
 		if (!rfc_casecmp (notify->name, name))
 		{
 			fe_notify_update (notify->name);
+			notify_index_remove (notify);
 			/* Remove the records for each server */
 			while (notify->server_list)
 			{
@@ -623,17 +819,18 @@ notify_adduser (char *name, char *networks)
 		notify->networks = despacify_dup (networks);
 	notify->server_list = 0;
 	notify_list = g_slist_prepend (notify_list, notify);
+	notify_index_add (notify);
+	notify_watch_all (notify, TRUE);
 	notify_checklist ();
 	fe_notify_update (notify->name);
 	fe_notify_update (0);
-	notify_watch_all (notify, TRUE);
 }
 
 gboolean
 notify_is_in_list (server *serv, char *name)
 {
 	struct notify *notify;
-	GSList *list = notify_list;
+	GSList *list = notify_index_lookup (name);
 
 	while (list)
 	{
@@ -651,7 +848,7 @@ notify_isnotify (struct session *sess, char *name)
 {
 	struct notify *notify;
 	struct notify_per_server *servnot;
-	GSList *list = notify_list;
+	GSList *list = notify_index_lookup (name);
 
 	while (list)
 	{
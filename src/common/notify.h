@@ -37,6 +37,7 @@ struct notify_per_server
 	time_t lastseen;
 	time_t lastoff;
 	unsigned int ison:1;
+	unsigned int watched:1;	/* sent with MONITOR/WATCH, not checked by ISON */
 };
 
 extern GSList *notify_list;
@@ -66,8 +67,10 @@ int notify_isnotify (session *sess, char *name);
 struct notify_per_server *notify_find_server_entry (struct notify *notify, struct server *serv);
 
 /* the old ISON stuff - remove me? */
-void notify_markonline (server *serv, char *word[], 
+void notify_markonline (server *serv, char *reply,
 								const message_tags_data *tags_data);
+void notify_ison_clear (server *serv);
+void notify_server_reset (server *serv);
 int notify_checklist (void);
 
 #endif
@@ -55,6 +55,8 @@
 #include "tree.h"
 #include "outbound.h"
 #include "chanopt.h"
+#include "banindex.h"
+#include "trace.h"
 
 #define TBUFSIZE 4096
 
@@ -557,6 +559,55 @@ cmd_ban (struct session *sess, char *tbuf, char *word[], char *word_eol[])
 	return TRUE;
 }
 
+static int
+cmd_banmatch (struct session *sess, char *tbuf, char *word[], char *word_eol[])
+{
+	char *arg = word[2];
+	struct User *user;
+	ban_mask *ban;
+	GSList *list, *l;
+
+	if (!*arg)
+		return FALSE;
+
+	if (strpbrk (arg, "!@$~"))
+	{
+		/* a mask: which users on the channel would it hit? */
+		list = banindex_users_matching (sess, arg);
+		PrintTextf (sess, _("%d user(s) on %s match %s\n"),
+						g_slist_length (list), sess->channel, arg);
+		for (l = list; l; l = l->next)
+		{
+			user = l->data;
+			PrintTextf (sess, "  %s!%s\n", user->nick,
+							user->hostname ? user->hostname : "*@*");
+		}
+		g_slist_free (list);
+		return TRUE;
+	}
+
+	/* a nick: which known masks hit them? */
+	user = userlist_find (sess, arg);
+	if (!user)
+	{
+		PrintTextf (sess, _("%s is not on %s\n"), arg, sess->channel);
+		return TRUE;
+	}
+
+	list = banindex_bans_matching (sess, user, 0);
+	PrintTextf (sess, _("%d known mask(s) on %s match %s\n"),
+					g_slist_length (list), sess->channel, arg);
+	for (l = list; l; l = l->next)
+	{
+		ban = l->data;
+		PrintTextf (sess, "  +%c %s (%s)\n", ban->mode, ban->mask,
+						ban->setter ? ban->setter : "?");
+	}
+	g_slist_free (list);
+
+	return TRUE;
+}
+
 static int
 cmd_unban (struct session *sess, char *tbuf, char *word[], char *word_eol[])
 {
@@ -2657,11 +2708,17 @@ cmd_load (struct session *sess, char *tbuf, char *word[], char *word_eol[])
 	return FALSE;
 }
 
-char *
-split_up_text(struct session *sess, char *text, int cmd_length, char *split_text)
+/* One line of outgoing text, cut from a longer message. The budget is
+ * worked out once per message and each piece is a slice of the original
+ * text, also copied (NUL terminated) into piece for the senders. */
+
+#define TEXT_SPLIT_MIN 32		/* whatever the nick/host lengths, make progress */
+#define TEXT_SPLIT_CLUSTER 32	/* give up keeping a grapheme cluster longer than this */
+
+void
+text_split_init (text_split *ts, struct session *sess, const char *text, int cmd_length)
 {
-	unsigned int max, space_offset;
-	char *space;
+	int max;
 
 	/* maximum allowed text */
 	/* :nickname!username@host.com cmd_length */
@@ -2678,48 +2735,174 @@ split_up_text(struct session *sess, char *text, int cmd_length, char *split_text
 		max -= 65;	/* max possible hostname and '@' */
 	}
 
-	if (strlen (text) > max)
-	{
-		unsigned int i = 0;
-		int size;
+	ts->next = text;
+	ts->end = text + strlen (text);
+	ts->max = MAX (max, TEXT_SPLIT_MIN);
+	ts->done = FALSE;
+	ts->start = text;
+	ts->len = 0;
+	ts->piece[0] = 0;
+}
 
-		/* traverse the utf8 string and find the nearest cut point that
-			doesn't split 1 char in half */
-		while (1)
+static gboolean
+split_is_ri (gunichar c)
+{
+	return c >= 0x1F1E6 && c <= 0x1F1FF;	/* regional indicator (flags) */
+}
+
+/* would splitting between a and b break up one user-visible character? */
+static gboolean
+split_joined (const char *p, const char *prev, gunichar a, gunichar b)
+{
+	int n;
+
+	if (g_unichar_ismark (b) || b == 0x200D || a == 0x200D)	/* combining, ZWJ */
+		return TRUE;
+	if ((b >= 0xFE00 && b <= 0xFE0F) || (b >= 0xE0100 && b <= 0xE01EF))	/* variation selectors */
+		return TRUE;
+	if ((b >= 0x1F3FB && b <= 0x1F3FF) || (b >= 0xE0020 && b <= 0xE007F))	/* skin tones, tags */
+		return TRUE;
+
+	if (split_is_ri (a) && split_is_ri (b))
+	{
+		/* flags pair up from the start of a run */
+		n = 1;
+		while (prev > p)
 		{
-			size = g_utf8_skip[((unsigned char *)text)[i]];
-			if ((i + size) >= max)
+			prev = g_utf8_find_prev_char (p, prev);
+			if (!prev || !split_is_ri (g_utf8_get_char (prev)))
 				break;
-			i += size;
+			n++;
 		}
-		max = i;
+		return n % 2;
+	}
+
+	return FALSE;
+}
+
+static const char *
+split_keep_cluster (const char *p, const char *cut)
+{
+	const char *start = cut, *prev;
+	gunichar a, b;
+
+	while (cut > p && start - cut < TEXT_SPLIT_CLUSTER)
+	{
+		prev = g_utf8_find_prev_char (p, cut);
+		if (!prev)
+			break;
+		a = g_utf8_get_char_validated (prev, cut - prev);
+		b = g_utf8_get_char_validated (cut, -1);
+		if (a == (gunichar) -1 || a == (gunichar) -2 || b == (gunichar) -1 || b == (gunichar) -2)
+			break;
+		if (!split_joined (p, prev, a, b))
+			return cut;
+		cut = prev;
+	}
+
+	return start - cut < TEXT_SPLIT_CLUSTER ? cut : start;
+}
+
+/* length of the \003 or \004 colour code at q */
+static int
+split_color_len (const char *q)
+{
+	int i = 1, n, hex = (*q == '\004');
+	int width = hex ? 6 : 2;
+
+	for (n = 0; n < width && (hex ? g_ascii_isxdigit (q[i]) : g_ascii_isdigit (q[i])); n++)
+		i++;
+	if (n && q[i] == ',' && (hex ? g_ascii_isxdigit (q[i + 1]) : g_ascii_isdigit (q[i + 1])))
+	{
+		i++;
+		for (n = 0; n < width && (hex ? g_ascii_isxdigit (q[i]) : g_ascii_isdigit (q[i])); n++)
+			i++;
+	}
+	return i;
+}
+
+/* don't leave "\00312,0" on one line and "4" on the next */
+static const char *
+split_keep_color (const char *p, const char *cut)
+{
+	const char *q;
 
-		/* Try splitting at last space */
-		space = g_utf8_strrchr (text, max, ' ');
-		if (space)
+	for (q = cut - 1; q >= p && cut - q <= 14; q--)
+	{
+		if (*q == '\003' || *q == '\004')
 		{
-			space_offset = g_utf8_pointer_to_offset (text, space);
+			if (q + split_color_len (q) > cut)
+				return q;
+			break;
+		}
+	}
+	return cut;
+}
+
+static const char *
+split_point (const char *p, gsize max)
+{
+	const char *limit, *cut, *s;
+	int back;
 
-			/* Only split if last word is of sane length */
-			if (max != space_offset && max - space_offset < 20)
-				max = space_offset + 1;
+	/* pieces stay under max, and don't split one char in half */
+	limit = cut = p + max - 1;
+	for (back = 0; back < 3 && cut > p && ((guchar) *cut & 0xC0) == 0x80; back++)
+		cut--;
+	if (cut == p)
+		cut = limit;
+	limit = cut;
+
+	/* Try splitting at last space, if the last word is of sane length */
+	for (s = cut - 1; s >= p && cut - s < 20; s--)
+	{
+		if (*s == ' ')
+		{
+			cut = s + 1;
+			break;
 		}
+	}
 
-		split_text = g_strdup_printf ("%.*s", max, text);
+	cut = split_keep_cluster (p, cut);
+	cut = split_keep_color (p, cut);
+
+	return cut > p ? cut : limit;
+}
+
+/* Moves to the next piece; the last one is whatever is left, possibly
+ * the whole (or an empty) text. Returns FALSE when all were given out. */
+gboolean
+text_split_next (text_split *ts)
+{
+	const char *cut;
 
-		return split_text;
+	if (ts->done)
+		return FALSE;
+
+	if ((gsize) (ts->end - ts->next) <= ts->max)
+	{
+		cut = ts->end;
+		ts->done = TRUE;
+	}
+	else
+	{
+		cut = split_point (ts->next, ts->max);
 	}
 
-	return NULL;
+	ts->start = ts->next;
+	ts->len = cut - ts->next;
+	memcpy (ts->piece, ts->start, ts->len);
+	ts->piece[ts->len] = 0;
+	ts->next = cut;
+	return TRUE;
 }
 
 static int
 cmd_me (struct session *sess, char *tbuf, char *word[], char *word_eol[])
 {
 	char *act = word_eol[2];
-	char *split_text = NULL;
+	text_split ts;
 	int cmd_length = 22; /* " PRIVMSG ", " ", :, \001ACTION, " ", \001, \r, \n */
-	int offset = 0;
 	message_tags_data no_tags = MESSAGE_TAGS_DATA_INIT;
 
 	if (!(*act))
@@ -2743,24 +2926,15 @@ cmd_me (struct session *sess, char *tbuf, char *word[], char *word_eol[])
 		/* DCC CHAT failed, try through server */
 		if (sess->server->connected)
 		{
-			while ((split_text = split_up_text (sess, act + offset, cmd_length, split_text)))
+			text_split_init (&ts, sess, act, cmd_length);
+			while (text_split_next (&ts))
 			{
-				sess->server->p_action (sess->server, sess->channel, split_text);
+				sess->server->p_action (sess->server, sess->channel, ts.piece);
 				/* print it to screen */
 				inbound_action (sess, sess->channel, sess->server->nick, "",
-									 split_text, TRUE, FALSE,
+									 ts.piece, TRUE, FALSE,
 									 &no_tags);
-
-				if (*split_text)
-					offset += strlen(split_text);
-
-				g_free (split_text);
 			}
-
-			sess->server->p_action (sess->server, sess->channel, act + offset);
-			/* print it to screen */
-			inbound_action (sess, sess->channel, sess->server->nick, "",
-								 act + offset, TRUE, FALSE, &no_tags);
 		} else
 		{
 			notc_msg (sess);
@@ -2829,9 +3003,8 @@ cmd_msg (struct session *sess, char *tbuf, char *word[], char *word_eol[])
 	char *nick = word[2];
 	char *msg = word_eol[3];
 	struct session *newsess;
-	char *split_text = NULL;
+	text_split ts;
 	int cmd_length = 13; /* " PRIVMSG ", " ", :, \r, \n */
-	int offset = 0;
 
 	if (*nick)
 	{
@@ -2862,17 +3035,9 @@ cmd_msg (struct session *sess, char *tbuf, char *word[], char *word_eol[])
 					return TRUE;
 				}
 
-				while ((split_text = split_up_text (sess, msg + offset, cmd_length, split_text)))
-				{
-					sess->server->p_message (sess->server, nick, split_text);
-
-					if (*split_text)
-						offset += strlen(split_text);
-
-					g_free (split_text);
-				}
-				sess->server->p_message (sess->server, nick, msg + offset);
-				offset = 0;
+				text_split_init (&ts, sess, msg, cmd_length);
+				while (text_split_next (&ts))
+					sess->server->p_message (sess->server, nick, ts.piece);
 			}
 			newsess = find_dialog (sess->server, nick);
 			if (!newsess)
@@ -2881,20 +3046,13 @@ cmd_msg (struct session *sess, char *tbuf, char *word[], char *word_eol[])
 			{
 				message_tags_data no_tags = MESSAGE_TAGS_DATA_INIT;
 
-				while ((split_text = split_up_text (sess, msg + offset, cmd_length, split_text)))
+				text_split_init (&ts, sess, msg, cmd_length);
+				while (text_split_next (&ts))
 				{
 					inbound_chanmsg (newsess->server, NULL, newsess->channel,
-										  newsess->server->nick, split_text, TRUE, FALSE,
+										  newsess->server->nick, ts.piece, TRUE, FALSE,
 										  &no_tags);
-
-					if (*split_text)
-						offset += strlen(split_text);
-
-					g_free (split_text);
 				}
-				inbound_chanmsg (newsess->server, NULL, newsess->channel,
-									  newsess->server->nick, msg + offset, TRUE, FALSE,
-									  &no_tags);
 			}
 			else
 			{
@@ -2975,26 +3133,18 @@ static int
 cmd_notice (struct session *sess, char *tbuf, char *word[], char *word_eol[])
 {
 	char *text = word_eol[3];
-	char *split_text = NULL;
+	text_split ts;
 	int cmd_length = 12; /* " NOTICE ", " ", :, \r, \n */
-	int offset = 0;
 
 	if (*word[2] && *word_eol[3])
 	{
-		while ((split_text = split_up_text (sess, text + offset, cmd_length, split_text)))
+		text_split_init (&ts, sess, text, cmd_length);
+		while (text_split_next (&ts))
 		{
-			sess->server->p_notice (sess->server, word[2], split_text);
-			EMIT_SIGNAL (XP_TE_NOTICESEND, sess, word[2], split_text, NULL, NULL, 0);
-			
-			if (*split_text)
-				offset += strlen(split_text);
-			
-			g_free (split_text);
+			sess->server->p_notice (sess->server, word[2], ts.piece);
+			EMIT_SIGNAL (XP_TE_NOTICESEND, sess, word[2], ts.piece, NULL, NULL, 0);
 		}
 
-		sess->server->p_notice (sess->server, word[2], text + offset);
-		EMIT_SIGNAL (XP_TE_NOTICESEND, sess, word[2], text + offset, NULL, NULL, 0);
-
 		return TRUE;
 	}
 	return FALSE;
@@ -3110,10 +3260,9 @@ cmd_query (struct session *sess, char *tbuf, char *word[], char *word_eol[])
 {
 	char *nick = word[2];
 	char *msg = word_eol[3];
-	char *split_text = NULL;
+	text_split ts;
 	gboolean focus = TRUE;
 	int cmd_length = 13; /* " PRIVMSG ", " ", :, \r, \n */
-	int offset = 0;
 
 	if (strcmp (word[2], "-nofocus") == 0)
 	{
@@ -3138,22 +3287,14 @@ cmd_query (struct session *sess, char *tbuf, char *word[], char *word_eol[])
 				return TRUE;
 			}
 
-			while ((split_text = split_up_text (sess, msg + offset, cmd_length, split_text)))
+			text_split_init (&ts, sess, msg, cmd_length);
+			while (text_split_next (&ts))
 			{
-				sess->server->p_message (sess->server, nick, split_text);
+				sess->server->p_message (sess->server, nick, ts.piece);
 				inbound_chanmsg (nick_sess->server, nick_sess, nick_sess->channel,
-								 nick_sess->server->nick, split_text, TRUE, FALSE,
+								 nick_sess->server->nick, ts.piece, TRUE, FALSE,
 								 &no_tags);
-
-				if (*split_text)
-					offset += strlen(split_text);
-
-				g_free (split_text);
 			}
-			sess->server->p_message (sess->server, nick, msg + offset);
-			inbound_chanmsg (nick_sess->server, nick_sess, nick_sess->channel,
-							 nick_sess->server->nick, msg + offset, TRUE, FALSE,
-							 &no_tags);
 		}
 
 		return TRUE;
@@ -3504,6 +3645,9 @@ cmd_server (struct session *sess, char *tbuf, char *word[], char *word_eol[])
 
 	sess->server->network = NULL;
 
+	/* resolve the listed network once, used for login and below */
+	net = servlist_net_find_from_server (server_name);
+
 	/* dont clear it for /servchan */
 	if (g_ascii_strncasecmp (word_eol[1], "SERVCHAN ", 9))
 		sess->willjoinchannel[0] = 0;
@@ -3540,7 +3684,6 @@ cmd_server (struct session *sess, char *tbuf, char *word[], char *word_eol[])
 	else
 	{
 		/* If part of a known network, login like normal */
-		net = servlist_net_find_from_server (server_name);
 		if (net && net->pass && *net->pass)
 		{
 			safe_strcpy (serv->password, net->pass, sizeof (serv->password));
@@ -3573,7 +3716,7 @@ cmd_server (struct session *sess, char *tbuf, char *word[], char *word_eol[])
 
 	/* try to associate this connection with a listed network */
 	/* may return NULL, but that's OK */
-	if ((serv->network = servlist_net_find_from_server (server_name)))
+	if ((serv->network = net))
 		server_set_encoding (serv, ((ircnet*)serv->network)->encoding);
 
 	return TRUE;
@@ -3609,6 +3752,64 @@ cmd_topic (struct session *sess, char *tbuf, char *word[], char *word_eol[])
 	return TRUE;
 }
 
+static int
+cmd_trace (struct session *sess, char *tbuf, char *word[], char *word_eol[])
+{
+	if (!g_ascii_strcasecmp (word[2], "ON"))
+	{
+		trace_set_active (TRUE);
+		PrintText (sess, _("Tracing enabled.\n"));
+		return TRUE;
+	}
+
+	if (!g_ascii_strcasecmp (word[2], "OFF"))
+	{
+		trace_set_active (FALSE);
+		PrintText (sess, _("Tracing disabled.\n"));
+		return TRUE;
+	}
+
+	if (!g_ascii_strcasecmp (word[2], "CLEAR"))
+	{
+		trace_clear ();
+		return TRUE;
+	}
+
+	if (!g_ascii_strcasecmp (word[2], "DUMP"))
+	{
+		GError *error = NULL;
+		char *file;
+		int count;
+
+		if (*word_eol[3])
+			file = g_strdup (word_eol[3]);
+		else
+		{
+			g_snprintf (tbuf, TBUFSIZE, "pchat-trace-%ld.json", (long) time (NULL));
+			file = g_build_filename (get_xdir (), tbuf, NULL);
+		}
+
+		count = trace_dump (file, &error);
+		if (count < 0)
+		{
+			PrintTextf (sess, _("Couldn't write %s: %s\n"), file, error->message);
+			g_error_free (error);
+		}
+		else
+			PrintTextf (sess, _("Wrote %d trace events to %s\n"), count, file);
+		g_free (file);
+		return TRUE;
+	}
+
+	if (!*word[2])
+	{
+		PrintText (sess, trace_active ? _("Tracing is on.\n") : _("Tracing is off.\n"));
+		return TRUE;
+	}
+
+	return FALSE;
+}
+
 static int
 cmd_tray (struct session *sess, char *tbuf, char *word[], char *word_eol[])
 {
@@ -3971,6 +4172,8 @@ const struct commands xc_cmds[] = {
 	{"BACK", cmd_back, 1, 0, 1, N_("BACK, sets you back (not away)")},
 	{"BAN", cmd_ban, 1, 1, 1,
 	 N_("BAN <mask> [<bantype>], bans everyone matching the mask from the current channel. If they are already on the channel this doesn't kick them (needs chanop)")},
+	{"BANMATCH", cmd_banmatch, 1, 1, 1,
+	 N_("BANMATCH <mask|nick>, lists the users on the current channel a mask matches, or the known bans, exempts, invites and quiets matching a nick")},
 	{"CHANOPT", cmd_chanopt, 0, 0, 1, N_("CHANOPT [-quiet] <variable> [<value>]")},
 	{"CHARSET", cmd_charset, 0, 0, 1, N_("CHARSET [<encoding>], get or set the encoding used for the current connection")},
 	{"CLEAR", cmd_clear, 0, 0, 1, N_("CLEAR [ALL|HISTORY|[-]<amount>], Clears the current text window or command history")},
@@ -4139,6 +4342,10 @@ const struct commands xc_cmds[] = {
 	{"SPLAY", cmd_splay, 0, 0, 1, "SPLAY <soundfile>"},
 	{"TOPIC", cmd_topic, 1, 1, 1,
 	 N_("TOPIC [<topic>], sets the topic if one is given, else shows the current topic")},
+	{"TRACE", cmd_trace, 0, 0, 1,
+	 N_("\nTRACE ON|OFF        Start or stop recording pipeline timings.\n"
+		   "TRACE DUMP [<file>]  Write them out as Chrome trace JSON.\n"
+		   "TRACE CLEAR          Discard what has been recorded.")},
 	{"TRAY", cmd_tray, 0, 0, 1,
 	 N_("\nTRAY -f <timeout> <file1> [<file2>] Blink tray between two icons.\n"
 		   "TRAY -f <filename>                  Set tray to a fixed icon.\n"
@@ -4644,25 +4851,16 @@ handle_say (session *sess, char *text, int check_spch)
 
 	if (sess->server->connected)
 	{
-		char *split_text = NULL;
+		text_split ts;
 		int cmd_length = 13; /* " PRIVMSG ", " ", :, \r, \n */
-		int offset = 0;
 
-		while ((split_text = split_up_text (sess, text + offset, cmd_length, split_text)))
+		text_split_init (&ts, sess, text, cmd_length);
+		while (text_split_next (&ts))
 		{
 			inbound_chanmsg (sess->server, sess, sess->channel, sess->server->nick,
-								  split_text, TRUE, FALSE, &no_tags);
-			sess->server->p_message (sess->server, sess->channel, split_text);
-			
-			if (*split_text)
-				offset += strlen(split_text);
-			
-			g_free (split_text);
+								  ts.piece, TRUE, FALSE, &no_tags);
+			sess->server->p_message (sess->server, sess->channel, ts.piece);
 		}
-
-		inbound_chanmsg (sess->server, sess, sess->channel, sess->server->nick,
-							  text + offset, TRUE, FALSE, &no_tags);
-		sess->server->p_message (sess->server, sess->channel, text + offset);
 	} else
 	{
 		notc_msg (sess);
@@ -4939,10 +5137,131 @@ handle_user_input (session *sess, char *text, int history, int nocommand)
 	return handle_command (sess, text + 1, TRUE);
 }
 
+/* A paste of two or more lines of plain text goes out as one block: the
+ * lines are split and echoed inside a single text batch, then handed to
+ * p_message_lines together (a draft/multiline BATCH where the server has
+ * it). Returns FALSE, leaving cmd untouched, when the block has to be
+ * handled line by line: it contains commands, a plugin hooks plain text
+ * (e.g. to encrypt it), it's a DCC chat, or there's nowhere to send it. */
+
+static gboolean
+handle_paste (session *sess, char *cmd, int history, int nocommand)
+{
+	server *serv = sess->server;
+	char cmdchar = prefs.pchat_input_command_char[0];
+	message_tags_data no_tags = MESSAGE_TAGS_DATA_INIT;
+	GPtrArray *chunks;
+	GByteArray *concat;
+	char *p, *text, *newcmd;
+	text_split ts;
+	int cmd_length = 13; /* " PRIVMSG ", " ", :, \r, \n */
+	int count, newcmdlen;
+	guint8 cont;
+	gsize len;
+
+	if (!serv->connected || !sess->channel[0] ||
+		 (sess->type != SESS_CHANNEL && sess->type != SESS_DIALOG) ||
+		 strcmp (sess->channel, "(lastlog)") == 0)
+		return FALSE;
+
+	if (sess->type == SESS_DIALOG &&
+		 (find_dcc (sess->channel, "", TYPE_CHATRECV) || find_dcc (sess->channel, "", TYPE_CHATSEND)))
+		return FALSE;
+
+	if (plugin_has_command_hook (""))
+		return FALSE;
+
+	/* look before touching anything: plain text only, at least two lines */
+	for (p = cmd, count = 0; *p; )
+	{
+		len = strcspn (p, "\n\r");
+		if (len)
+		{
+			if (!nocommand && p[0] == cmdchar && !(len > 1 && p[1] == cmdchar))
+				return FALSE;
+			count++;
+		}
+		p += len;
+		if (*p)
+			p++;
+	}
+	if (count < 2)
+		return FALSE;
+
+	chunks = g_ptr_array_new_with_free_func (g_free);
+	concat = g_byte_array_new ();
+
+	text_batch_begin (sess);
+
+	while (*cmd)
+	{
+		char *cr = cmd + strcspn (cmd, "\n\r");
+		int end_of_string = *cr == 0;
+		*cr = 0;
+
+		if (*cmd)
+		{
+			if (history)
+				history_add (&sess->history, cmd);
+
+			text = cmd;
+			if (!nocommand && text[0] == cmdchar)	/* "//" */
+				text++;
+
+			if (prefs.pchat_input_perc_color)
+				check_special_chars (text, prefs.pchat_input_perc_ascii);
+
+			len = strlen (text);
+			newcmdlen = MAX(len + NICKLEN + 1, TBUFSIZE);
+			newcmd = g_malloc (newcmdlen);
+			if (prefs.pchat_completion_auto)
+				perform_nick_completion (sess, text, newcmd);
+			else
+				safe_strcpy (newcmd, text, newcmdlen);
+
+			/* same splitting and echo as handle_say */
+			cont = 0;
+			text_split_init (&ts, sess, newcmd, cmd_length);
+			while (text_split_next (&ts))
+			{
+				inbound_chanmsg (serv, sess, sess->channel, serv->nick,
+									  ts.piece, TRUE, FALSE, &no_tags);
+				g_ptr_array_add (chunks, g_strndup (ts.start, ts.len));
+				g_byte_array_append (concat, &cont, 1);
+				cont = 1;
+			}
+
+			g_free (newcmd);
+
+			/* a print hook may have closed the tab */
+			if (!is_session (sess))
+				goto xit;
+		}
+
+		if (end_of_string)
+			break;
+		cmd = cr + 1;
+	}
+
+	text_batch_end (sess);
+
+	if (is_server (serv) && serv->connected)
+		serv->p_message_lines (serv, sess->channel, (char **) chunks->pdata,
+									  (const char *) concat->data, chunks->len);
+
+xit:
+	g_ptr_array_free (chunks, TRUE);
+	g_byte_array_free (concat, TRUE);
+	return TRUE;
+}
+
 /* changed by Steve Green. Macs sometimes paste with imbedded \r */
 void
 handle_multiline (session *sess, char *cmd, int history, int nocommand)
 {
+	if (handle_paste (sess, cmd, history, nocommand))
+		return;
+
 	while (*cmd)
 	{
 		char *cr = cmd + strcspn (cmd, "\n\r");
@@ -23,6 +23,18 @@
 #include "pchat.h"
 
 extern const struct commands xc_cmds[];
+
+/* see text_split_init () */
+typedef struct
+{
+	const char *next;		/* what is left to send */
+	const char *end;
+	gsize max;				/* payload bytes per line */
+	gboolean done;
+	const char *start;	/* current piece, within the original text */
+	gsize len;
+	char piece[512];		/* current piece, NUL terminated */
+} text_split;
 extern GSList *menu_list;
 
 int auto_insert (char *dest, gsize destlen, char *src, char *word[], char *word_eol[],
@@ -38,5 +50,7 @@ void server_sendquit (session * sess);
 int menu_streq (const char *s1, const char *s2, int def);
 session *open_query (server *serv, char *nick, gboolean focus_existing);
 gboolean load_perform_file (session *sess, char *file);
+void text_split_init (text_split *ts, session *sess, const char *text, int cmd_length);
+gboolean text_split_next (text_split *ts);
 
 #endif
@@ -47,12 +47,16 @@
 #include "plugin-identd.h"
 #include "plugin-timer.h"
 #include "notify.h"
+#include "banindex.h"
+#include "chathistory.h"
+#include "modes.h"
 #include "server.h"
 #include "servlist.h"
 #include "outbound.h"
 #include "text.h"
 #include "url.h"
 #include "pchatc.h"
+#include "trace.h"
 
 #if ! GLIB_CHECK_VERSION (2, 36, 0)
 #include <glib-object.h>			/* for g_type_init() */
@@ -196,11 +200,11 @@ find_dialog (server *serv, char *nick)
 	if (serv->dialogs_hash)
 	{
 		sess = g_hash_table_lookup (serv->dialogs_hash, nick);
-		if (sess && sess->type == SESS_DIALOG)
+		if (sess && sess->type == SESS_DIALOG && !serv->p_cmp (nick, sess->channel))
 			return sess;
 	}
 
-	/* Fall back to linear search (handles case sensitivity differences) */
+	/* Fall back to linear search (names renamed out of the table, casemapping collisions) */
 	GSList *list = sess_list;
 	while (list)
 	{
@@ -224,11 +228,11 @@ find_channel (server *serv, char *chan)
 	if (serv->channels_hash)
 	{
 		sess = g_hash_table_lookup (serv->channels_hash, chan);
-		if (sess && sess->type == SESS_CHANNEL)
+		if (sess && sess->type == SESS_CHANNEL && !serv->p_cmp (chan, sess->channel))
 			return sess;
 	}
 
-	/* Fall back to linear search (handles case sensitivity differences) */
+	/* Fall back to linear search (names renamed out of the table, casemapping collisions) */
 	GSList *list = sess_list;
 	while (list)
 	{
@@ -702,6 +706,8 @@ session_free (session *killsess)
 
 	exec_notify_kill (killsess);
 
+	if (killsess->log_batch)
+		g_string_free (killsess->log_batch, TRUE);
 	log_close (killsess);
 	scrollback_close (killsess);
 	chanopt_save (killsess);
@@ -710,7 +716,12 @@ session_free (session *killsess)
 
 	history_free (&killsess->history);
 	g_free (killsess->topic);
-	g_free (killsess->current_modes);
+	chan_modes_clear (killsess);
+	if (killsess->mode_args)
+		g_array_free (killsess->mode_args, TRUE);
+	banindex_free (killsess);
+	chathistory_free (killsess);
+	userlist_who_discard (killsess);
 
 	fe_session_callback (killsess);
 
@@ -1163,6 +1174,7 @@ main (int argc, char *argv[])
 
 	xchat_init ();
 
+	trace_thread_name ("main");
 	fe_main ();
 
 #ifdef WIN32
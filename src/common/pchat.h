@@ -379,6 +379,12 @@ typedef struct session
 	char channelkey[64];			  /* XXX correct max length? */
 	int limit;						  /* channel user limit */
 	int logfd;
+	char *log_path;					/* resolved log file, see log_get_path() */
+	char *log_key;						/* server/channel/network/mask it was resolved for */
+	time_t log_expires;				/* when the logmask's time fields next change, 0 = never */
+	time_t log_checked;				/* last time log_path was checked to still exist */
+	GString *log_batch;				/* log lines held back by text_batch_begin() */
+	int text_batch;					/* text_batch_begin() nesting depth */
 
 	GFile *scrollfile;							/* scrollback file */
 	int scrollwritten;					/* number of lines written */
@@ -394,7 +400,13 @@ typedef struct session
 
 	char *quitreason;
 	char *topic;
-	char *current_modes;					/* free() me */
+	char *current_modes;					/* rendered by chan_modes_get(), free() me */
+	guint32 mode_bits[8];				/* channel modes set, one bit per mode char */
+	GArray *mode_args;					/* parameters of set B/C modes, see modes.c */
+	guint8 modes_known;					/* mode_bits holds something from 324/MODE */
+	GPtrArray *who_pending;				/* WHO replies held until 315, see userlist.c */
+	struct ban_index *banindex;			/* known list-mode masks, see banindex.c */
+	struct chathistory *chathistory;	/* draft/chathistory paging state, see chathistory.c */
 
 	int mode_timeout_tag;
 
@@ -416,6 +428,7 @@ typedef struct session
 	unsigned int end_of_names:1;
 	unsigned int doing_who:1;		/* /who sent on this channel */
 	unsigned int done_away_check:1;	/* done checking for away status changes */
+	unsigned int userlist_frozen:1;	/* bulk update, see userlist_freeze() */
 	tab_state_flags tab_state;
 	tab_state_flags last_tab_state; /* before event is handled */
 	gtk_xtext_search_flags lastlog_flags;
@@ -439,6 +452,7 @@ typedef struct server
 	void (*auto_reconnect)(struct server *, int send_quit, int err);
 	/* irc protocol functions (in proto*.c) */
 	void (*p_inline)(struct server *, char *buf, int len);
+	void (*p_inline_words)(struct server *, char *buf, char *tags, char *word[], char *word_eol[]);
 	void (*p_invite)(struct server *, char *channel, char *nick);
 	void (*p_cycle)(struct server *, char *channel, char *key);
 	void (*p_ctcp)(struct server *, char *to, char *msg);
@@ -461,6 +475,7 @@ typedef struct server
 	void (*p_set_back)(struct server *);
 	void (*p_set_away)(struct server *, char *reason);
 	void (*p_message)(struct server *, char *channel, char *text);
+	void (*p_message_lines)(struct server *, char *channel, char **lines, const char *concat, int count);
 	void (*p_action)(struct server *, char *channel, char *act);
 	void (*p_notice)(struct server *, char *channel, char *text);
 	void (*p_topic)(struct server *, char *channel, char *topic);
@@ -471,6 +486,7 @@ typedef struct server
 /*	void (*p_set_away)(struct server *);*/
 	int (*p_raw)(struct server *, char *raw);
 	int (*p_cmp)(const char *s1, const char *s2);
+	int casemapping;				/* CASEMAP_* from util.h, for match_casemap */
 
 	int port;
 	int sok;					/* is equal to sok4 or sok6 (the one we are using) */
@@ -502,9 +518,9 @@ typedef struct server
 	char servername[128];			/* what the server says is its name */
 	char password[1024];
 	char nick[NICKLEN];
-	char linebuf[8704];				/* RFC says 512 chars including \r\n, IRCv3 message tags add 8191, plus the NUL byte */
 	char *last_away_reason;
-	int pos;								/* current position in linebuf */
+	struct netreader *reader;		/* socket reader thread while connected, see netreader.c */
+	GMutex io_lock;					/* serialises ssl and the read converter with the reader */
 	int nickcount;
 	int loginmethod;					/* see login_types[] */
 
@@ -512,8 +528,17 @@ typedef struct server
 	char *chanmodes;					/* for 005 numeric - free me */
 	char *nick_prefixes;				/* e.g. "*@%+" */
 	char *nick_modes;					/* e.g. "aohv" */
+	guint8 mode_class[256];			/* CHANMODES type and nick-mode flag per mode char, see modes.c */
 	char *bad_nick_prefixes;		/* for ircd that doesn't give the modes */
 	int modes_per_line;				/* 6 on undernet, 4 on efnet etc... */
+	int watch_limit;					/* MONITOR=/WATCH= list size, 0 if unlimited */
+	GSList *ison_rounds;				/* ISON requests awaiting a 303, see notify.c */
+	GHashTable *batches;				/* open BATCH reference tag -> struct irc_batch */
+	int chathistory_limit;			/* CHATHISTORY= 005 token, 0 if unlimited */
+	int multiline_max_bytes;		/* draft/multiline cap values, 0 if not given */
+	int multiline_max_lines;
+	const char *current_msgid;		/* msgid tag of the line being processed */
+	const char *current_batch;		/* batch tag of the line being processed */
 
 	void *network;						/* points to entry in servlist.c or NULL! */
 
@@ -542,6 +567,7 @@ typedef struct server
 	char *encoding;
 	GIConv read_converter;  /* iconv converter for converting from server encoding to UTF-8. */
 	GIConv write_converter; /* iconv converter for converting from UTF-8 to server encoding. */
+	const struct charset_table *read_table; /* single-byte decoding table used instead of read_converter, or NULL */
 
 	GSList *favlist;			/* list of channels & keys to join */
 
@@ -575,6 +601,9 @@ typedef struct server
 	unsigned int have_extjoin:1;	/* cap extended-join */
 	unsigned int have_account_tag:1;	/* cap account-tag */
 	unsigned int have_server_time:1;	/* cap server-time */
+	unsigned int have_batch:1;		/* cap batch */
+	unsigned int have_chathistory:1;	/* cap draft/chathistory */
+	unsigned int have_multiline:1;	/* cap draft/multiline */
 	unsigned int have_sasl:1;		/* SASL capability */
 	unsigned int have_except:1;	/* ban exemptions +e */
 	unsigned int have_invite:1;	/* invite exemptions +I */
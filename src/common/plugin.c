@@ -52,6 +52,7 @@ typedef struct session pchat_context;
 
 
 #include "pchatc.h"
+#include "trace.h"
 
 /* the USE_PLUGIN define only removes libdl stuff */
 
@@ -682,6 +683,15 @@ plugin_emit_command (session *sess, char *name, char *word[], char *word_eol[])
 	return plugin_hook_run (sess, name, word, word_eol, NULL, HOOK_COMMAND);
 }
 
+/* is anything hooked on this command? Lets callers take shortcuts that
+   would bypass plugin_emit_command. */
+
+int
+plugin_has_command_hook (char *name)
+{
+	return plugin_hook_find (hook_list, HOOK_COMMAND, name) != NULL;
+}
+
 pchat_event_attrs *
 pchat_event_attrs_create (pchat_plugin *ph)
 {
@@ -701,11 +711,15 @@ plugin_emit_server (session *sess, char *name, char *word[], char *word_eol[],
 					time_t server_time)
 {
 	pchat_event_attrs attrs;
+	gint64 span = trace_begin ();
+	int ret;
 
 	attrs.server_time_utc = server_time;
 
-	return plugin_hook_run (sess, name, word, word_eol, &attrs, 
-							HOOK_SERVER | HOOK_SERVER_ATTRS);
+	ret = plugin_hook_run (sess, name, word, word_eol, &attrs,
+								  HOOK_SERVER | HOOK_SERVER_ATTRS);
+	trace_end ("plugin_emit_server", span);
+	return ret;
 }
 
 /* see if any plugins are interested in this print event */
@@ -1239,7 +1253,7 @@ pchat_get_info (pchat_plugin *ph, const char *id)
 		return fe_get_inputbox_contents (sess);
 
 	case 0x633fb30:	/* modes */
-		return sess->current_modes;
+		return chan_modes_get (sess);
 
 	case 0x6de15a2e:	/* network */
 		return server_get_network (sess->server, FALSE);
@@ -34,6 +34,7 @@
 #include "fe.h"
 #include "ignore.h"
 #include "inbound.h"
+#include "chathistory.h"
 #include "modes.h"
 #include "notify.h"
 #include "plugin.h"
@@ -44,6 +45,7 @@
 #include "pchatc.h"
 #include "url.h"
 #include "servlist.h"
+#include "trace.h"
 
 static void
 irc_login (server *serv, char *user, char *realname)
@@ -362,6 +364,78 @@ irc_message (server *serv, char *channel, char *text)
 	tcp_sendf (serv, "PRIVMSG %s :%s\r\n", channel, text);
 }
 
+/* Send a paste. concat[i] is set when lines[i] continues lines[i - 1]
+ * (a long line that had to be split). With draft/multiline each batch
+ * goes into the send queue as one entry, so the whole paste costs one
+ * message of flood budget; otherwise every line is queued on its own,
+ * built in a reused buffer rather than through tcp_sendf. */
+
+static void
+irc_message_lines (server *serv, char *channel, char **lines, const char *concat, int count)
+{
+	static unsigned int batch_id = 0;
+	GString *buf;
+	char ref[16];
+	gsize prefix;
+	int i, n, bytes, len;
+
+	buf = g_string_sized_new (512);
+
+	if (!serv->have_multiline || !serv->have_batch || serv->multiline_max_bytes <= 0)
+	{
+		g_string_append (buf, "PRIVMSG ");
+		g_string_append (buf, channel);
+		g_string_append (buf, " :");
+		prefix = buf->len;
+
+		for (i = 0; i < count; i++)
+		{
+			g_string_truncate (buf, prefix);
+			g_string_append (buf, lines[i]);
+			g_string_append_len (buf, "\r\n", 2);
+			tcp_send_len (serv, buf->str, buf->len);
+		}
+
+		g_string_free (buf, TRUE);
+		return;
+	}
+
+	i = 0;
+	while (i < count)
+	{
+		g_snprintf (ref, sizeof (ref), "ml%u", ++batch_id);
+
+		g_string_truncate (buf, 0);
+		g_string_append_printf (buf, "BATCH +%s draft/multiline %s\r\n", ref, channel);
+
+		/* the server counts the message text plus a separator per line */
+		for (n = 0, bytes = 0; i < count; i++, n++)
+		{
+			len = strlen (lines[i]);
+			if (n > 0 && ((serv->multiline_max_lines > 0 && n >= serv->multiline_max_lines) ||
+							  bytes + len + 1 > serv->multiline_max_bytes))
+				break;
+			bytes += len + 1;
+
+			g_string_append (buf, "@batch=");
+			g_string_append (buf, ref);
+			/* a batch can't open with a continuation; it becomes a new line */
+			if (concat[i] && n > 0)
+				g_string_append (buf, ";draft/multiline-concat");
+			g_string_append (buf, " PRIVMSG ");
+			g_string_append (buf, channel);
+			g_string_append (buf, " :");
+			g_string_append (buf, lines[i]);
+			g_string_append_len (buf, "\r\n", 2);
+		}
+
+		g_string_append_printf (buf, "BATCH -%s\r\n", ref);
+		tcp_send_len (serv, buf->str, buf->len);
+	}
+
+	g_string_free (buf, TRUE);
+}
+
 static void
 irc_action (server *serv, char *channel, char *act)
 {
@@ -542,8 +616,7 @@ process_numeric (session * sess, int n,
 		else goto def;
 
 	case 303:
-		word[4]++;
-		notify_markonline (serv, word, tags_data);
+		notify_markonline (serv, word_eol[4][0] == ':' ? word_eol[4] + 1 : word_eol[4], tags_data);
 		break;
 
 	case 305:
@@ -785,6 +858,7 @@ process_numeric (session * sess, int n,
 					EMIT_SIGNAL_TIMESTAMP (XP_TE_SERVTEXT, serv->server_session, text,
 												  word[1], word[2], NULL, 0,
 												  tags_data->timestamp);
+				userlist_who_apply (who_sess);
 				who_sess->doing_who = FALSE;
 			} else
 			{
@@ -803,6 +877,7 @@ process_numeric (session * sess, int n,
 		break;
 
 	case 347:	/* end of invite list */
+		inbound_banlist_end (serv, word[4], 347);
 		if (!fe_ban_list_end (sess, 347))
 			goto def;
 		break;
@@ -814,7 +889,7 @@ process_numeric (session * sess, int n,
 		break;
 
 	case 349:	/* end of exemption list */
-		sess = find_channel (serv, word[4]);
+		sess = inbound_banlist_end (serv, word[4], 349);
 		if (!sess)
 			goto def;
 		if (!fe_ban_list_end (sess, 349))
@@ -839,7 +914,7 @@ process_numeric (session * sess, int n,
 		break;
 
 	case 368:
-		sess = find_channel (serv, word[4]);
+		sess = inbound_banlist_end (serv, word[4], 368);
 		if (!sess)
 			goto def;
 		if (!fe_ban_list_end (sess, 368))
@@ -937,6 +1012,7 @@ process_numeric (session * sess, int n,
 		break;
 
 	case 729:	/* end of quiet list */
+		inbound_banlist_end (serv, word[4], 729);
 		if (!fe_ban_list_end (sess, 729))
 			goto def;
 		break;
@@ -1198,6 +1274,17 @@ process_named_msg (session *sess, char *type, char *word[], char *word_eol[],
 			inbound_sasl_authenticate (sess->server, word_eol[3]);
 			return;
 
+		case WORDL('T','A','G','M'):
+			/* TAGMSG: client-only tags (typing etc.), nothing to show */
+			return;
+
+		case WORDL('B','A','T','C'):
+			if (word[3][0] == '+')
+				inbound_batch_start (serv, word[3] + 1, word[4], word_eol[5]);
+			else if (word[3][0] == '-')
+				inbound_batch_end (serv, word[3] + 1, tags_data);
+			return;
+
 		case WORDL('C', 'H', 'G', 'H'):
 			inbound_user_info (sess, NULL, word[3], STRIP_COLON(word, word_eol, 4), NULL, nick, NULL,
 							   NULL, 0xff, tags_data);
@@ -1559,48 +1646,43 @@ handle_message_tags (server *serv, const char *tags_str,
 
 		if (serv->have_server_time && !strcmp (key, "time"))
 			handle_message_tag_time (value, tags_data);
+
+		if (serv->have_batch && !strcmp (key, "batch"))
+			tags_data->batch = g_strdup (value);
+
+		if (!strcmp (key, "msgid"))
+			tags_data->msgid = g_strdup (value);
 	}
 	
 	g_strfreev (tags);
 }
 
-/* irc_inline() - 1 single line received from serv */
+/* a line already split up by irc_inline or the reader thread (netreader.c);
+   tags is the message-tags part without the '@', or NULL */
+
 static void
-irc_inline (server *serv, char *buf, int len)
+irc_inline_words (server *serv, char *buf, char *tags, char *word[], char *word_eol[])
 {
 	session *sess, *tmp;
 	char *type, *text;
-	char *word[PDIWORDS+1];
-	char *word_eol[PDIWORDS+1];
-	char *pdibuf;
 	message_tags_data tags_data = MESSAGE_TAGS_DATA_INIT;
-
-	pdibuf = g_malloc (len + 1);
+	gint64 span = trace_begin (), step;
 
 	sess = serv->front_session;
 
-	/* Python relies on this */
-	word[PDIWORDS] = NULL;
-	word_eol[PDIWORDS] = NULL;
-
-	if (*buf == '@')
+	if (tags)
 	{
-		char *tags = buf + 1; /* skip the '@' */
-		char *sep = strchr (buf, ' ');
+		handle_message_tags(serv, tags, &tags_data);
 
-		if (!sep)
+		/* history we've already shown */
+		if (tags_data.batch && chathistory_filter (serv, &tags_data))
 			goto xit;
-		
-		*sep = '\0';
-		buf = sep + 1;
-
-		handle_message_tags(serv, tags, &tags_data);
 	}
 
 	url_check_line (buf);
 
-	/* split line into words and words_to_end_of_line */
-	process_data_init (pdibuf, buf, word, word_eol, FALSE, FALSE);
+	serv->current_msgid = tags_data.msgid;
+	serv->current_batch = tags_data.batch;
 
 	if (buf[0] == ':')
 	{
@@ -1647,14 +1729,55 @@ irc_inline (server *serv, char *buf, int len)
 		if (*text == ':')
 			text++;
 
+		step = trace_begin ();
 		process_numeric (sess, atoi (word[2]), word, word_eol, text, &tags_data);
+		trace_end ("process_numeric", step);
 	} else
 	{
+		step = trace_begin ();
 		process_named_msg (sess, type, word, word_eol, &tags_data);
+		trace_end ("process_named_msg", step);
 	}
 
 xit:
+	serv->current_msgid = NULL;
+	serv->current_batch = NULL;
 	message_tags_data_free (&tags_data);
+	trace_end ("irc_inline", span);
+}
+
+/* irc_inline() - 1 single line received from serv */
+static void
+irc_inline (server *serv, char *buf, int len)
+{
+	char *word[PDIWORDS+1];
+	char *word_eol[PDIWORDS+1];
+	char *pdibuf;
+	char *tags = NULL;
+
+	if (*buf == '@')
+	{
+		char *sep = strchr (buf, ' ');
+
+		if (!sep)
+			return;
+
+		*sep = '\0';
+		tags = buf + 1; /* skip the '@' */
+		buf = sep + 1;
+	}
+
+	pdibuf = g_malloc (len + 1);
+
+	/* split line into words and words_to_end_of_line */
+	process_data_init (pdibuf, buf, word, word_eol, FALSE, FALSE);
+
+	/* Python relies on this */
+	word[PDIWORDS] = NULL;
+	word_eol[PDIWORDS] = NULL;
+
+	irc_inline_words (serv, buf, tags, word, word_eol);
+
 	g_free (pdibuf);
 }
 
@@ -1662,12 +1785,15 @@ void
 message_tags_data_free (message_tags_data *tags_data)
 {
 	g_clear_pointer (&tags_data->account, g_free);
+	g_clear_pointer (&tags_data->batch, g_free);
+	g_clear_pointer (&tags_data->msgid, g_free);
 }
 
 void
 proto_fill_her_up (server *serv)
 {
 	serv->p_inline = irc_inline;
+	serv->p_inline_words = irc_inline_words;
 	serv->p_invite = irc_invite;
 	serv->p_cycle = irc_cycle;
 	serv->p_ctcp = irc_ctcp;
@@ -1691,6 +1817,7 @@ proto_fill_her_up (server *serv)
 	serv->p_set_back = irc_set_back;
 	serv->p_set_away = irc_set_away;
 	serv->p_message = irc_message;
+	serv->p_message_lines = irc_message_lines;
 	serv->p_action = irc_action;
 	serv->p_notice = irc_notice;
 	serv->p_topic = irc_topic;
@@ -1700,4 +1827,5 @@ proto_fill_her_up (server *serv)
 	serv->p_ping = irc_ping;
 	serv->p_raw = irc_raw;
 	serv->p_cmp = rfc_casecmp;	/* can be changed by 005 in modes.c */
+	serv->casemapping = CASEMAP_RFC1459;
 }
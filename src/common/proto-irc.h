@@ -28,6 +28,8 @@
 		NULL, /* account name */		\
 		FALSE, /* identified to nick */ \
 		(time_t)0, /* timestamp */		\
+		NULL, /* batch reference */		\
+		NULL, /* msgid */				\
 	}
 
 #define STRIP_COLON(word, word_eol, idx) (word)[(idx)][0] == ':' ? (word_eol)[(idx)]+1 : (word)[(idx)]
@@ -41,6 +43,8 @@ typedef struct
 	char *account;
 	gboolean identified;
 	time_t timestamp;
+	char *batch;		/* reference tag of the BATCH this message is part of */
+	char *msgid;
 } message_tags_data;
 
 void message_tags_data_free (message_tags_data *tags_data);
@@ -31,8 +31,262 @@
 #define CLIENT_KEY "Client Key"
 #define SERVER_KEY "Server Key"
 
+/* PBKDF2 at a few thousand rounds of SHA-512 takes long enough to be seen
+ * in the UI, and a reconnect storm can ask for one per network at once */
+#define SCRAM_THREADS 2
+#define SCRAM_CACHE_MAX 64
+
+/* ClientKey and ServerKey depend only on the password, salt and
+ * iteration count, so RFC 5802 allows keeping them instead of the
+ * password-derived SaltedPassword between authentications. Entries are
+ * keyed by account, salt and iteration count. */
+typedef struct
+{
+	unsigned char password_check[PCHAT_HASH_MAX_SIZE];	/* see scram_cache_check */
+	unsigned char client_key[PCHAT_HASH_MAX_SIZE];
+	unsigned char server_key[PCHAT_HASH_MAX_SIZE];
+} scram_cache_entry;
+
+struct scram_job
+{
+	scram_session *session;		/* NULL once the session is gone */
+	char *cache_key;
+	pchat_hash_alg digest;
+	size_t digest_size;
+	char *password;
+	unsigned char *salt;
+	size_t salt_len;
+	unsigned int iteration_count;
+	unsigned char client_key[PCHAT_HASH_MAX_SIZE];
+	unsigned char server_key[PCHAT_HASH_MAX_SIZE];
+	int ok;
+};
+
+static GHashTable *scram_cache;
+static unsigned char scram_cache_secret[32];
+static gboolean scram_cache_secret_set;
+static GThreadPool *scram_pool;
+
+static void
+scram_wipe_free (char *str)
+{
+	if (str)
+	{
+		memset (str, 0, strlen (str));
+		g_free (str);
+	}
+}
+
+static void
+scram_cache_entry_free (scram_cache_entry *entry)
+{
+	memset (entry, 0, sizeof (*entry));
+	g_free (entry);
+}
+
+static char *
+scram_cache_key (scram_session *session)
+{
+	char *salt_b64, *key;
+
+	salt_b64 = g_base64_encode (session->salt, session->salt_len);
+	key = g_strdup_printf ("%d\n%s\n%s\n%s\n%u", session->digest,
+								  session->cache_id ? session->cache_id : "",
+								  session->username, salt_b64, session->iteration_count);
+	g_free (salt_b64);
+	return key;
+}
+
+/* So a changed password doesn't reuse old keys, entries remember the
+ * password as an HMAC under a random per-process secret, over the salt,
+ * iteration count and password. No plain digest of it is kept. */
+static int
+scram_cache_check (pchat_hash_alg digest, const char *password, const unsigned char *salt,
+						 size_t salt_len, unsigned int iteration_count, unsigned char *out)
+{
+	guint32 count = GUINT32_TO_BE (iteration_count);
+	size_t password_len = strlen (password);
+	size_t len = salt_len + sizeof (count) + password_len;
+	unsigned char *data;
+	int ok;
+
+	if (!scram_cache_secret_set)
+	{
+		if (!pchat_random_bytes (scram_cache_secret, sizeof (scram_cache_secret)))
+			return 0;
+		scram_cache_secret_set = TRUE;
+	}
+
+	data = g_malloc (len);
+	memcpy (data, salt, salt_len);
+	memcpy (data + salt_len, &count, sizeof (count));
+	memcpy (data + salt_len + sizeof (count), password, password_len);
+
+	ok = pchat_hmac (digest, scram_cache_secret, sizeof (scram_cache_secret),
+						  data, len, out);
+
+	memset (data, 0, len);
+	g_free (data);
+	return ok;
+}
+
+static int
+scram_cache_lookup (scram_session *session, const char *key)
+{
+	scram_cache_entry *entry;
+	unsigned char password_check[PCHAT_HASH_MAX_SIZE];
+	int same;
+
+	if (!scram_cache || !(entry = g_hash_table_lookup (scram_cache, key)))
+		return 0;
+
+	same = scram_cache_check (session->digest, session->password, session->salt,
+									  session->salt_len, session->iteration_count, password_check) &&
+			 !memcmp (password_check, entry->password_check, session->digest_size);
+	memset (password_check, 0, sizeof (password_check));
+
+	if (!same)
+	{
+		g_hash_table_remove (scram_cache, key);
+		return 0;
+	}
+
+	memcpy (session->client_key, entry->client_key, session->digest_size);
+	memcpy (session->server_key, entry->server_key, session->digest_size);
+	return 1;
+}
+
+static void
+scram_cache_store (struct scram_job *job)
+{
+	scram_cache_entry *entry;
+
+	entry = g_new0 (scram_cache_entry, 1);
+	if (!scram_cache_check (job->digest, job->password, job->salt, job->salt_len,
+									job->iteration_count, entry->password_check))
+	{
+		scram_cache_entry_free (entry);
+		return;
+	}
+	memcpy (entry->client_key, job->client_key, job->digest_size);
+	memcpy (entry->server_key, job->server_key, job->digest_size);
+
+	if (!scram_cache)
+		scram_cache = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+														 (GDestroyNotify) scram_cache_entry_free);
+	else if (g_hash_table_size (scram_cache) >= SCRAM_CACHE_MAX)
+		g_hash_table_remove_all (scram_cache);
+
+	g_hash_table_replace (scram_cache, g_strdup (job->cache_key), entry);
+}
+
+static void
+scram_job_free (struct scram_job *job)
+{
+	g_free (job->cache_key);
+	scram_wipe_free (job->password);
+	g_free (job->salt);
+	memset (job, 0, sizeof (*job));
+	g_free (job);
+}
+
+static void
+scram_job_derive (struct scram_job *job)
+{
+	unsigned char salted_password[PCHAT_HASH_MAX_SIZE];
+
+	/* SaltedPassword := Hi(Normalize(password), salt, i)
+	 * ClientKey := HMAC(SaltedPassword, "Client Key")
+	 * ServerKey := HMAC(SaltedPassword, "Server Key") */
+	job->ok = pchat_pbkdf2 (job->digest, job->password, strlen (job->password),
+									job->salt, job->salt_len, job->iteration_count,
+									salted_password, job->digest_size) &&
+				 pchat_hmac (job->digest, salted_password, job->digest_size,
+								 CLIENT_KEY, strlen (CLIENT_KEY), job->client_key) &&
+				 pchat_hmac (job->digest, salted_password, job->digest_size,
+								 SERVER_KEY, strlen (SERVER_KEY), job->server_key);
+	memset (salted_password, 0, sizeof (salted_password));
+}
+
+/* main loop side */
+
+static gboolean
+scram_job_done (gpointer data)
+{
+	struct scram_job *job = data;
+	scram_session *session = job->session;
+
+	/* keep the result even if the connection went away meanwhile */
+	if (job->ok)
+		scram_cache_store (job);
+
+	if (session)
+	{
+		session->job = NULL;
+		if (job->ok)
+		{
+			memcpy (session->client_key, job->client_key, session->digest_size);
+			memcpy (session->server_key, job->server_key, session->digest_size);
+			session->have_keys = 1;
+		}
+		else
+		{
+			session->error = g_strdup ("PBKDF2 failed");
+		}
+		session->ready (session, session->ready_data);
+	}
+
+	scram_job_free (job);
+	return G_SOURCE_REMOVE;
+}
+
+/* worker thread side */
+
+static void
+scram_job_run (gpointer data, gpointer user_data)
+{
+	struct scram_job *job = data;
+
+	scram_job_derive (job);
+	g_idle_add (scram_job_done, job);
+}
+
+static int
+scram_job_start (scram_session *session, const char *cache_key)
+{
+	struct scram_job *job;
+
+	if (!scram_pool)
+	{
+		scram_pool = g_thread_pool_new (scram_job_run, NULL, SCRAM_THREADS, FALSE, NULL);
+		if (!scram_pool)
+			return 0;
+	}
+
+	job = g_new0 (struct scram_job, 1);
+	job->session = session;
+	job->cache_key = g_strdup (cache_key);
+	job->digest = session->digest;
+	job->digest_size = session->digest_size;
+	job->password = g_strdup (session->password);
+	job->salt = g_malloc (session->salt_len);
+	memcpy (job->salt, session->salt, session->salt_len);
+	job->salt_len = session->salt_len;
+	job->iteration_count = session->iteration_count;
+
+	if (!g_thread_pool_push (scram_pool, job, NULL))
+	{
+		scram_job_free (job);
+		return 0;
+	}
+
+	session->job = job;
+	return 1;
+}
+
 scram_session *
-scram_session_create (const char *digest, const char *username, const char *password)
+scram_session_create (const char *digest, const char *username, const char *password,
+							 const char *cache_id, scram_ready_func ready, void *ready_data)
 {
 	scram_session *session;
 	pchat_hash_alg alg = pchat_hash_alg_by_name (digest);
@@ -45,6 +299,9 @@ scram_session_create (const char *digest, const char *username, const char *pass
 	session->digest_size = pchat_hash_size (alg);
 	session->username = g_strdup (username);
 	session->password = g_strdup (password);
+	session->cache_id = g_strdup (cache_id);
+	session->ready = ready;
+	session->ready_data = ready_data;
 	return session;
 }
 
@@ -54,16 +311,39 @@ scram_session_free (scram_session *session)
 	if (session == NULL)
 		return;
 
+	/* the derivation carries on and still fills the cache */
+	if (session->job)
+		session->job->session = NULL;
+
 	g_free (session->username);
-	g_free (session->password);
+	scram_wipe_free (session->password);
+	g_free (session->cache_id);
 	g_free (session->client_nonce_b64);
 	g_free (session->client_first_message_bare);
-	g_free (session->salted_password);
+	g_free (session->server_first_message);
+	g_free (session->server_nonce_b64);
+	g_free (session->salt);
 	g_free (session->auth_message);
 	g_free (session->error);
+	memset (session, 0, sizeof (*session));
 	g_free (session);
 }
 
+/* The server rejected our proof: drop any cached keys for this account so
+ * the next attempt derives them from the password again. */
+void
+scram_session_forget (scram_session *session)
+{
+	char *key;
+
+	if (!scram_cache || !session->salt)
+		return;
+
+	key = scram_cache_key (session);
+	g_hash_table_remove (scram_cache, key);
+	g_free (key);
+}
+
 static scram_status
 process_client_first (scram_session *session, char **output, size_t *output_len)
 {
@@ -84,18 +364,11 @@ process_client_first (scram_session *session, char **output, size_t *output_len)
 }
 
 static scram_status
-process_server_first (scram_session *session, const char *data, char **output,
-                      size_t *output_len)
+parse_server_first (scram_session *session, const char *data)
 {
 	char **params;
-	char *client_final_message_without_proof = NULL;
 	char *salt = NULL;
 	char *server_nonce_b64 = NULL;
-	char *client_proof_b64;
-	unsigned char client_key[PCHAT_HASH_MAX_SIZE];
-	unsigned char stored_key[PCHAT_HASH_MAX_SIZE];
-	unsigned char client_signature[PCHAT_HASH_MAX_SIZE];
-	unsigned char *client_proof;
 	unsigned int i, param_count, iteration_count = 0;
 	gsize salt_len = 0;
 	size_t client_nonce_len;
@@ -150,39 +423,90 @@ process_server_first (scram_session *session, const char *data, char **output,
 
 	g_base64_decode_inplace ((gchar *) salt, &salt_len);
 
-	/* SaltedPassword := Hi(Normalize(password), salt, i) */
-	session->salted_password = g_malloc (session->digest_size);
-	if (!pchat_pbkdf2 (session->digest, session->password, strlen (session->password),
-	                   (unsigned char *) salt, salt_len, iteration_count,
-	                   session->salted_password, session->digest_size))
-	{
-		session->error = g_strdup ("PBKDF2 failed");
-		g_free (server_nonce_b64);
-		g_free (salt);
+	session->server_first_message = g_strdup (data);
+	session->server_nonce_b64 = server_nonce_b64;
+	session->salt = (unsigned char *) salt;
+	session->salt_len = salt_len;
+	session->iteration_count = iteration_count;
+	return SCRAM_IN_PROGRESS;
+}
+
+static scram_status
+process_server_first (scram_session *session, const char *data, char **output,
+                      size_t *output_len)
+{
+	char *client_final_message_without_proof;
+	char *client_proof_b64;
+	char *cache_key;
+	unsigned char stored_key[PCHAT_HASH_MAX_SIZE];
+	unsigned char client_signature[PCHAT_HASH_MAX_SIZE];
+	unsigned char client_proof[PCHAT_HASH_MAX_SIZE];
+	unsigned int i;
+
+	if (session->job)
+		return SCRAM_PENDING;
+	if (session->error)
 		return SCRAM_ERROR;
+
+	/* first call has the server-first-message; a call after the ready
+	 * callback passes NULL and picks up the derived keys */
+	if (!session->server_first_message)
+	{
+		if (data == NULL || parse_server_first (session, data) == SCRAM_ERROR)
+			return SCRAM_ERROR;
 	}
 
-	client_final_message_without_proof = g_strdup_printf ("c=biws,r=%s", server_nonce_b64);
-	session->auth_message = g_strdup_printf ("%s,%s,%s",
-		session->client_first_message_bare, data, client_final_message_without_proof);
+	if (!session->have_keys)
+	{
+		cache_key = scram_cache_key (session);
+		session->have_keys = scram_cache_lookup (session, cache_key);
+		if (!session->have_keys && session->ready && scram_job_start (session, cache_key))
+		{
+			g_free (cache_key);
+			return SCRAM_PENDING;
+		}
+		g_free (cache_key);
+	}
 
-	/* ClientKey := HMAC(SaltedPassword, "Client Key") */
-	if (!pchat_hmac (session->digest, session->salted_password, session->digest_size,
-	                 CLIENT_KEY, strlen (CLIENT_KEY), client_key))
+	/* no callback, or no worker thread: derive in place */
+	if (!session->have_keys)
 	{
-		session->error = g_strdup ("HMAC failed");
-		g_free (server_nonce_b64);
-		g_free (salt);
-		g_free (client_final_message_without_proof);
-		return SCRAM_ERROR;
+		struct scram_job job;
+
+		memset (&job, 0, sizeof (job));
+		job.cache_key = scram_cache_key (session);
+		job.digest = session->digest;
+		job.digest_size = session->digest_size;
+		job.password = session->password;
+		job.salt = session->salt;
+		job.salt_len = session->salt_len;
+		job.iteration_count = session->iteration_count;
+		scram_job_derive (&job);
+		if (job.ok)
+		{
+			scram_cache_store (&job);
+			memcpy (session->client_key, job.client_key, session->digest_size);
+			memcpy (session->server_key, job.server_key, session->digest_size);
+			session->have_keys = 1;
+		}
+		g_free (job.cache_key);
+		memset (&job, 0, sizeof (job));
+		if (!session->have_keys)
+		{
+			session->error = g_strdup ("PBKDF2 failed");
+			return SCRAM_ERROR;
+		}
 	}
 
+	client_final_message_without_proof = g_strdup_printf ("c=biws,r=%s", session->server_nonce_b64);
+	session->auth_message = g_strdup_printf ("%s,%s,%s",
+		session->client_first_message_bare, session->server_first_message,
+		client_final_message_without_proof);
+
 	/* StoredKey := H(ClientKey) */
-	if (!pchat_hash (session->digest, client_key, session->digest_size, stored_key))
+	if (!pchat_hash (session->digest, session->client_key, session->digest_size, stored_key))
 	{
 		session->error = g_strdup ("Hash failed");
-		g_free (server_nonce_b64);
-		g_free (salt);
 		g_free (client_final_message_without_proof);
 		return SCRAM_ERROR;
 	}
@@ -193,26 +517,20 @@ process_server_first (scram_session *session, const char *data, char **output,
 	                 client_signature))
 	{
 		session->error = g_strdup ("HMAC failed");
-		g_free (server_nonce_b64);
-		g_free (salt);
 		g_free (client_final_message_without_proof);
 		return SCRAM_ERROR;
 	}
 
 	/* ClientProof := ClientKey XOR ClientSignature */
-	client_proof = g_malloc0 (session->digest_size);
 	for (i = 0; i < session->digest_size; i++)
-		client_proof[i] = client_key[i] ^ client_signature[i];
+		client_proof[i] = session->client_key[i] ^ client_signature[i];
 
 	client_proof_b64 = g_base64_encode (client_proof, session->digest_size);
 
 	*output = g_strdup_printf ("%s,p=%s", client_final_message_without_proof, client_proof_b64);
 	*output_len = strlen (*output);
 
-	g_free (server_nonce_b64);
-	g_free (salt);
 	g_free (client_final_message_without_proof);
-	g_free (client_proof);
 	g_free (client_proof_b64);
 
 	session->step++;
@@ -223,25 +541,18 @@ static scram_status
 process_server_final (scram_session *session, const char *data)
 {
 	char *verifier;
-	unsigned char server_key[PCHAT_HASH_MAX_SIZE];
 	unsigned char server_signature[PCHAT_HASH_MAX_SIZE];
 	gsize verifier_len = 0;
 	scram_status rv;
 
-	if (strlen (data) < 3 || (data[0] != 'v' && data[1] != '='))
+	if (data == NULL || strlen (data) < 3 || (data[0] != 'v' && data[1] != '='))
 		return SCRAM_ERROR;
 
 	verifier = g_strdup (data + 2);
 	g_base64_decode_inplace (verifier, &verifier_len);
 
-	if (!pchat_hmac (session->digest, session->salted_password, session->digest_size,
-	                 SERVER_KEY, strlen (SERVER_KEY), server_key))
-	{
-		g_free (verifier);
-		return SCRAM_ERROR;
-	}
-
-	if (!pchat_hmac (session->digest, server_key, session->digest_size,
+	/* ServerSignature := HMAC(ServerKey, AuthMessage) */
+	if (!pchat_hmac (session->digest, session->server_key, session->digest_size,
 	                 session->auth_message, strlen (session->auth_message),
 	                 server_signature))
 	{
@@ -253,20 +564,24 @@ process_server_final (scram_session *session, const char *data)
 	      memcmp (verifier, server_signature, verifier_len) == 0)
 		? SCRAM_SUCCESS : SCRAM_ERROR;
 	g_free (verifier);
+
+	if (rv == SCRAM_ERROR)
+		scram_session_forget (session);
 	return rv;
 }
 
 scram_status
 scram_process (scram_session *session, const char *input, char **output, size_t *output_len)
 {
+	*output = NULL;
+	*output_len = 0;
+
 	switch (session->step)
 	{
 	case 0: return process_client_first (session, output, output_len);
 	case 1: return process_server_first (session, input, output, output_len);
 	case 2: return process_server_final (session, input);
 	default:
-		*output = NULL;
-		*output_len = 0;
 		return SCRAM_ERROR;
 	}
 }
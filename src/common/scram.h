@@ -26,30 +26,53 @@
 #include <stddef.h>
 #include "pchat_crypto.h"
 
-typedef struct
+struct scram_job;
+typedef struct scram_session scram_session;
+
+/* called on the main loop once keys derived off-thread are ready;
+ * scram_process() should then be called again with a NULL input */
+typedef void (*scram_ready_func) (scram_session *session, void *user_data);
+
+struct scram_session
 {
 	pchat_hash_alg digest;
 	size_t digest_size;
 	char *username;
 	char *password;
+	char *cache_id;
 	char *client_nonce_b64;
 	char *client_first_message_bare;
-	unsigned char *salted_password;
+	char *server_first_message;
+	char *server_nonce_b64;
+	unsigned char *salt;
+	size_t salt_len;
+	unsigned int iteration_count;
+	unsigned char client_key[PCHAT_HASH_MAX_SIZE];
+	unsigned char server_key[PCHAT_HASH_MAX_SIZE];
+	int have_keys;
+	struct scram_job *job;
+	scram_ready_func ready;
+	void *ready_data;
 	char *auth_message;
 	char *error;
 	int step;
-} scram_session;
+};
 
 typedef enum
 {
 	SCRAM_ERROR = 0,
 	SCRAM_IN_PROGRESS,
-	SCRAM_SUCCESS
+	SCRAM_SUCCESS,
+	SCRAM_PENDING		/* waiting for the key derivation thread */
 } scram_status;
 
-scram_session *scram_session_create (const char *digest, const char *username, const char *password);
+/* cache_id names the account's network; derived keys are remembered per
+ * (cache_id, user, digest, salt, iterations) for later reconnects */
+scram_session *scram_session_create (const char *digest, const char *username, const char *password,
+												 const char *cache_id, scram_ready_func ready, void *ready_data);
 void scram_session_free (scram_session *session);
 scram_status scram_process (scram_session *session, const char *input, char **output, size_t *output_len);
+void scram_session_forget (scram_session *session);
 
 #endif /* USE_SSL */
 #endif
@@ -43,6 +43,7 @@
 #include "pchat.h"
 #include "fe.h"
 #include "cfgfiles.h"
+#include "charset.h"
 #include "network.h"
 #include "notify.h"
 #include "pchatc.h"
@@ -50,11 +51,14 @@
 #include "outbound.h"
 #include "text.h"
 #include "util.h"
+#include "casefold.h"
 #include "url.h"
 #include "debug-log.h"
 #include "proto-irc.h"
+#include "modes.h"
 #include "servlist.h"
 #include "server.h"
+#include "netreader.h"
 
 #ifdef USE_SSL
 #include "ssl.h"
@@ -104,11 +108,18 @@ tcp_send_real (void *ssl, int sok, GIConv write_converter, char *buf, int len)
 static int
 server_send_real (server *serv, char *buf, int len)
 {
+	int ret;
+
 	fe_add_rawlog (serv, buf, len, TRUE);
 
 	url_check_line (buf);
 
-	return tcp_send_real (serv->ssl, serv->sok, serv->write_converter, buf, len);
+	/* the reader thread may be inside SSL_read on the same session */
+	g_mutex_lock (&serv->io_lock);
+	ret = tcp_send_real (serv->ssl, serv->sok, serv->write_converter, buf, len);
+	g_mutex_unlock (&serv->io_lock);
+
+	return ret;
 }
 
 /* new throttling system, uses the same method as the Undernet
@@ -118,7 +129,7 @@ server_send_real (server *serv, char *buf, int len)
 static int
 tcp_send_queue (server *serv)
 {
-	char *buf, *p;
+	char *buf, *p, *eol;
 	int len, i, pri;
 	GSList *list;
 	time_t now = time (0);
@@ -152,6 +163,11 @@ tcp_send_queue (server *serv)
 				}
 
 				for (p = buf, i = len; i && *p != ' '; p++, i--);
+				/* a draft/multiline batch (several lines in one entry) is a
+				   single message to the server: charge it as one full line */
+				eol = strstr (buf, "\r\n");
+				if (i > 510 && eol && eol + 2 < buf + len)
+					i = 510;
 				serv->next_send += (2 + i / 120);
 				serv->sendq_len -= len;
 				serv->prev_now = now;
@@ -188,9 +204,10 @@ tcp_send_len (server *serv, char *buf, int len)
 	memcpy (dbuf + 1, buf, len);
 	dbuf[len + 1] = 0;
 
-	/* privmsg and notice get a lower priority */
+	/* privmsg and notice get a lower priority, as do pastes (see irc_message_lines) */
 	if (g_ascii_strncasecmp (dbuf + 1, "PRIVMSG", 7) == 0 ||
-		 g_ascii_strncasecmp (dbuf + 1, "NOTICE", 6) == 0)
+		 g_ascii_strncasecmp (dbuf + 1, "NOTICE", 6) == 0 ||
+		 g_ascii_strncasecmp (dbuf + 1, "BATCH ", 6) == 0)
 	{
 		dbuf[0] = 1;
 	}
@@ -270,98 +287,40 @@ close_socket (int sok)
 	fe_timeout_add_seconds (5, close_socket_cb, GINT_TO_POINTER (sok));
 }
 
-/* handle 1 line of text received from the server */
+/* decode one line received from the server (or a DCC chat with a user
+   on it) to UTF-8. The GIConv isn't thread-safe, so callers hold
+   serv->io_lock: the reader thread, and DCC chat on the main thread. */
 
-static void
-server_inline (server *serv, char *line, gssize len)
+char *
+server_decode_line (server *serv, char *line, gssize len, gsize *len_utf8)
 {
-	gsize len_utf8;
 	if (!strcmp (serv->encoding, "UTF-8"))
-		line = text_fixup_invalid_utf8 (line, len, &len_utf8);
+		return text_fixup_invalid_utf8 (line, len, len_utf8);
+	else if (serv->read_table)
+		return charset_decode (serv->read_table, line, len, len_utf8);
 	else
-		line = text_convert_invalid (line, len, serv->read_converter, unicode_fallback_string, &len_utf8);
-
-	fe_add_rawlog (serv, line, len_utf8, FALSE);
-
-	/* let proto-irc.c handle it */
-	serv->p_inline (serv, line, len_utf8);
-
-	g_free (line);
+		return text_convert_invalid (line, len, serv->read_converter, unicode_fallback_string, len_utf8);
 }
 
-/* read data from socket */
+/* the reader thread (netreader.c) hit EOF or an error on the socket */
 
-static gboolean
-server_read (GIOChannel *source, GIOCondition condition, server *serv)
+void
+server_read_failed (server *serv, int error)
 {
-	int sok = serv->sok;
-	int error, i, len;
-	char lbuf[2050];
-
-	while (1)
+	if (!serv->end_of_motd)
 	{
-#ifdef USE_SSL
-		if (!serv->ssl)
-#endif
-			len = recv (sok, lbuf, sizeof (lbuf) - 2, 0);
-#ifdef USE_SSL
-		else
-			len = pchat_ssl_recv (serv->ssl, lbuf, sizeof (lbuf) - 2);
-#endif
-		if (len < 1)
-		{
-			error = 0;
-			if (len < 0)
-			{
-				if (would_block ())
-					return TRUE;
-				error = sock_error ();
-			}
-			if (!serv->end_of_motd)
-			{
-				server_disconnect (serv->server_session, FALSE, error);
-				if (!servlist_cycle (serv))
-				{
-					if (prefs.pchat_net_auto_reconnect)
-						auto_reconnect (serv, FALSE, error);
-				}
-			} else
-			{
-				if (prefs.pchat_net_auto_reconnect)
-					auto_reconnect (serv, FALSE, error);
-				else
-					server_disconnect (serv->server_session, FALSE, error);
-			}
-			return TRUE;
-		}
-
-		i = 0;
-
-		lbuf[len] = 0;
-
-		while (i < len)
+		server_disconnect (serv->server_session, FALSE, error);
+		if (!servlist_cycle (serv))
 		{
-			switch (lbuf[i])
-			{
-			case '\r':
-				break;
-
-			case '\n':
-				serv->linebuf[serv->pos] = 0;
-				server_inline (serv, serv->linebuf, serv->pos);
-				serv->pos = 0;
-				break;
-
-			default:
-				serv->linebuf[serv->pos] = lbuf[i];
-				if (serv->pos >= (sizeof (serv->linebuf) - 1))
-					fprintf (stderr,
-								"*** HEXCHAT WARNING: Buffer overflow - non-compliant server!\n");
-				else
-					serv->pos++;
-			}
-			i++;
+			if (prefs.pchat_net_auto_reconnect)
+				auto_reconnect (serv, FALSE, error);
 		}
+	} else
+	{
+		if (prefs.pchat_net_auto_reconnect)
+			auto_reconnect (serv, FALSE, error);
+		else
+			server_disconnect (serv->server_session, FALSE, error);
 	}
 }
 
@@ -373,7 +332,7 @@ server_connected (server * serv)
 	serv->lag_sent = 0;
 	serv->connected = TRUE;
 	set_nonblocking (serv->sok);
-	serv->iotag = fe_input_add (serv->sok, FIA_READ|FIA_EX, server_read, serv);
+	serv->reader = netreader_start (serv);
 	if (!serv->no_login)
 	{
 		EMIT_SIGNAL (XP_TE_CONNECTED, serv->server_session, NULL, NULL, NULL,
@@ -842,6 +801,15 @@ server_cleanup (server * serv)
 {
 	fe_set_lag (serv, 0);
 
+	/* before the socket and TLS session go away under it */
+	netreader_stop (serv->reader);
+	serv->reader = NULL;
+
+#ifdef USE_SSL
+	/* detaches a key derivation still running for this connection */
+	g_clear_pointer (&serv->scram_session, scram_session_free);
+#endif
+
 	if (serv->iotag)
 	{
 		fe_input_remove (serv->iotag);
@@ -944,12 +912,12 @@ server_disconnect (session * sess, int sendquit, int err)
 		list = list->next;
 	}
 
-	serv->pos = 0;
 	serv->motd_skipped = FALSE;
 	serv->no_login = FALSE;
 	serv->servername[0] = 0;
 	serv->lag_sent = 0;
 
+	notify_server_reset (serv);
 	notify_cleanup ();
 }
 
@@ -1611,6 +1579,9 @@ server_set_encoding (server *serv, char *new_encoding)
 {
 	char *space;
 
+	/* the reader thread decodes with these */
+	g_mutex_lock (&serv->io_lock);
+
 	g_free (serv->encoding);
 
 	if (new_encoding)
@@ -1645,12 +1616,15 @@ server_set_encoding (server *serv, char *new_encoding)
 		g_iconv_close (serv->read_converter);
 	}
 	serv->read_converter = g_iconv_open ("UTF-8", serv->encoding);
+	serv->read_table = charset_table_lookup (serv->encoding);
 
 	if (serv->write_converter != NULL)
 	{
 		g_iconv_close (serv->write_converter);
 	}
 	serv->write_converter = g_iconv_open (serv->encoding, "UTF-8");
+
+	g_mutex_unlock (&serv->io_lock);
 }
 
 server *
@@ -1660,6 +1634,7 @@ server_new (void)
 	server *serv;
 
 	serv = g_new0 (struct server, 1);
+	g_mutex_init (&serv->io_lock);
 
 	/* use server.c and proto-irc.c functions */
 	server_fill_her_up (serv);
@@ -1669,8 +1644,8 @@ server_new (void)
 	g_strlcpy (serv->nick, prefs.pchat_irc_nick1, NICKLEN);
 
 	/* Create hash tables for O(1) session lookups */
-	serv->channels_hash = g_hash_table_new (g_str_hash, g_str_equal);
-	serv->dialogs_hash = g_hash_table_new (g_str_hash, g_str_equal);
+	serv->channels_hash = g_hash_table_new (casefold_hash, casefold_equal);
+	serv->dialogs_hash = g_hash_table_new (casefold_hash, casefold_equal);
 
 	server_set_defaults (serv);
 
@@ -1701,6 +1676,7 @@ server_set_defaults (server *serv)
 	serv->chanmodes = g_strdup ("beI,k,l");
 	serv->nick_prefixes = g_strdup ("@%+");
 	serv->nick_modes = g_strdup ("ohv");
+	mode_class_update (serv);
 	serv->modes_per_line = 3; /* https://datatracker.ietf.org/doc/html/rfc1459#section-4.2.3.1 */
 	serv->sasl_mech = MECH_PLAIN;
 
@@ -1714,6 +1690,8 @@ server_set_defaults (server *serv)
 	serv->is_away = FALSE;
 	serv->supports_watch = FALSE;
 	serv->supports_monitor = FALSE;
+	serv->watch_limit = 0;
+	notify_server_reset (serv);
 	serv->bad_prefix = FALSE;
 	serv->use_who = TRUE;
 	serv->have_namesx = FALSE;
@@ -1725,6 +1703,13 @@ server_set_defaults (server *serv)
 	serv->have_extjoin = FALSE;
 	serv->have_account_tag = FALSE;
 	serv->have_server_time = FALSE;
+	serv->have_batch = FALSE;
+	serv->have_chathistory = FALSE;
+	serv->chathistory_limit = 0;
+	serv->have_multiline = FALSE;
+	serv->multiline_max_bytes = 0;
+	serv->multiline_max_lines = 0;
+	inbound_batch_clear (serv);
 	serv->have_sasl = FALSE;
 	serv->have_except = FALSE;
 	serv->have_invite = FALSE;
@@ -1859,9 +1844,12 @@ server_free (server *serv)
 	g_free (serv->bad_nick_prefixes);
 	g_free (serv->last_away_reason);
 	g_free (serv->encoding);
+	notify_ison_clear (serv);
+	inbound_batch_clear (serv);
 
 	g_iconv_close (serv->read_converter);
 	g_iconv_close (serv->write_converter);
+	g_mutex_clear (&serv->io_lock);
 
 	if (serv->favlist)
 		g_slist_free_full (serv->favlist, (GDestroyNotify) servlist_favchan_free);
@@ -31,6 +31,8 @@ server *server_new (void);
 int is_server (server *serv);
 void server_fill_her_up (server *serv);
 void server_set_encoding (server *serv, char *new_encoding);
+char *server_decode_line (server *serv, char *line, gssize len, gsize *len_utf8);
+void server_read_failed (server *serv, int error);
 void server_set_defaults (server *serv);
 char *server_get_network (server *serv, gboolean fallback);
 void server_set_name (server *serv, char *name);
@@ -336,6 +336,99 @@ static const struct defaultserver def[] =
 
 GSList *network_list = 0;
 
+/* Lookup indexes over network_list, rebuilt lazily after any change to the
+   list. Both map a lowercased key to the first matching network in list
+   order, which is what the linear scans used to return. */
+typedef struct
+{
+	ircnet *net;
+	int pos;
+} netindex_entry;
+
+static GHashTable *netindex_names;	/* lowercased net->name -> entry */
+static GHashTable *netindex_hosts;	/* lowercased hostname sans /port -> entry */
+static gboolean *netindex_host_lens;	/* hostname lengths present */
+static gsize netindex_max_len;
+static gboolean netindex_dirty = TRUE;
+
+/* call after renaming, reordering or editing the servers of a network */
+
+void
+servlist_index_invalidate (void)
+{
+	netindex_dirty = TRUE;
+}
+
+static void
+netindex_insert (GHashTable *table, char *key, ircnet *net, int pos)
+{
+	netindex_entry *entry;
+
+	if (g_hash_table_contains (table, key))
+	{
+		g_free (key);
+		return;
+	}
+
+	entry = g_new (netindex_entry, 1);
+	entry->net = net;
+	entry->pos = pos;
+	g_hash_table_insert (table, key, entry);
+}
+
+static void
+netindex_build (void)
+{
+	GSList *list, *slist;
+	ircnet *net;
+	ircserver *serv;
+	const char *p;
+	gsize len;
+	int pos = 0;
+
+	if (!netindex_names)
+	{
+		netindex_names = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+		netindex_hosts = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+	}
+	else
+	{
+		g_hash_table_remove_all (netindex_names);
+		g_hash_table_remove_all (netindex_hosts);
+	}
+
+	netindex_max_len = 0;
+	for (list = network_list; list; list = list->next)
+	{
+		for (slist = ((ircnet *) list->data)->servlist; slist; slist = slist->next)
+		{
+			serv = slist->data;
+			len = (p = strchr (serv->hostname, '/')) ? (gsize) (p - serv->hostname) : strlen (serv->hostname);
+			netindex_max_len = MAX (netindex_max_len, len);
+		}
+	}
+	g_free (netindex_host_lens);
+	netindex_host_lens = g_new0 (gboolean, netindex_max_len + 1);
+
+	for (list = network_list; list; list = list->next, pos++)
+	{
+		net = list->data;
+		netindex_insert (netindex_names, g_ascii_strdown (net->name, -1), net, pos);
+
+		for (slist = net->servlist; slist; slist = slist->next)
+		{
+			serv = slist->data;
+
+			/* Ignore port when comparing */
+			len = (p = strchr (serv->hostname, '/')) ? (gsize) (p - serv->hostname) : strlen (serv->hostname);
+			netindex_host_lens[len] = TRUE;
+			netindex_insert (netindex_hosts, g_ascii_strdown (serv->hostname, len), net, pos);
+		}
+	}
+
+	netindex_dirty = FALSE;
+}
+
 favchannel *
 servlist_favchan_copy (favchannel *fav)
 {
@@ -450,22 +543,13 @@ int
 servlist_connect_by_netname (session *sess, char *network, gboolean join)
 {
 	ircnet *net;
-	GSList *list = network_list;
-
-	while (list)
-	{
-		net = list->data;
 
-		if (g_ascii_strcasecmp (net->name, network) == 0)
-		{
-			servlist_connect (sess, net, join);
-			return 1;
-		}
-
-		list = list->next;
-	}
+	net = servlist_net_find (network, NULL, g_ascii_strcasecmp);
+	if (!net)
+		return 0;
 
-	return 0;
+	servlist_connect (sess, net, join);
+	return 1;
 }
 
 int
@@ -645,49 +729,65 @@ servlist_command_find (ircnet *net, char *cmd, int *pos)
 ircnet *
 servlist_net_find_from_server (char *server_name)
 {
-	GSList *list = network_list;
-	GSList *slist;
-	ircnet *net;
-	ircserver *serv;
-
-	while (list)
-	{
-		net = list->data;
+	netindex_entry *entry, *best = NULL;
+	char *key;
+	char saved;
+	gsize len, i;
 
-		slist = net->servlist;
-		while (slist)
-		{
-			gsize hostname_len;
-			const char *hostname, *p;
+	if (netindex_dirty)
+		netindex_build ();
 
-			serv = slist->data;
-			hostname = serv->hostname;
-
-			/* Ignore port when comparing */
-			if ((p = strchr (hostname, '/')))
-				hostname_len = p - hostname;
-			else
-				hostname_len = strlen (hostname);
+	/* a listed hostname matches if it is a prefix of server_name, so probe
+	   every prefix length that some listed hostname actually has */
+	key = g_ascii_strdown (server_name, -1);
+	len = MIN (strlen (key), netindex_max_len);
+	for (i = 0; i <= len; i++)
+	{
+		if (!netindex_host_lens[i])
+			continue;
 
-			if (g_ascii_strncasecmp (hostname, server_name, hostname_len) == 0)
-				return net;
-			slist = slist->next;
-		}
+		saved = key[i];
+		key[i] = 0;
+		entry = g_hash_table_lookup (netindex_hosts, key);
+		key[i] = saved;
 
-		list = list->next;
+		if (entry && (!best || entry->pos < best->pos))
+			best = entry;
 	}
+	g_free (key);
 
-	return NULL;
+	return best ? best->net : NULL;
 }
 
 ircnet *
 servlist_net_find (char *name, int *pos, int (*cmpfunc) (const char *, const char *))
 {
-	GSList *list = network_list;
+	GSList *list;
+	netindex_entry *entry;
 	ircnet *net;
+	char *key;
 	int i = 0;
 
-	while (list)
+	if (netindex_dirty)
+		netindex_build ();
+
+	key = g_ascii_strdown (name, -1);
+	entry = g_hash_table_lookup (netindex_names, key);
+	g_free (key);
+
+	/* no case-insensitive match means no match at all */
+	if (!entry && (cmpfunc == strcmp || cmpfunc == g_ascii_strcasecmp))
+		return NULL;
+
+	if (entry && cmpfunc (entry->net->name, name) == 0)
+	{
+		if (pos)
+			*pos = entry->pos;
+		return entry->net;
+	}
+
+	/* names differing only in case, walk the list */
+	for (list = network_list; list; list = list->next, i++)
 	{
 		net = list->data;
 		if (cmpfunc (net->name, name) == 0)
@@ -696,8 +796,6 @@ servlist_net_find (char *name, int *pos, int (*cmpfunc) (const char *, const cha
 				*pos = i;
 			return net;
 		}
-		i++;
-		list = list->next;
 	}
 
 	return NULL;
@@ -712,6 +810,7 @@ servlist_server_add (ircnet *net, char *name)
 	serv->hostname = g_strdup (name);
 
 	net->servlist = g_slist_append (net->servlist, serv);
+	servlist_index_invalidate ();
 
 	return serv;
 }
@@ -773,6 +872,7 @@ servlist_server_remove (ircnet *net, ircserver *serv)
 	g_free (serv->hostname);
 	g_free (serv);
 	net->servlist = g_slist_remove (net->servlist, serv);
+	servlist_index_invalidate ();
 }
 
 static void
@@ -851,6 +951,7 @@ servlist_net_remove (ircnet *net)
 
 	servlist_server_remove_all (net);
 	network_list = g_slist_remove (network_list, net);
+	servlist_index_invalidate ();
 
 	g_free (net->nick);
 	g_free (net->nick2);
@@ -894,6 +995,7 @@ servlist_net_add (char *name, char *comment, int prepend)
 		network_list = g_slist_prepend (network_list, net);
 	else
 		network_list = g_slist_append (network_list, net);
+	servlist_index_invalidate ();
 
 	return net;
 }
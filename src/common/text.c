@@ -35,6 +35,7 @@
 #include "pchat.h"
 #include "cfgfiles.h"
 #include "chanopt.h"
+#include "chathistory.h"
 #include "plugin.h"
 #include "fe.h"
 #include "server.h"
@@ -43,6 +44,7 @@
 #include "pchatc.h"
 #include "text.h"
 #include "typedef.h"
+#include "trace.h"
 #ifdef WIN32
 #include <windows.h>
 #endif
@@ -199,7 +201,13 @@ scrollback_save (session *sess, char *text, time_t stamp)
 		stamp = time(0);
 	/* Always serialise as 64-bit so files are portable across platforms
 	 * regardless of native time_t width. */
-	buf = g_strdup_printf ("T %" G_GINT64_FORMAT " ", (gint64) stamp);
+	/* a msgid, if the server sent one, goes after the stamp as ",<msgid>",
+	 * which older readers skip along with the stamp */
+	if (sess->server && sess->server->current_msgid)
+		buf = g_strdup_printf ("T %" G_GINT64_FORMAT ",%s ", (gint64) stamp,
+									  sess->server->current_msgid);
+	else
+		buf = g_strdup_printf ("T %" G_GINT64_FORMAT " ", (gint64) stamp);
 
 	g_output_stream_write (ostream, buf, strlen (buf), NULL, NULL);
 	g_output_stream_write (ostream, text, strlen (text), NULL, NULL);
@@ -275,9 +283,11 @@ scrollback_load (session *sess)
 			 */
 			if (buf[0] == 'T' && buf[1] == ' ')
 			{
+				char *end;
+
 				/* Scrollback files always store 64-bit timestamps; parse as such
 				 * regardless of the local time_t width. */
-				stamp = (time_t) g_ascii_strtoull (buf + 2, NULL, 10);
+				stamp = (time_t) g_ascii_strtoull (buf + 2, &end, 10);
 
 				if (G_UNLIKELY(stamp == 0))
 				{
@@ -286,6 +296,17 @@ scrollback_load (session *sess)
 				}
 
 				text = strchr (buf + 3, ' ');
+
+				/* "T <stamp>,<msgid> <text>" */
+				if (*end == ',' && text)
+				{
+					*text = 0;
+					chathistory_remember (sess, end + 1, stamp);
+					*text = ' ';
+				}
+				else
+					chathistory_remember (sess, NULL, stamp);
+
 				if (text && text[1])
 				{
 					if (prefs.pchat_text_stripcolor_replay)
@@ -365,6 +386,11 @@ log_close (session *sess)
 		close (sess->logfd);
 		sess->logfd = -1;
 	}
+
+	g_free (sess->log_path);
+	sess->log_path = NULL;
+	g_free (sess->log_key);
+	sess->log_key = NULL;
 }
 
 /*
@@ -553,20 +579,124 @@ log_create_pathname (char *servname, char *channame, char *netname)
 	return g_strdup (fname);
 }
 
+/* when the strftime fields of the logmask next produce a different path,
+   0 if they never do. %c %n %s have been replaced by log_insert_vars. */
+
+static time_t
+log_mask_expiry (const char *mask, time_t now)
+{
+	struct tm tm;
+	time_t next;
+	int step = 0;
+	const char *p;
+
+	for (p = mask; *p && step != 1; p++)
+	{
+		if (*p != '%' || !p[1])
+			continue;
+		p++;
+		if ((*p == 'E' || *p == 'O') && p[1])
+			p++;
+
+		switch (*p)
+		{
+		case '%': case 'c': case 'n': case 's': case 't':
+			break;
+		case 'a': case 'A': case 'b': case 'B': case 'h': case 'd': case 'e':
+		case 'j': case 'm': case 'u': case 'w': case 'U': case 'W': case 'V':
+		case 'G': case 'g': case 'y': case 'Y': case 'C': case 'D': case 'F':
+		case 'x':
+			step = step ? step : 86400;
+			break;
+		case 'H': case 'I': case 'k': case 'l': case 'p': case 'P':
+			step = (step && step < 3600) ? step : 3600;
+			break;
+		case 'M': case 'R':
+			step = (step && step < 60) ? step : 60;
+			break;
+		default:
+			step = 1;
+		}
+	}
+
+	switch (step)
+	{
+	case 0:
+		return 0;
+	case 1:
+		return now + 1;
+	case 60:
+		return now - (now % 60) + 60;
+	}
+
+#ifdef WIN32
+	localtime_s (&tm, &now);
+#else
+	localtime_r (&now, &tm);
+#endif
+	tm.tm_sec = 0;
+	tm.tm_min = 0;
+	if (step == 86400)
+	{
+		tm.tm_hour = 0;
+		tm.tm_mday++;
+	}
+	else
+		tm.tm_hour++;
+	tm.tm_isdst = -1;
+
+	next = mktime (&tm);
+	return next > now ? next : now + 1;
+}
+
+/* the session's log file name, only rebuilt when the time bucket of the
+   logmask passes or the server, channel, network or mask changes */
+
+static const char *
+log_get_path (session *sess, gboolean *changed)
+{
+	char key[1024];
+	char *netname, *path;
+	time_t now;
+	int len;
+
+	netname = server_get_network (sess->server, FALSE);
+	len = g_snprintf (key, sizeof (key), "%s\n%s\n%s%s\n%s", sess->server->servername,
+							sess->channel, netname ? "=" : "", netname ? netname : "",
+							prefs.pchat_irc_logmask);
+	now = time (NULL);
+
+	if (changed)
+		*changed = FALSE;
+
+	if (sess->log_path && len < (int) sizeof (key) && !strcmp (key, sess->log_key) &&
+		 (!sess->log_expires || now < sess->log_expires))
+		return sess->log_path;
+
+	path = log_create_pathname (sess->server->servername, sess->channel, netname);
+	if (changed)
+		*changed = g_strcmp0 (path, sess->log_path) != 0;
+
+	g_free (sess->log_path);
+	g_free (sess->log_key);
+	sess->log_path = path;
+	sess->log_key = g_strdup (key);
+	sess->log_expires = log_mask_expiry (prefs.pchat_irc_logmask, now);
+
+	return sess->log_path;
+}
+
 static int
-log_open_file (char *servname, char *channame, char *netname)
+log_open_file (const char *file)
 {
 	char buf[512];
 	int fd;
-	char *file;
 	time_t currenttime;
 
-	file = log_create_pathname (servname, channame, netname);
 	if (!file)
 		return -1;
 
 	fd = g_open (file, O_CREAT | O_APPEND | O_WRONLY | OFLAGS, 0644);
-	g_free (file);
 
 	if (fd == -1)
 		return -1;
@@ -584,15 +714,11 @@ log_open (session *sess)
 	static gboolean log_error = FALSE;
 
 	log_close (sess);
-	sess->logfd = log_open_file (sess->server->servername, sess->channel,
-										  server_get_network (sess->server, FALSE));
+	sess->logfd = log_open_file (log_get_path (sess, NULL));
 
 	if (!log_error && sess->logfd == -1)
 	{
-		char *filename = log_create_pathname (sess->server->servername, sess->channel, server_get_network (sess->server, FALSE));
-		char *message = g_strdup_printf (_("* Can't open log file(s) for writing. Check the\npermissions on %s"), filename);
-
-		g_free (filename);
+		char *message = g_strdup_printf (_("* Can't open log file(s) for writing. Check the\npermissions on %s"), sess->log_path);
 
 		fe_message (message, FE_MSG_WAIT | FE_MSG_ERROR);
 
@@ -625,94 +751,148 @@ int
 get_stamp_str (char *fmt, time_t tim, char **ret)
 {
 	char dest[128];
-	gsize len_locale;
-	gsize len_utf8;
-
-	/* strftime requires the format string to be in locale encoding. */
-	fmt = g_locale_from_utf8 (fmt, -1, NULL, NULL, NULL);
-
-	len_locale = strftime_validated (dest, sizeof (dest), fmt, localtime (&tim));
-
-	g_free (fmt);
-
-	if (len_locale == 0)
-	{
-		return 0;
-	}
+	gsize len;
 
-	*ret = g_locale_to_utf8 (dest, len_locale, NULL, &len_utf8, NULL);
-	if (*ret == NULL)
+	len = stamp_format (fmt, tim, dest, sizeof (dest));
+	if (len == 0)
 	{
 		return 0;
 	}
 
-	return len_utf8;
+	*ret = g_strndup (dest, len);
+	return len;
 }
 
+/* one log line as it goes to disk: stamp, stripped text, newline */
+
 static void
-log_write (session *sess, char *text, time_t ts)
+log_format_line (GString *out, char *text, time_t ts)
 {
 	char *temp;
-	char *stamp;
-	char *file;
+	char stamp[128];
 	int len;
 
-	if (sess->text_logging == SET_DEFAULT)
-	{
-		if (!prefs.pchat_irc_logging)
-			return;
-	}
-	else
+	if (prefs.pchat_stamp_log)
 	{
-		if (sess->text_logging != SET_ON)
-			return;
+		if (!ts) ts = time(0);
+		len = stamp_format (prefs.pchat_stamp_log_format, ts, stamp, sizeof (stamp));
+		if (len)
+			g_string_append_len (out, stamp, len);
 	}
 
+	temp = strip_color (text, -1, STRIP_ALL);
+	len = strlen (temp);
+	g_string_append_len (out, temp, len);
+	/* lots of scripts/plugins print without a \n at the end */
+	if (len == 0 || temp[len - 1] != '\n')
+		g_string_append_c (out, '\n');	/* emulate what xtext would display */
+	g_free (temp);
+}
+
+/* opens (or re-opens, if it was moved away) the session's log file */
+
+static gboolean
+log_prepare (session *sess)
+{
+	const char *file;
+	gboolean changed;
+	time_t now;
+
 	if (sess->logfd == -1)
 	{
 		log_open (sess);
 	}
 
 	/* change to a different log file? */
-	file = log_create_pathname (sess->server->servername, sess->channel, server_get_network (sess->server, FALSE));
+	file = log_get_path (sess, &changed);
 	if (file)
 	{
-		if (g_access (file, F_OK) != 0)
+		/* or was it moved away? checked at most once a second */
+		now = time (NULL);
+		if (!changed && now != sess->log_checked)
+		{
+			sess->log_checked = now;
+			changed = g_access (file, F_OK) != 0;
+		}
+
+		if (changed)
 		{
 			if (sess->logfd != -1)
 			{
 				close (sess->logfd);
 			}
 
-			sess->logfd = log_open_file (sess->server->servername, sess->channel, server_get_network (sess->server, FALSE));
+			sess->logfd = log_open_file (file);
 		}
+	}
+
+	return sess->logfd != -1;
+}
 
-		g_free (file);
+static void
+log_write (session *sess, char *text, time_t ts)
+{
+	GString *line;
+	gint64 span;
+
+	if (sess->text_logging == SET_DEFAULT)
+	{
+		if (!prefs.pchat_irc_logging)
+			return;
+	}
+	else
+	{
+		if (sess->text_logging != SET_ON)
+			return;
 	}
 
-	if (sess->logfd == -1)
+	/* inside text_batch_begin/end: written out in one go at the end */
+	if (sess->log_batch)
 	{
+		log_format_line (sess->log_batch, text, ts);
 		return;
 	}
 
-	if (prefs.pchat_stamp_log)
+	span = trace_begin ();
+	if (log_prepare (sess))
 	{
-		if (!ts) ts = time(0);
-		len = get_stamp_str (prefs.pchat_stamp_log_format, ts, &stamp);
-		if (len)
-		{
-			write (sess->logfd, stamp, len);
-			g_free (stamp);
-		}
+		line = g_string_sized_new (256);
+		log_format_line (line, text, ts);
+		write (sess->logfd, line->str, line->len);
+		g_string_free (line, TRUE);
 	}
+	trace_end ("log_write", span);
+}
 
-	temp = strip_color (text, -1, STRIP_ALL);
-	len = strlen (temp);
-	write (sess->logfd, temp, len);
-	/* lots of scripts/plugins print without a \n at the end */
-	if (temp[len - 1] != '\n')
-		write (sess->logfd, "\n", 1);	/* emulate what xtext would display */
-	g_free (temp);
+/* Group a burst of output to one session (e.g. echoing a paste): the
+ * front end renders it as one update and the log gets a single write.
+ * Calls nest; everything is flushed by the outermost text_batch_end. */
+
+void
+text_batch_begin (session *sess)
+{
+	if (sess->text_batch++ > 0)
+		return;
+
+	sess->log_batch = g_string_sized_new (1024);
+	fe_text_batch_begin (sess);
+}
+
+void
+text_batch_end (session *sess)
+{
+	GString *batch;
+
+	if (sess->text_batch == 0 || --sess->text_batch > 0)
+		return;
+
+	fe_text_batch_end (sess);
+
+	batch = sess->log_batch;
+	sess->log_batch = NULL;
+	if (batch->len && log_prepare (sess))
+		write (sess->logfd, batch->str, batch->len);
+	g_string_free (batch, TRUE);
 }
 
 /**
@@ -852,9 +1032,25 @@ PrintTextTimeStamp (session *sess, char *text, time_t timestamp)
 		text = text_fixup_invalid_utf8 (text, -1, NULL);
 	}
 
-	log_write (sess, text, timestamp);
-	scrollback_save (sess, text, timestamp);
-	fe_print_text (sess, text, timestamp, FALSE);
+	if (chathistory_backlog (sess))
+	{
+		/* replayed chathistory: it's already been seen (or is out of order)
+			for the log and scrollback, and not new activity. An older page
+			goes above what's shown. */
+		if (chathistory_prepending (sess))
+			fe_print_history (sess, text, timestamp);
+		else
+			fe_print_text (sess, text, timestamp, TRUE);
+	}
+	else
+	{
+		log_write (sess, text, timestamp);
+		scrollback_save (sess, text, timestamp);
+		fe_print_text (sess, text, timestamp, FALSE);
+	}
+
+	if (sess->server && sess->server->current_msgid)
+		chathistory_remember (sess, sess->server->current_msgid, timestamp);
 	g_free (text);
 }
 
@@ -1058,6 +1254,12 @@ static char * const pevt_quit_help[] = {
 	N_("Host"),
 };
 
+static char * const pevt_netsplit_help[] = {
+	N_("Servers"),
+	N_("Number of users"),
+	N_("Nicks"),
+};
+
 static char * const pevt_pingrep_help[] = {
 	N_("Who it's from"),
 	N_("The time in x.x format (see below)"),
@@ -2027,11 +2229,12 @@ text_color_of (char *name)
 }
 
 
-/* called by EMIT_SIGNAL macro */
+/* called by EMIT_SIGNAL macro. nick_color is the colour for a coloured
+ * nick in arg a, or -1 to work it out from the nick. */
 
-void
-text_emit (int index, session *sess, char *a, char *b, char *c, char *d,
-			  time_t timestamp)
+static void
+text_emit_real (int index, session *sess, int nick_color, char *a, char *b,
+					 char *c, char *d, time_t timestamp)
 {
 	char *word[PDIWORDS];
 	int i;
@@ -2042,7 +2245,7 @@ text_emit (int index, session *sess, char *a, char *b, char *c, char *d,
 
 	if (a != NULL && prefs.pchat_text_color_nicks && (index == XP_TE_CHANACTION || index == XP_TE_CHANMSG))
 	{
-		g_snprintf (tbuf, sizeof (tbuf), "\003%d%s", text_color_of (a), a);
+		g_snprintf (tbuf, sizeof (tbuf), "\003%d%s", nick_color >= 0 ? nick_color : text_color_of (a), a);
 		a = tbuf;
 		stripcolor_args &= ~ARG_FLAG(1);	/* don't strip color from this argument */
 	}
@@ -2131,6 +2334,55 @@ text_emit (int index, session *sess, char *a, char *b, char *c, char *d,
 	display_event (sess, index, word, stripcolor_args, timestamp);
 }
 
+void
+text_emit (int index, session *sess, char *a, char *b, char *c, char *d,
+			  time_t timestamp)
+{
+	gint64 span = trace_begin ();
+
+	text_emit_real (index, sess, -1, a, b, c, d, timestamp);
+	trace_end ("text_emit", span);
+}
+
+/* text_emit() for a channel message or action from a known user: the
+ * nick colour comes from the User instead of being worked out again */
+
+void
+text_emit_speaker (int index, session *sess, struct User *user, char *a, char *b,
+						 char *c, char *d, time_t timestamp)
+{
+	gint64 span = trace_begin ();
+
+	text_emit_real (index, sess, user ? user->color : -1, a, b, c, d, timestamp);
+	trace_end ("text_emit", span);
+}
+
+/* Hand an event to plugins without printing it. Used for the per-user
+   Quit/Join lines that a netsplit or netjoin batch summarises in one
+   line, so scripts hooking those events still see every user. */
+
+void
+text_emit_hidden (int index, session *sess, char *a, char *b, char *c, char *d,
+						time_t timestamp)
+{
+	char *word[PDIWORDS];
+	tab_state_flags current_state = sess->tab_state;
+	int i;
+
+	word[0] = te[index].name;
+	word[1] = (a ? a : "\000");
+	word[2] = (b ? b : "\000");
+	word[3] = (c ? c : "\000");
+	word[4] = (d ? d : "\000");
+	for (i = 5; i < PDIWORDS; i++)
+		word[i] = "\000";
+
+	plugin_emit_print (sess, word, timestamp);
+
+	if (is_session (sess))
+		sess->tab_state = current_state;
+}
+
 char *
 text_find_format_string (char *name)
 {
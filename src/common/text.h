@@ -23,6 +23,8 @@
 #ifndef PCHAT_TEXT_H
 #define PCHAT_TEXT_H
 
+struct User;
+
 /* timestamp is non-zero if we are using server-time */
 #define EMIT_SIGNAL_TIMESTAMP(i, sess, a, b, c, d, e, timestamp) \
 	text_emit(i, sess, a, b, c, d, timestamp)
@@ -47,6 +49,8 @@ void PrintTextf (session *sess, const char *format, ...) G_GNUC_PRINTF (2, 3);
 void PrintTextTimeStampf (session *sess, time_t timestamp, const char *format, ...) G_GNUC_PRINTF (3, 4);
 void log_close (session *sess);
 void log_open_or_close (session *sess);
+void text_batch_begin (session *sess);
+void text_batch_end (session *sess);
 void load_text_events (void);
 void pevent_save (char *fn);
 int pevt_build_string (const char *input, char **output, int *max_arg);
@@ -55,6 +59,10 @@ void pevent_make_pntevts (void);
 int text_color_of (char *name);
 void text_emit (int index, session *sess, char *a, char *b, char *c, char *d,
 		time_t timestamp);
+void text_emit_hidden (int index, session *sess, char *a, char *b, char *c, char *d,
+		time_t timestamp);
+void text_emit_speaker (int index, session *sess, struct User *user, char *a, char *b,
+		char *c, char *d, time_t timestamp);
 int text_emit_by_name (char *name, session *sess, time_t timestamp,
 					   char *a, char *b, char *c, char *d);
 gchar *text_convert_invalid (const gchar* text, gssize len, GIConv converter, const gchar *fallback, gsize *len_out);
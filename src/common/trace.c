@@ -0,0 +1,198 @@
+/* PChat
+ * Copyright (C) 2026 PChat-IRC contributors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <string.h>
+
+#include "trace.h"
+
+#define TRACE_RING_SIZE 65536		/* spans kept per thread */
+
+typedef struct
+{
+	const char *name;
+	gint64 start;
+	gint64 dur;
+} trace_event;
+
+typedef struct
+{
+	GMutex lock;					/* writer vs. trace_dump; uncontended otherwise */
+	guint tid;
+	const char *thread_name;
+	gboolean dead;					/* thread exited; next new thread may take it over */
+	guint64 count;					/* spans ever written; ring index is count % size */
+	trace_event events[TRACE_RING_SIZE];
+} trace_ring;
+
+gint trace_active = FALSE;
+
+static GMutex rings_lock;
+static GSList *rings;
+static guint next_tid = 1;
+
+static void trace_thread_exit (gpointer data);
+
+static GPrivate ring_key = G_PRIVATE_INIT (trace_thread_exit);
+static GPrivate name_key;
+
+static void
+trace_thread_exit (gpointer data)
+{
+	trace_ring *ring = data;
+
+	g_mutex_lock (&rings_lock);
+	ring->dead = TRUE;
+	g_mutex_unlock (&rings_lock);
+}
+
+/* the calling thread's ring, created on its first span. Rings live for the
+ * whole process so a dump still shows threads that have since exited, and
+ * are recycled so reconnects don't grow memory without bound. */
+static trace_ring *
+trace_thread_ring (void)
+{
+	trace_ring *ring = g_private_get (&ring_key);
+	GSList *list;
+
+	if (ring)
+		return ring;
+
+	g_mutex_lock (&rings_lock);
+	for (list = rings; list; list = list->next)
+	{
+		trace_ring *r = list->data;
+
+		if (r->dead)
+		{
+			ring = r;
+			break;
+		}
+	}
+	if (!ring)
+	{
+		ring = g_new0 (trace_ring, 1);
+		g_mutex_init (&ring->lock);
+		ring->tid = next_tid++;
+		rings = g_slist_append (rings, ring);
+	}
+	ring->dead = FALSE;
+	ring->thread_name = g_private_get (&name_key);
+	g_mutex_unlock (&rings_lock);
+
+	g_private_set (&ring_key, ring);
+	return ring;
+}
+
+void
+trace_end (const char *name, gint64 start)
+{
+	trace_ring *ring;
+	trace_event *ev;
+
+	if (start == 0)
+		return;
+
+	ring = trace_thread_ring ();
+	g_mutex_lock (&ring->lock);
+	ev = &ring->events[ring->count % TRACE_RING_SIZE];
+	ev->name = name;
+	ev->start = start;
+	ev->dur = g_get_monotonic_time () - start;
+	ring->count++;
+	g_mutex_unlock (&ring->lock);
+}
+
+/* names the calling thread in dumps; name must outlive the thread */
+void
+trace_thread_name (const char *name)
+{
+	trace_ring *ring = g_private_get (&ring_key);
+
+	g_private_set (&name_key, (gpointer) name);
+	if (ring)
+		ring->thread_name = name;
+}
+
+void
+trace_set_active (gboolean active)
+{
+	g_atomic_int_set (&trace_active, active);
+}
+
+void
+trace_clear (void)
+{
+	GSList *list;
+
+	g_mutex_lock (&rings_lock);
+	for (list = rings; list; list = list->next)
+	{
+		trace_ring *ring = list->data;
+
+		g_mutex_lock (&ring->lock);
+		ring->count = 0;
+		g_mutex_unlock (&ring->lock);
+	}
+	g_mutex_unlock (&rings_lock);
+}
+
+/* writes every buffered span as Chrome trace JSON; returns how many, or
+ * -1 with error set */
+int
+trace_dump (const char *filename, GError **error)
+{
+	GString *out = g_string_sized_new (1024 * 1024);
+	GSList *list;
+	gboolean first = TRUE;
+	int written = 0;
+	int ret;
+
+	g_string_append (out, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+
+	g_mutex_lock (&rings_lock);
+	for (list = rings; list; list = list->next)
+	{
+		trace_ring *ring = list->data;
+		guint64 i;
+
+		g_mutex_lock (&ring->lock);
+		g_string_append_printf (out, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,"
+										"\"args\":{\"name\":\"%s\"}}",
+										first ? "" : ",", ring->tid,
+										ring->thread_name ? ring->thread_name : "thread");
+		first = FALSE;
+
+		i = ring->count > TRACE_RING_SIZE ? ring->count - TRACE_RING_SIZE : 0;
+		for (; i < ring->count; i++)
+		{
+			trace_event *ev = &ring->events[i % TRACE_RING_SIZE];
+
+			g_string_append_printf (out, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,"
+											"\"ts\":%" G_GINT64_FORMAT ",\"dur\":%" G_GINT64_FORMAT "}",
+											ev->name, ring->tid, ev->start, ev->dur);
+			written++;
+		}
+		g_mutex_unlock (&ring->lock);
+	}
+	g_mutex_unlock (&rings_lock);
+
+	g_string_append (out, "\n]}\n");
+	ret = g_file_set_contents (filename, out->str, out->len, error) ? written : -1;
+	g_string_free (out, TRUE);
+	return ret;
+}
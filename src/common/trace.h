@@ -0,0 +1,45 @@
+/* PChat
+ * Copyright (C) 2026 PChat-IRC contributors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/* Trace spans for the message pipeline, off until /TRACE ON.
+ *
+ *	gint64 span = trace_begin ();
+ *	...
+ *	trace_end ("irc_inline", span);
+ *
+ * While tracing is off, trace_begin is one predictable branch and
+ * trace_end returns at once. Spans are kept in a ring buffer per thread
+ * and written out by trace_dump as Chrome trace JSON, for chrome://tracing
+ * or Perfetto. Names must be string literals: only the pointer is stored. */
+
+#ifndef PCHAT_TRACE_H
+#define PCHAT_TRACE_H
+
+#include <glib.h>
+
+extern gint trace_active;
+
+#define trace_begin() (G_UNLIKELY (trace_active) ? g_get_monotonic_time () : 0)
+
+void trace_end (const char *name, gint64 start);
+void trace_thread_name (const char *name);
+void trace_set_active (gboolean active);
+void trace_clear (void);
+int trace_dump (const char *filename, GError **error);
+
+#endif
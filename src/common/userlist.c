@@ -27,6 +27,7 @@
 #include "tree.h"
 #include "pchatc.h"
 #include "util.h"
+#include "text.h"
 
 
 int
@@ -177,48 +178,165 @@ userlist_set_account (struct session *sess, char *nick, char *account)
 	}
 }
 
+#define USERINFO_CHANGED 1	/* some field was updated */
+#define USERINFO_REHASH 2	/* ...and the front end's row shows it */
+
+static int
+userlist_merge_info (struct User *user, char *hostname, char *realname,
+							char *servername, char *account, unsigned int away)
+{
+	int changed = 0;
+
+	if (hostname && (!user->hostname || strcmp(user->hostname, hostname)))
+	{
+		changed |= USERINFO_CHANGED;
+		if (prefs.pchat_gui_ulist_show_hosts)
+			changed |= USERINFO_REHASH;
+		g_free (user->hostname);
+		user->hostname = g_strdup (hostname);
+	}
+	if (realname && *realname && g_strcmp0 (user->realname, realname) != 0)
+	{
+		changed |= USERINFO_CHANGED;
+		g_free (user->realname);
+		user->realname = g_strdup (realname);
+	}
+	if (!user->servername && servername)
+	{
+		changed |= USERINFO_CHANGED;
+		user->servername = g_strdup (servername);
+	}
+	if (!user->account && account && strcmp (account, "0") != 0)
+	{
+		changed |= USERINFO_CHANGED;
+		user->account = g_strdup (account);
+	}
+	if (away != 0xff && user->away != away)
+	{
+		changed |= USERINFO_CHANGED | USERINFO_REHASH;
+		user->away = away;
+	}
+
+	return changed;
+}
+
 int
 userlist_add_hostname (struct session *sess, char *nick, char *hostname,
 							  char *realname, char *servername, char *account, unsigned int away)
 {
 	struct User *user;
-	gboolean do_rehash = FALSE;
 
 	user = userlist_find (sess, nick);
 	if (user)
 	{
-		if (hostname && (!user->hostname || strcmp(user->hostname, hostname)))
-		{
-			if (prefs.pchat_gui_ulist_show_hosts)
-				do_rehash = TRUE;
-			g_free (user->hostname);
-			user->hostname = g_strdup (hostname);
-		}
-		if (realname && *realname && g_strcmp0 (user->realname, realname) != 0)
-		{
-			g_free (user->realname);
-			user->realname = g_strdup (realname);
-		}
-		if (!user->servername && servername)
-			user->servername = g_strdup (servername);
-		if (!user->account && account && strcmp (account, "0") != 0)
-			user->account = g_strdup (account);
-		if (away != 0xff)
-		{
-			if (user->away != away)
-				do_rehash = TRUE;
-			user->away = away;
-		}
-
-		fe_userlist_update (sess, user);
-		if (do_rehash)
+		if (userlist_merge_info (user, hostname, realname, servername, account, away) & USERINFO_REHASH)
 			fe_userlist_rehash (sess, user);
+		fe_userlist_update (sess, user);
 
 		return 1;
 	}
 	return 0;
 }
 
+/* WHO replies for a channel we sent WHO for are held until RPL_ENDOFWHO,
+   then merged in one go, see userlist_who_apply() */
+
+struct who_reply
+{
+	char *nick;
+	char *hostname;
+	char *realname;
+	char *servername;
+	char *account;
+	unsigned int away;
+};
+
+#define WHO_BATCH_MIN 16	/* fewer changed rows than this are looked up one by one */
+
+static void
+who_reply_free (struct who_reply *reply)
+{
+	g_free (reply->nick);
+	g_free (reply->hostname);
+	g_free (reply->realname);
+	g_free (reply->servername);
+	g_free (reply->account);
+	g_free (reply);
+}
+
+void
+userlist_who_add (session *sess, char *nick, char *hostname, char *realname,
+						char *servername, char *account, unsigned int away)
+{
+	struct who_reply *reply;
+
+	if (!sess->who_pending)
+		sess->who_pending = g_ptr_array_new_with_free_func ((GDestroyNotify) who_reply_free);
+
+	reply = g_new (struct who_reply, 1);
+	reply->nick = g_strdup (nick);
+	reply->hostname = g_strdup (hostname);
+	reply->realname = g_strdup (realname);
+	reply->servername = g_strdup (servername);
+	reply->account = g_strdup (account);
+	reply->away = away;
+	g_ptr_array_add (sess->who_pending, reply);
+}
+
+/* Merge the held WHO replies into the userlist. Only users whose fields
+   changed are touched; if many rows need redrawing they are updated in
+   place as one batch (see userlist_freeze) rather than each searched for
+   in the front end's list. */
+
+void
+userlist_who_apply (session *sess)
+{
+	struct who_reply *reply;
+	struct User *user;
+	GSList *rehash = NULL, *list;
+	guint i, count = 0;
+	int changed;
+
+	if (!sess->who_pending)
+		return;
+
+	for (i = 0; i < sess->who_pending->len; i++)
+	{
+		reply = g_ptr_array_index (sess->who_pending, i);
+		user = userlist_find (sess, reply->nick);
+		if (!user)
+			continue;
+
+		changed = userlist_merge_info (user, reply->hostname, reply->realname,
+												 reply->servername, reply->account, reply->away);
+		if (changed)
+			fe_userlist_update (sess, user);
+		if (changed & USERINFO_REHASH)
+		{
+			rehash = g_slist_prepend (rehash, user);
+			count++;
+		}
+	}
+	userlist_who_discard (sess);
+
+	if (count >= WHO_BATCH_MIN)
+		userlist_freeze (sess);
+	for (list = rehash; list; list = list->next)
+		fe_userlist_rehash (sess, list->data);
+	userlist_thaw (sess);
+	g_slist_free (rehash);
+}
+
+void
+userlist_who_discard (session *sess)
+{
+	if (sess->who_pending)
+	{
+		g_ptr_array_free (sess->who_pending, TRUE);
+		sess->who_pending = NULL;
+	}
+}
+
 static int
 free_user (struct User *user, gpointer data)
 {
@@ -354,6 +472,7 @@ userlist_update_mode (session *sess, char *name, char mode, char sign)
 
 	/* now what is this users highest prefix? e.g. @ for ops */
 	user->prefix[0] = get_nick_prefix (sess->server, user->access);
+	user->rank = get_prefix_rank (sess->server, user->prefix[0]);
 
 	/* update the various counts using the CHANGED prefix only */
 	update_counts (sess, user, prefix, level, offset);
@@ -376,6 +495,7 @@ userlist_change (struct session *sess, char *oldname, char *newname)
 		fe_userlist_remove (sess, user);
 
 		safe_strcpy (user->nick, newname, NICKLEN);
+		user->color = text_color_of (user->nick);
 
 		int row = tree_insert (sess->usertree, user);
 		fe_userlist_insert (sess, user, row, FALSE);
@@ -410,7 +530,8 @@ userlist_remove_user (struct session *sess, struct User *user)
 	if (user->hop)
 		sess->hops--;
 	sess->total--;
-	fe_userlist_numbers (sess);
+	if (!sess->userlist_frozen)
+		fe_userlist_numbers (sess);
 	fe_userlist_remove (sess, user);
 
 	if (user == sess->me)
@@ -439,11 +560,13 @@ userlist_add (struct session *sess, char *name, char *hostname,
 	/* assume first char is the highest level nick prefix */
 	if (prefix_chars)
 		user->prefix[0] = name[0];
+	user->rank = get_prefix_rank (sess->server, user->prefix[0]);
 
 	/* add it to our linked list */
 	if (hostname)
 		user->hostname = g_strdup (hostname);
 	safe_strcpy (user->nick, name + prefix_chars, NICKLEN);
+	user->color = text_color_of (user->nick);
 	/* is it me? */
 	if (!sess->server->p_cmp (user->nick, sess->server->nick))
 		user->me = TRUE;
@@ -483,10 +606,36 @@ userlist_add (struct session *sess, char *name, char *hostname,
 		sess->me = user;
 
 	fe_userlist_insert (sess, user, row, FALSE);
-	if(sess->end_of_names)
+	if(sess->end_of_names && !sess->userlist_frozen)
 		fe_userlist_numbers (sess);
 }
 
+/* While frozen, the front end finds rows through an index built once by
+   fe_userlist_batch_begin() rather than a walk of its list per user, and
+   the user counts are only redrawn by userlist_thaw(). Rows are updated
+   in place, so the user's selection and scroll position survive. Used
+   for bulk changes such as netsplits and large WHO replies. */
+
+void
+userlist_freeze (session *sess)
+{
+	if (sess->userlist_frozen)
+		return;
+	sess->userlist_frozen = TRUE;
+	fe_userlist_batch_begin (sess);
+}
+
+void
+userlist_thaw (session *sess)
+{
+	if (!sess->userlist_frozen)
+		return;
+	sess->userlist_frozen = FALSE;
+
+	fe_userlist_batch_end (sess);
+	fe_userlist_numbers (sess);
+}
+
 static int
 rehash_cb (struct User *user, session *sess)
 {
@@ -500,6 +649,39 @@ userlist_rehash (session *sess)
 	tree_foreach (sess->usertree, (tree_traverse_func *)rehash_cb, sess);
 }
 
+static int
+rerank_cb (struct User *user, session *sess)
+{
+	int rank = get_prefix_rank (sess->server, user->prefix[0]);
+
+	if (user->rank != rank)
+	{
+		user->rank = rank;
+		fe_userlist_rehash (sess, user);
+	}
+	return TRUE;
+}
+
+/* Work out every user's rank again after the server's PREFIX changed,
+   e.g. a 005 that arrives after some channels were already listed. */
+
+void
+userlist_rerank (server *serv)
+{
+	GSList *list;
+	session *sess;
+
+	for (list = sess_list; list; list = list->next)
+	{
+		sess = list->data;
+		if (sess->server != serv || !sess->usertree)
+			continue;
+		userlist_freeze (sess);
+		tree_foreach (sess->usertree, (tree_traverse_func *)rerank_cb, sess);
+		userlist_thaw (sess);
+	}
+}
+
 static int
 flat_cb (struct User *user, GSList **list)
 {
@@ -33,6 +33,8 @@ struct User
 	time_t lasttalk;
 	unsigned int access;	/* axs bit field */
 	char prefix[2]; /* @ + % */
+	unsigned char color;	/* text_color_of (nick), kept with the nick */
+	unsigned char rank;	/* USER_RANK_*, kept with prefix */
 	unsigned int op:1;
 	unsigned int hop:1;
 	unsigned int voice:1;
@@ -46,8 +48,25 @@ struct User
 int userlist_add_hostname (session *sess, char *nick,
 									char *hostname, char *realname,
 									char *servername, char *account, unsigned int away);
+void userlist_who_add (session *sess, char *nick, char *hostname, char *realname,
+							  char *servername, char *account, unsigned int away);
+void userlist_who_apply (session *sess);
+void userlist_who_discard (session *sess);
 void userlist_set_away (session *sess, char *nick, unsigned int away);
 void userlist_set_account (session *sess, char *nick, char *account);
+/* what prefix[0] means, for the frontend's icons */
+enum
+{
+	USER_RANK_NONE,
+	USER_RANK_VOICE,
+	USER_RANK_HALFOP,
+	USER_RANK_OP,
+	USER_RANK_OWNER,		/* 1 level above op */
+	USER_RANK_FOUNDER,	/* 2 levels above op */
+	USER_RANK_NETOP,		/* 3 levels above op */
+	USER_RANK_OTHER		/* unknown, or 4+ levels above op */
+};
+
 struct User *userlist_find (session *sess, const char *name);
 struct User *userlist_find_global (server *serv, char *name);
 void userlist_clear (session *sess);
@@ -61,6 +80,9 @@ void userlist_update_mode (session *sess, char *name, char mode, char sign);
 GSList *userlist_flat_list (session *sess);
 GList *userlist_double_list (session *sess);
 void userlist_rehash (session *sess);
+void userlist_rerank (server *serv);
+void userlist_freeze (session *sess);
+void userlist_thaw (session *sess);
 void userlist_resort (session *sess);
 int nick_cmp (struct User *user1, struct User *user2, server *serv);
 int nick_cmp_az_ops (struct User *user1, struct User *user2, server *serv);
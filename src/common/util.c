@@ -47,6 +47,7 @@
 #include "pchatc.h"
 #include <ctype.h>
 #include "util.h"
+#include "casefold.h"
 
 #if defined (__FreeBSD__) || defined (__APPLE__)
 #include <sys/sysctl.h>
@@ -550,87 +551,249 @@ buf_get_line (char *ibuf, char **buf, int *position, int len)
 	return 1;
 }
 
-int match(const char *mask, const char *string)
+/* match() compiles each mask once: the pattern is split at '*' into
+ * segments, folded through the casemapping's table, and kept in a small
+ * LRU keyed by (mask, casemapping). A match is then a prefix check, a
+ * suffix check and a leftmost search for each middle segment, instead of
+ * re-reading the mask with backtracking on every call. */
+
+#define MASK_CACHE_SIZE 256
+
+typedef struct
+{
+	const char *mask;
+	int casemap;
+} mask_key;
+
+typedef struct
+{
+	int off;						/* into pat/wild */
+	int len;
+	gboolean any;				/* contains '?' */
+} mask_seg;
+
+typedef struct
+{
+	mask_key key;				/* first, so the entry is its own hash key */
+	GList link;					/* position in mask_lru */
+	const unsigned char *fold;
+	gboolean star;				/* at least one '*' */
+	int nseg;
+	int minlen;					/* bytes the segments need between them */
+	mask_seg *segs;
+	guchar *pat;				/* folded segment bytes, back to back */
+	guchar *wild;				/* TRUE where pat is a '?' */
+} compiled_mask;
+
+static GHashTable *mask_cache;
+static GQueue mask_lru = G_QUEUE_INIT;
+G_LOCK_DEFINE_STATIC (mask_cache);
+
+static guint
+mask_key_hash (gconstpointer key)
+{
+	const mask_key *k = key;
+
+	return g_str_hash (k->mask) ^ k->casemap;
+}
+
+static gboolean
+mask_key_equal (gconstpointer a, gconstpointer b)
+{
+	const mask_key *ka = a, *kb = b;
+
+	return ka->casemap == kb->casemap && strcmp (ka->mask, kb->mask) == 0;
+}
+
+static void
+compiled_mask_free (compiled_mask *cm)
+{
+	g_free ((char *) cm->key.mask);
+	g_free (cm->segs);
+	g_free (cm->pat);
+	g_free (cm->wild);
+	g_free (cm);
+}
+
+static compiled_mask *
+mask_compile (const char *mask, int casemap)
+{
+	compiled_mask *cm = g_new0 (compiled_mask, 1);
+	const unsigned char *fold = casemap_table (casemap);
+	gsize masklen = strlen (mask);
+	const char *m = mask;
+	mask_seg *seg;
+	int n = 0;
+
+	cm->key.mask = g_strdup (mask);
+	cm->key.casemap = casemap;
+	cm->fold = fold;
+	cm->pat = g_malloc (masklen + 1);
+	cm->wild = g_malloc (masklen + 1);
+	cm->segs = g_new0 (mask_seg, masklen + 1);	/* at most one per '*', plus one */
+
+	seg = &cm->segs[0];
+	for (;;)
+	{
+		char ch = *m++;
+
+		if (ch == '*' || ch == 0)
+		{
+			cm->minlen += seg->len;
+			cm->nseg++;
+			if (ch == 0)
+				break;
+			cm->star = TRUE;
+			seg = &cm->segs[cm->nseg];
+			seg->off = n;
+			continue;
+		}
+
+		if (ch == '\\' && (*m == '?' || *m == '*'))
+		{
+			cm->pat[n] = *m++;
+			cm->wild[n] = FALSE;
+		}
+		else if (ch == '?')
+		{
+			cm->pat[n] = 0;
+			cm->wild[n] = TRUE;
+			seg->any = TRUE;
+		}
+		else
+		{
+			cm->pat[n] = fold[(unsigned char) ch];
+			cm->wild[n] = FALSE;
+		}
+		n++;
+		seg->len++;
+	}
+
+	return cm;
+}
+
+static inline gboolean
+mask_seg_equal (const compiled_mask *cm, const mask_seg *seg, const unsigned char *s)
+{
+	const guchar *pat = cm->pat + seg->off;
+	int i;
+
+	if (seg->any)
+	{
+		const guchar *wild = cm->wild + seg->off;
+
+		for (i = 0; i < seg->len; i++)
+			if (!wild[i] && cm->fold[s[i]] != pat[i])
+				return FALSE;
+	}
+	else
+	{
+		for (i = 0; i < seg->len; i++)
+			if (cm->fold[s[i]] != pat[i])
+				return FALSE;
+	}
+	return TRUE;
+}
+
+/* leftmost start of seg in s[from..limit), or -1 */
+static int
+mask_seg_find (const compiled_mask *cm, const mask_seg *seg, const unsigned char *s,
+					int from, int limit)
 {
-  const char *m = mask, *s = string;
-  char ch;
-  const char *bm, *bs;
-
-  /* Process the "head" of the mask, if any */
-  while ((ch = *m++) && (ch != '*'))
-    switch (ch)
-    {
-      case '\\':
-	if (*m == '?' || *m == '*')
-	  ch = *m++;
-      default:
-	if (rfc_tolower(*s) != rfc_tolower(ch))
-	  return 0;
-      case '?':
-	if (!*s++)
-	  return 0;
-    };
-  if (!ch)
-    return !(*s);
-
-  /* We got a star: quickly find if/where we match the next char */
-got_star:
-  bm = m;			/* Next try rollback here */
-  while ((ch = *m++))
-    switch (ch)
-    {
-      case '?':
-	if (!*s++)
-	  return 0;
-      case '*':
-	bm = m;
-	continue;		/* while */
-      case '\\':
-	if (*m == '?' || *m == '*')
-	  ch = *m++;
-      default:
-	goto break_while;	/* C is structured ? */
-    };
-break_while:
-  if (!ch)
-    return 1;			/* mask ends with '*', we got it */
-  ch = rfc_tolower(ch);
-  while (rfc_tolower(*s++) != ch)
-    if (!*s)
-      return 0;
-  bs = s;			/* Next try start from here */
-
-  /* Check the rest of the "chunk" */
-  while ((ch = *m++))
-  {
-    switch (ch)
-    {
-      case '*':
-	goto got_star;
-      case '\\':
-	if (*m == '?' || *m == '*')
-	  ch = *m++;
-      default:
-	if (rfc_tolower(*s) != rfc_tolower(ch))
+	int last = limit - seg->len;
+	int i;
+
+	if (seg->len == 0)
+		return from;
+
+	if (cm->wild[seg->off])
+	{
+		for (i = from; i <= last; i++)
+			if (mask_seg_equal (cm, seg, s + i))
+				return i;
+	}
+	else
 	{
-	  if (!*s)
-	    return 0;
-	  m = bm;
-	  s = bs;
-	  goto got_star;
-	};
-      case '?':
-	if (!*s++)
-	  return 0;
-    };
-  };
-  if (*s)
-  {
-    m = bm;
-    s = bs;
-    goto got_star;
-  };
-  return 1;
+		guchar first = cm->pat[seg->off];
+
+		for (i = from; i <= last; i++)
+			if (cm->fold[s[i]] == first && mask_seg_equal (cm, seg, s + i))
+				return i;
+	}
+	return -1;
+}
+
+static int
+mask_run (const compiled_mask *cm, const char *string)
+{
+	const unsigned char *s = (const unsigned char *) string;
+	const mask_seg *first = &cm->segs[0];
+	const mask_seg *last = &cm->segs[cm->nseg - 1];
+	int len = strlen (string);
+	int pos, limit, i;
+
+	if (!cm->star)
+		return len == cm->minlen && mask_seg_equal (cm, first, s);
+
+	if (len < cm->minlen || !mask_seg_equal (cm, first, s))
+		return 0;
+
+	pos = first->len;
+	limit = len - last->len;
+	for (i = 1; i < cm->nseg - 1; i++)
+	{
+		int at = mask_seg_find (cm, &cm->segs[i], s, pos, limit);
+
+		if (at < 0)
+			return 0;
+		pos = at + cm->segs[i].len;
+	}
+
+	return mask_seg_equal (cm, last, s + limit);
+}
+
+int
+match_casemap (const char *mask, const char *string, int casemap)
+{
+	mask_key key = { mask, casemap };
+	compiled_mask *cm;
+	int ret;
+
+	G_LOCK (mask_cache);
+
+	if (!mask_cache)
+		mask_cache = g_hash_table_new (mask_key_hash, mask_key_equal);
+
+	cm = g_hash_table_lookup (mask_cache, &key);
+	if (cm)
+	{
+		g_queue_unlink (&mask_lru, &cm->link);
+	}
+	else
+	{
+		if (mask_lru.length >= MASK_CACHE_SIZE)
+		{
+			compiled_mask *old = g_queue_pop_tail_link (&mask_lru)->data;
+
+			g_hash_table_remove (mask_cache, &old->key);
+			compiled_mask_free (old);
+		}
+		cm = mask_compile (mask, casemap);
+		cm->link.data = cm;
+		g_hash_table_insert (mask_cache, &cm->key, cm);
+	}
+	g_queue_push_head_link (&mask_lru, &cm->link);
+
+	ret = mask_run (cm, string);
+
+	G_UNLOCK (mask_cache);
+	return ret;
+}
+
+int
+match (const char *mask, const char *string)
+{
+	return match_casemap (mask, string, CASEMAP_RFC1459);
 }
 
 void
@@ -1021,38 +1184,13 @@ make_ping_time (void)
 int
 rfc_casecmp (const char *s1, const char *s2)
 {
-	int c1, c2;
-
-	while (*s1 && *s2)
-	{
-		c1 = (int)rfc_tolower (*s1);
-		c2 = (int)rfc_tolower (*s2);
-		if (c1 != c2)
-			return (c1 - c2);
-		s1++;
-		s2++;
-	}
-	return (((int)*s1) - ((int)*s2));
+	return casefold_cmp (s1, s2, CASEMAP_RFC1459);
 }
 
 int
 rfc_ncasecmp (char *s1, char *s2, int n)
 {
-	int c1, c2;
-
-	while (*s1 && *s2 && n > 0)
-	{
-		c1 = (int)rfc_tolower (*s1);
-		c2 = (int)rfc_tolower (*s2);
-		if (c1 != c2)
-			return (c1 - c2);
-		n--;
-		s1++;
-		s2++;
-	}
-	c1 = (int)rfc_tolower (*s1);
-	c2 = (int)rfc_tolower (*s2);
-	return (n == 0) ? 0 : (c1 - c2);
+	return casefold_ncmp (s1, s2, n, CASEMAP_RFC1459);
 }
 
 const unsigned char rfc_tolowertab[] =
@@ -1090,6 +1228,39 @@ const unsigned char rfc_tolowertab[] =
 	0xfa, 0xfb, 0xfc, 0xfd, 0xfe, 0xff
 };
 
+/* CASEMAPPING=strict-rfc1459 leaves ^ and ~ alone; ascii folds A-Z only */
+static unsigned char strict_rfc1459_tolowertab[256];
+static unsigned char ascii_tolowertab[256];
+
+const unsigned char *
+casemap_table (int casemap)
+{
+	static gsize init = 0;
+
+	if (g_once_init_enter (&init))
+	{
+		int i;
+
+		for (i = 0; i < 256; i++)
+		{
+			strict_rfc1459_tolowertab[i] = rfc_tolowertab[i];
+			ascii_tolowertab[i] = g_ascii_tolower (i);
+		}
+		strict_rfc1459_tolowertab['^'] = '^';
+		g_once_init_leave (&init, 1);
+	}
+
+	switch (casemap)
+	{
+	case CASEMAP_STRICT_RFC1459:
+		return strict_rfc1459_tolowertab;
+	case CASEMAP_ASCII:
+		return ascii_tolowertab;
+	default:
+		return rfc_tolowertab;
+	}
+}
+
 static gboolean
 file_exists (char *fname)
 {
@@ -1394,14 +1565,11 @@ str_sha256hash (char *string)
 static char *
 rfc_strlower (const char *str)
 {
-	size_t i, len = strlen(str);
+	size_t len = strlen(str);
 	char *lower = g_new(char, len + 1);
 
-	for (i = 0; i < len; ++i)
-	{
-		lower[i] = rfc_tolower(str[i]);
-	}
-	lower[i] = '\0';
+	casefold_copy (lower, str, len, CASEMAP_RFC1459);
+	lower[len] = '\0';
 
 	return lower;
 }
@@ -1551,3 +1719,167 @@ strftime_utf8 (char *dest, gsize destsize, const char *format, time_t time)
 	g_date_free (date);
 	return result;
 }
+
+/* Timestamp prefixes for the chat view and logs. A busy channel formats
+ * the same second hundreds of times, so results are kept per (format,
+ * second); the locale conversions of the format and result only happen on
+ * a miss. Slots are flushed when the UTC offset seen by localtime changes
+ * (timezone or DST switch), and a different format string simply misses. */
+
+#define STAMP_FORMATS 4
+#define STAMP_SLOTS 8
+#define STAMP_MAX 128
+
+static struct
+{
+	char *utf8;
+	char *locale;
+	guint serial;
+} stamp_formats[STAMP_FORMATS];
+
+static struct
+{
+	guint serial;				/* 0: empty */
+	time_t tim;
+	gsize len;
+	char text[STAMP_MAX];
+} stamp_slots[STAMP_SLOTS];
+
+static guint stamp_serial;
+static guint stamp_next_format, stamp_next_slot;
+static long stamp_utc_offset;
+G_LOCK_DEFINE_STATIC (stamp_cache);
+
+static guint
+stamp_format_serial (const char *fmt)
+{
+	int i;
+
+	for (i = 0; i < STAMP_FORMATS; i++)
+	{
+		if (stamp_formats[i].utf8 && !strcmp (stamp_formats[i].utf8, fmt))
+			return stamp_formats[i].serial;
+	}
+
+	i = stamp_next_format++ % STAMP_FORMATS;
+	g_free (stamp_formats[i].utf8);
+	g_free (stamp_formats[i].locale);
+	stamp_formats[i].utf8 = g_strdup (fmt);
+	/* strftime requires the format string to be in locale encoding. */
+	stamp_formats[i].locale = g_locale_from_utf8 (fmt, -1, NULL, NULL, NULL);
+	stamp_formats[i].serial = ++stamp_serial;
+	return stamp_formats[i].serial;
+}
+
+static const char *
+stamp_format_locale (guint serial)
+{
+	int i;
+
+	for (i = 0; i < STAMP_FORMATS; i++)
+	{
+		if (stamp_formats[i].serial == serial)
+			return stamp_formats[i].locale;
+	}
+	return NULL;
+}
+
+static long
+stamp_offset (const struct tm *local, time_t tim)
+{
+	struct tm utc;
+	int days;
+
+#ifdef WIN32
+	gmtime_s (&utc, &tim);
+#else
+	gmtime_r (&tim, &utc);
+#endif
+	days = local->tm_yday - utc.tm_yday;
+	if (days > 1)
+		days = -1;				/* local is Dec 31st, utc Jan 1st */
+	else if (days < -1)
+		days = 1;
+	return ((days * 24L + local->tm_hour - utc.tm_hour) * 60 + local->tm_min - utc.tm_min) * 60 +
+			 local->tm_sec - utc.tm_sec;
+}
+
+/* Formats tim with the utf-8 strftime format fmt into dest, NUL terminated.
+ * Returns the length, or 0 when there is nothing to show or it won't fit. */
+gsize
+stamp_format (const char *fmt, time_t tim, char *dest, gsize destsize)
+{
+	const char *locale_fmt;
+	char buf[STAMP_MAX];
+	struct tm tm;
+	guint serial;
+	gsize len = 0;
+	long offset;
+	int i;
+
+	G_LOCK (stamp_cache);
+
+	serial = stamp_format_serial (fmt);
+	for (i = 0; i < STAMP_SLOTS; i++)
+	{
+		if (stamp_slots[i].serial == serial && stamp_slots[i].tim == tim)
+		{
+			len = stamp_slots[i].len;
+			goto copy;
+		}
+	}
+
+#ifdef WIN32
+	localtime_s (&tm, &tim);
+#else
+	localtime_r (&tim, &tm);
+#endif
+	offset = stamp_offset (&tm, tim);
+	if (offset != stamp_utc_offset)
+	{
+		for (i = 0; i < STAMP_SLOTS; i++)
+			stamp_slots[i].serial = 0;
+		stamp_utc_offset = offset;
+	}
+
+	locale_fmt = stamp_format_locale (serial);
+	if (locale_fmt)
+		len = strftime_validated (buf, sizeof (buf), locale_fmt, &tm);
+
+	i = stamp_next_slot++ % STAMP_SLOTS;
+	stamp_slots[i].serial = serial;
+	stamp_slots[i].tim = tim;
+	stamp_slots[i].len = 0;
+	if (len)
+	{
+		if (g_get_charset (NULL))
+		{
+			memcpy (stamp_slots[i].text, buf, len);
+		}
+		else
+		{
+			char *utf8;
+			gsize utf8_len = 0;
+
+			utf8 = g_locale_to_utf8 (buf, len, NULL, &utf8_len, NULL);
+			if (utf8 && utf8_len < STAMP_MAX)
+				memcpy (stamp_slots[i].text, utf8, utf8_len);
+			else
+				utf8_len = 0;
+			g_free (utf8);
+			len = utf8_len;
+		}
+		stamp_slots[i].len = len;
+	}
+
+copy:
+	if (len >= destsize)
+		len = 0;
+	else if (len)
+		memcpy (dest, stamp_slots[i].text, len);
+	if (destsize)
+		dest[len] = 0;
+
+	G_UNLOCK (stamp_cache);
+	return len;
+}
@@ -39,9 +39,17 @@
 
 extern const unsigned char rfc_tolowertab[];
 
+/* CASEMAPPING values from RPL_ISUPPORT */
+#define CASEMAP_RFC1459 0
+#define CASEMAP_STRICT_RFC1459 1
+#define CASEMAP_ASCII 2
+
+const unsigned char *casemap_table (int casemap);
+
 char *expand_homedir (char *file);
 void path_part (char *file, char *path, int pathlen);
 int match (const char *mask, const char *string);
+int match_casemap (const char *mask, const char *string, int casemap);
 char *file_part (char *file);
 void for_files (const char *dirname, const char *mask, void callback (char *file));
 int rfc_casecmp (const char *, const char *);
@@ -80,4 +88,5 @@ char *encode_sasl_pass_plain (char *user, char *pass);
 char *challengeauth_response (const char *username, const char *password, const char *challenge);
 size_t strftime_validated (char *dest, size_t destsize, const char *format, const struct tm *time);
 gsize strftime_utf8 (char *dest, gsize destsize, const char *format, time_t time);
+gsize stamp_format (const char *fmt, time_t tim, char *dest, gsize destsize);
 #endif
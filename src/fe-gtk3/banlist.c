@@ -93,9 +93,21 @@ enum
 	MASK_COLUMN,
 	FROM_COLUMN,
 	DATE_COLUMN,
+	TIME_COLUMN,	/* hidden, DATE_COLUMN parsed once for sorting */
 	N_COLUMNS
 };
 
+/* A list entry held back until its end-of-list numeric arrives, so a
+   channel with thousands of masks is inserted in one pass rather than
+   re-sorting and redrawing the view per 367 line. */
+typedef struct banlist_row_s {
+	int mode;
+	char *mask;
+	char *who;
+	char *when;
+	time_t stamp;
+} banlist_row;
+
 static GtkTreeView *
 get_view (struct session *sess)
 {
@@ -203,12 +215,11 @@ yes:
 
 /* fe_add_ban_list() and fe_ban_list_end() return TRUE if consumed, FALSE otherwise */
 gboolean
-fe_add_ban_list (struct session *sess, char *mask, char *who, char *when, int rplcode)
+fe_add_ban_list (struct session *sess, char *mask, char *who, char *when, time_t stamp, int rplcode)
 {
 	banlist_info *banl = sess->res->banlist;
 	int i;
-	GtkListStore *store;
-	GtkTreeIter iter;
+	banlist_row *row;
 
 	if (!banl)
 		return FALSE;
@@ -223,16 +234,73 @@ fe_add_ban_list (struct session *sess, char *mask, char *who, char *when, int rp
 	}
 	if (banl->pending & 1<<i)
 	{
-		store = get_store (sess);
-		gtk_list_store_append (store, &iter);
+		row = g_new (banlist_row, 1);
+		row->mode = i;
+		row->mask = g_strdup (mask);
+		row->who = g_strdup (who);
+		row->when = g_strdup (when);
+		row->stamp = stamp;
+		banl->rows = g_slist_prepend (banl->rows, row);
+		return TRUE;
+	}
+	else return FALSE;
+}
+
+static void
+banlist_row_free (banlist_row *row)
+{
+	g_free (row->mask);
+	g_free (row->who);
+	g_free (row->when);
+	g_free (row);
+}
+
+static void
+banlist_rows_free (banlist_info *banl)
+{
+	g_slist_free_full (banl->rows, (GDestroyNotify) banlist_row_free);
+	banl->rows = NULL;
+}
+
+/* Move the buffered rows into the store with the view detached and
+   sorting switched off, then restore the user's sort order once. */
+static void
+banlist_flush_rows (banlist_info *banl)
+{
+	GtkTreeView *view = get_view (banl->sess);
+	GtkListStore *store = get_store (banl->sess);
+	GtkTreeSortable *sortable = GTK_TREE_SORTABLE (store);
+	GtkSortType order;
+	GSList *list;
+	banlist_row *row;
+	gint sort_id;
+
+	if (!banl->rows)
+		return;
+
+	banl->rows = g_slist_reverse (banl->rows);
 
-		gtk_list_store_set (store, &iter, TYPE_COLUMN, _(modes[i].type), MASK_COLUMN, mask,
-						FROM_COLUMN, who, DATE_COLUMN, when, -1);
+	g_object_ref (store);
+	gtk_tree_view_set_model (view, NULL);
+	if (!gtk_tree_sortable_get_sort_column_id (sortable, &sort_id, &order))
+		sort_id = GTK_TREE_SORTABLE_UNSORTED_SORT_COLUMN_ID;
+	gtk_tree_sortable_set_sort_column_id (sortable,
+							GTK_TREE_SORTABLE_UNSORTED_SORT_COLUMN_ID, GTK_SORT_ASCENDING);
 
+	for (list = banl->rows; list; list = list->next)
+	{
+		row = list->data;
+		gtk_list_store_insert_with_values (store, NULL, -1,
+						TYPE_COLUMN, _(modes[row->mode].type), MASK_COLUMN, row->mask,
+						FROM_COLUMN, row->who, DATE_COLUMN, row->when,
+						TIME_COLUMN, (gint64) row->stamp, -1);
 		banl->line_ct++;
-		return TRUE;
 	}
-	else return FALSE;
+	banlist_rows_free (banl);
+
+	gtk_tree_sortable_set_sort_column_id (sortable, sort_id, order);
+	gtk_tree_view_set_model (view, GTK_TREE_MODEL (store));
+	g_object_unref (store);
 }
 
 /* Sensitize checkboxes and buttons as appropriate for the moment  */
@@ -322,6 +390,7 @@ fe_ban_list_end (struct session *sess, int rplcode)
 		banl->pending &= ~modes[i].bit;
 		if (!banl->pending)
 		{
+			banlist_flush_rows (banl);
 			gtk_widget_set_sensitive (banl->but_refresh, TRUE);
 			banlist_sensitize (banl);
 		}
@@ -442,6 +511,7 @@ banlist_do_refresh (banlist_info *banl)
 
 		store = get_store (sess);
 		gtk_list_store_clear (store);
+		banlist_rows_free (banl);
 		banl->line_ct = 0;
 		banl->pending = banl->checked;
 		if (banl->pending)
@@ -642,64 +712,13 @@ banlist_toggle (GtkWidget *item, gpointer data)
 	}
 }
 
-/* NOTICE:  The official strptime() is not available on all platforms so
- * I've implemented a special version here.  The official version is
- * vastly more general than this:  it uses locales for weekday and month
- * names and its second arg is a format character-string.  This special
- * version depends on the format returned by ctime(3) whose manpage
- * says it returns:
- *     "a null-terminated string of the form "Wed Jun 30 21:49:08 1993\n"
- *
- * If the real strpftime() comes available, use this format string:
- *		#define DATE_FORMAT "%a %b %d %T %Y"
- */
-static void
-banlist_strptime (char *ti, struct tm *tm)
-{
-	/* Expect something like "Sat Mar 16 21:24:27 2013" */
-	static char *mon[] = { "Jan", "Feb", "Mar", "Apr", "May", "Jun",
-								  "Jul", "Aug", "Sep", "Oct", "Nov", "Dec", NULL };
-	int M = -1, d = -1, h = -1, m = -1, s = -1, y = -1;
-
-	if (*ti == 0)
-	{
-		memset (tm, 0, sizeof *tm);
-		return;
-	}
-	/* No need to supply tm->tm_wday; mktime() doesn't read it */
-	ti += 4;
-	while ((mon[++M]))
-		if (strncmp (ti, mon[M], 3) == 0)
-			break;
-	ti += 4;
-
-	d = strtol (ti, &ti, 10);
-	h = strtol (++ti, &ti, 10);
-	m = strtol (++ti, &ti, 10);
-	s = strtol (++ti, &ti, 10);
-	y = strtol (++ti, NULL, 10) - 1900;
-
-	tm->tm_sec = s;
-	tm->tm_min = m;
-	tm->tm_hour = h;
-	tm->tm_mday = d;
-	tm->tm_mon = M;
-	tm->tm_year = y;
-}
-
 gint
 banlist_date_sort (GtkTreeModel *model, GtkTreeIter *a, GtkTreeIter *b, gpointer user_data)
 {
-	struct tm tm1, tm2;
-	time_t t1, t2;
-	char *time1, *time2;
+	gint64 t1, t2;
 
-	gtk_tree_model_get(model, a, DATE_COLUMN, &time1, -1);
-	gtk_tree_model_get(model, b, DATE_COLUMN, &time2, -1);
-	banlist_strptime (time1, &tm1);
-	banlist_strptime (time2, &tm2);
-	t1 = mktime (&tm1);
-	t2 = mktime (&tm2);
+	gtk_tree_model_get (model, a, TIME_COLUMN, &t1, -1);
+	gtk_tree_model_get (model, b, TIME_COLUMN, &t2, -1);
 
 	if (t1 < t2) return 1;
 	if (t1 == t2) return 0;
@@ -716,7 +735,7 @@ banlist_treeview_new (GtkWidget *box, banlist_info *banl)
 	GtkTreeSortable *sortable;
 
 	store = gtk_list_store_new (N_COLUMNS, G_TYPE_STRING, G_TYPE_STRING,
-										 G_TYPE_STRING, G_TYPE_STRING);
+										 G_TYPE_STRING, G_TYPE_STRING, G_TYPE_INT64);
 	g_return_val_if_fail (store != NULL, NULL);
 
 	sortable = GTK_TREE_SORTABLE (store);
@@ -767,6 +786,7 @@ banlist_closegui (GtkWidget *wid, banlist_info *banl)
 
 	if (sess->res->banlist == banl)
 	{
+		banlist_rows_free (banl);
 		g_free (banl);
 		sess->res->banlist = NULL;
 	}
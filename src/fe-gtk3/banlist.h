@@ -56,6 +56,7 @@ typedef struct banlist_info_s {
 	int current;	/* index of currently processing mode */
 	int line_ct;	/* count of presented lines */
 	int select_ct;	/* count of selected lines */
+	GSList *rows;	/* banlist_row entries received but not yet in the store */
 	GtkWidget *window;
 	GtkWidget *treeview;
 	GtkWidget *checkboxes[MODE_CT];
@@ -45,6 +45,7 @@
 #include "gtkutil.h"
 #include "maingui.h"
 #include "menu.h"
+#include "regex-cache.h"
 
 #include "custom-list.h"
 
@@ -78,7 +79,8 @@ chanlist_match (server *serv, const char *str)
 	switch (serv->gui->chanlist_search_type)
 	{
 	case 1:
-		return match (gtk_entry_get_text (GTK_ENTRY (serv->gui->chanlist_wild)), str);
+		return match_casemap (gtk_entry_get_text (GTK_ENTRY (serv->gui->chanlist_wild)), str,
+									 serv->casemapping);
 	case 2:
 		if (!serv->gui->have_regex)
 			return 0;
@@ -398,29 +400,98 @@ fe_chan_list_end (server *serv)
 	custom_list_resort ((CustomList *)GET_MODEL (serv));
 }
 
+#define CHANLIST_FIND_DELAY 300	/* ms of typing pause before searching */
+#define CHANLIST_REGEX_CFLAGS (G_REGEX_CASELESS | G_REGEX_EXTENDED)
+#define CHANLIST_REGEX_MFLAGS (G_REGEX_MATCH_NOTBOL)
+
 static void
-chanlist_search_pressed (GtkButton * button, server *serv)
+chanlist_set_regex (server *serv, GRegex *re)
 {
-	chanlist_build_gui_list (serv);
+	if (serv->gui->have_regex)
+	{
+		serv->gui->have_regex = 0;
+		g_regex_unref (serv->gui->chanlist_match_regex);
+	}
+
+	serv->gui->chanlist_match_regex = re;
+	if (re)
+		serv->gui->have_regex = 1;
 }
 
+/* forget the pending search for text that has since changed */
+
 static void
-chanlist_find_cb (GtkWidget * wid, server *serv)
+chanlist_find_cancel (server *serv)
 {
-	const char *pattern = gtk_entry_get_text (GTK_ENTRY (wid));
+	if (serv->gui->chanlist_find_tag)
+	{
+		g_source_remove (serv->gui->chanlist_find_tag);
+		serv->gui->chanlist_find_tag = 0;
+	}
 
-	/* recompile the regular expression. */
-	if (serv->gui->have_regex)
+	if (serv->gui->chanlist_regex_cancel)
 	{
-		serv->gui->have_regex = 0;
-		g_regex_unref (serv->gui->chanlist_match_regex);
+		g_cancellable_cancel (serv->gui->chanlist_regex_cancel);
+		g_object_unref (serv->gui->chanlist_regex_cancel);
+		serv->gui->chanlist_regex_cancel = NULL;
 	}
+}
+
+static void
+chanlist_regex_ready (GRegex *re, GError *err, server *serv)
+{
+	g_clear_object (&serv->gui->chanlist_regex_cancel);
+	chanlist_set_regex (serv, re ? g_regex_ref (re) : NULL);
 
-	serv->gui->chanlist_match_regex = g_regex_new (pattern, G_REGEX_CASELESS | G_REGEX_EXTENDED,
-												G_REGEX_MATCH_NOTBOL, NULL);
+	if (serv->gui->chanlist_search_type == 2 && serv->gui->chanlist_data_stored_rows)
+		chanlist_build_gui_list (serv);
+}
 
-	if (serv->gui->chanlist_match_regex)
-		serv->gui->have_regex = 1;
+static gboolean
+chanlist_find_timeout (server *serv)
+{
+	serv->gui->chanlist_find_tag = 0;
+
+	/* the regex is kept current for whichever search type gets picked */
+	serv->gui->chanlist_regex_cancel = g_cancellable_new ();
+	regex_cache_compile_async (gtk_entry_get_text (GTK_ENTRY (serv->gui->chanlist_wild)),
+										CHANLIST_REGEX_CFLAGS, CHANLIST_REGEX_MFLAGS,
+										serv->gui->chanlist_regex_cancel,
+										(regex_ready_func) chanlist_regex_ready, serv);
+
+	if (serv->gui->chanlist_search_type != 2 && serv->gui->chanlist_data_stored_rows)
+		chanlist_build_gui_list (serv);
+
+	return G_SOURCE_REMOVE;
+}
+
+/* compile the Find box's regex right away, from the cache if we can */
+
+static void
+chanlist_find_now (server *serv)
+{
+	chanlist_find_cancel (serv);
+	chanlist_set_regex (serv, regex_cache_get (gtk_entry_get_text (GTK_ENTRY (serv->gui->chanlist_wild)),
+															 CHANLIST_REGEX_CFLAGS, CHANLIST_REGEX_MFLAGS,
+															 NULL));
+}
+
+static void
+chanlist_search_pressed (GtkButton * button, server *serv)
+{
+	/* don't search with a regex for older text */
+	if (serv->gui->chanlist_find_tag || serv->gui->chanlist_regex_cancel)
+		chanlist_find_now (serv);
+
+	chanlist_build_gui_list (serv);
+}
+
+static void
+chanlist_find_cb (GtkWidget * wid, server *serv)
+{
+	chanlist_find_cancel (serv);
+	serv->gui->chanlist_find_tag = g_timeout_add (CHANLIST_FIND_DELAY,
+																 (GSourceFunc) chanlist_find_timeout, serv);
 }
 
 static void
@@ -658,11 +729,8 @@ chanlist_destroy_widget (GtkWidget *wid, server *serv)
 		serv->gui->chanlist_tag = 0;
 	}
 
-	if (serv->gui->have_regex)
-	{
-		g_regex_unref (serv->gui->chanlist_match_regex);
-		serv->gui->have_regex = 0;
-	}
+	chanlist_find_cancel (serv);
+	chanlist_set_regex (serv, NULL);
 }
 
 static void
@@ -918,7 +986,7 @@ chanlist_opengui (server *serv, int do_refresh)
 	gtk_widget_show (wid);
 	serv->gui->chanlist_wild = wid;
 
-	chanlist_find_cb (wid, serv);
+	chanlist_find_now (serv);
 
 	/* ============================================================= */
 
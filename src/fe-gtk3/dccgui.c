@@ -85,6 +85,8 @@ struct dccwindow
 
 	GtkWidget *file_label;
 	GtkWidget *address_label;
+
+	GHashTable *rows;	/* struct DCC * -> struct dcc_row */
 };
 
 struct my_dcc_send
@@ -156,108 +158,195 @@ fe_dcc_send_filereq (struct session *sess, char *nick, int maxcps, int passive)
 	gtkutil_file_req (tbuf, dcc_send_filereq_file, mdc, prefs.pchat_dcc_dir, NULL, FRF_MULTIPLE|FRF_FILTERISINITIAL);
 }
 
+/* Each row remembers its iter (list store iters persist) and the text it
+ * last showed, so progress ticks find it without a walk and only touch
+ * the columns that changed. */
+struct dcc_row
+{
+	GtkTreeIter iter;
+	int dccstat;
+	char size[16];
+	char pos[16];
+	char perc[14];
+	char kbs[16];
+	char eta[16];
+};
+
+/* changed columns collected for one gtk_list_store_set_valuesv () */
+struct dcc_row_update
+{
+	gint columns[N_COLUMNS];
+	GValue values[N_COLUMNS];
+	gint n;
+};
+
+/* progress is redrawn at most this often, however many transfers run */
+#define DCC_REFRESH_MS 100
+
+static GHashTable *dcc_dirty;	/* struct DCC * set, waiting for a redraw */
+static guint dcc_refresh_tag;
+
+static struct dcc_row *
+dcc_find_row (struct dccwindow *win, struct DCC *dcc)
+{
+	if (!win->window || !win->rows)
+		return NULL;
+	return g_hash_table_lookup (win->rows, dcc);
+}
+
+static struct dcc_row *
+dcc_new_row (struct dccwindow *win, struct DCC *dcc, GtkTreeIter *iter)
+{
+	struct dcc_row *row;
+
+	if (!win->rows)
+		win->rows = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, g_free);
+
+	row = g_new0 (struct dcc_row, 1);
+	row->iter = *iter;
+	row->dccstat = -1;
+	g_hash_table_replace (win->rows, dcc, row);
+	return row;
+}
+
+static void
+dcc_row_text (struct dcc_row_update *up, int col, char *shown, gsize shown_size,
+				  const char *text)
+{
+	if (!strcmp (shown, text))
+		return;
+
+	g_strlcpy (shown, text, shown_size);
+	g_value_init (&up->values[up->n], G_TYPE_STRING);
+	g_value_set_static_string (&up->values[up->n], shown);
+	up->columns[up->n++] = col;
+}
+
 static void
-dcc_prepare_row_chat (struct DCC *dcc, GtkListStore *store, GtkTreeIter *iter,
+dcc_row_status (struct dcc_row_update *up, struct dcc_row *row, struct DCC *dcc,
+					 int status_col, int color_col)
+{
+	if (row->dccstat == dcc->dccstat)
+		return;
+
+	row->dccstat = dcc->dccstat;
+	g_value_init (&up->values[up->n], G_TYPE_STRING);
+	g_value_set_static_string (&up->values[up->n], _(dccstat[dcc->dccstat].name));
+	up->columns[up->n++] = status_col;
+	g_value_init (&up->values[up->n], GDK_TYPE_RGBA);
+	g_value_set_boxed (&up->values[up->n], dccstat[dcc->dccstat].color == 1 ?
+							 NULL : colors + dccstat[dcc->dccstat].color);
+	up->columns[up->n++] = color_col;
+}
+
+static void
+dcc_row_apply (struct dcc_row_update *up, GtkListStore *store, struct dcc_row *row)
+{
+	int i;
+
+	if (up->n)
+		gtk_list_store_set_valuesv (store, &row->iter, up->columns, up->values, up->n);
+	for (i = 0; i < up->n; i++)
+		g_value_unset (&up->values[i]);
+}
+
+static void
+dcc_prepare_row_chat (struct DCC *dcc, GtkListStore *store, struct dcc_row *row,
 							 gboolean update_only)
 {
-	static char pos[16], siz[16];
+	struct dcc_row_update up;
+	char pos[16], siz[16];
 	char *date;
 
-	date = ctime (&dcc->starttime);
-	date[strlen (date) - 1] = 0;	/* remove the \n */
-
+	memset (&up, 0, sizeof (up));
 	proper_unit (dcc->pos, pos, sizeof (pos));
 	proper_unit (dcc->size, siz, sizeof (siz));
 
-	gtk_list_store_set (store, iter,
-							  CCOL_STATUS, _(dccstat[dcc->dccstat].name),
-							  CCOL_NICK, dcc->nick,
-							  CCOL_RECV, pos,
-							  CCOL_SENT, siz,
-							  CCOL_START, date,
-							  CCOL_DCC, dcc,
-							  CCOL_COLOR,
-							  dccstat[dcc->dccstat].color == 1 ?
-								NULL :
-								colors + dccstat[dcc->dccstat].color,
-							  -1);
+	if (!update_only)
+	{
+		date = ctime (&dcc->starttime);
+		date[strlen (date) - 1] = 0;	/* remove the \n */
+
+		gtk_list_store_set (store, &row->iter,
+								  CCOL_NICK, dcc->nick,
+								  CCOL_START, date,
+								  CCOL_DCC, dcc,
+								  -1);
+	}
+
+	dcc_row_status (&up, row, dcc, CCOL_STATUS, CCOL_COLOR);
+	dcc_row_text (&up, CCOL_RECV, row->pos, sizeof (row->pos), pos);
+	dcc_row_text (&up, CCOL_SENT, row->size, sizeof (row->size), siz);
+	dcc_row_apply (&up, store, row);
 }
 
+/* done: bytes acknowledged (send) or received (recv) */
 static void
-dcc_prepare_row_send (struct DCC *dcc, GtkListStore *store, GtkTreeIter *iter,
-							 gboolean update_only)
+dcc_prepare_row_file (struct DCC *dcc, GtkListStore *store, struct dcc_row *row,
+							 gboolean update_only, GdkPixbuf *pix, guint64 shown_pos,
+							 guint64 done)
 {
-	static char pos[16], size[16], kbs[14], perc[14], eta[14];
+	struct dcc_row_update up;
+	char size[16], pos[16], kbs[16], perc[14], eta[16];
 	int to_go;
 	float per;
 
-	if (!pix_up)
-	{
-		GtkIconTheme *icon_theme = gtk_icon_theme_get_default();
-		/* Add error handling to avoid GTK warnings about scale factor */
-		GError *error = NULL;
-		pix_up = gtk_icon_theme_load_icon(icon_theme, "go-up",
-														16, GTK_ICON_LOOKUP_USE_BUILTIN, &error);
-		if (error)
-		{
-			g_error_free(error);
-			pix_up = NULL;
-		}
-	}
-	/* percentage ack'ed */
-	per = (float) ((dcc->ack * 100.00) / dcc->size);
+	memset (&up, 0, sizeof (up));
 	proper_unit (dcc->size, size, sizeof (size));
-	proper_unit (dcc->pos, pos, sizeof (pos));
+	proper_unit (shown_pos, pos, sizeof (pos));
 	snprintf (kbs, sizeof (kbs), "%.1f", ((float)dcc->cps) / 1024);
-/*	proper_unit (dcc->ack, ack, sizeof (ack));*/
+	per = (float) ((done * 100.00) / dcc->size);
 	snprintf (perc, sizeof (perc), "%.0f%%", per);
 	if (dcc->cps != 0)
 	{
-		to_go = (dcc->size - dcc->ack) / dcc->cps;
+		to_go = (dcc->size - done) / dcc->cps;
 		snprintf (eta, sizeof (eta), "%.2d:%.2d:%.2d",
 					 to_go / 3600, (to_go / 60) % 60, to_go % 60);
 	} else
 		g_strlcpy (eta, "--:--:--", sizeof (eta));
 
-	if (update_only)
-		gtk_list_store_set (store, iter,
-								  COL_STATUS, _(dccstat[dcc->dccstat].name),
-								  COL_POS, pos,
-								  COL_PERC, perc,
-								  COL_SPEED, kbs,
-								  COL_ETA, eta,
-								  COL_COLOR,
-								  dccstat[dcc->dccstat].color == 1 ?
-									NULL :
-									colors + dccstat[dcc->dccstat].color,
-									-1);
-	else
-		gtk_list_store_set (store, iter,
-								  COL_TYPE, pix_up,
-								  COL_STATUS, _(dccstat[dcc->dccstat].name),
+	if (!update_only)
+		gtk_list_store_set (store, &row->iter,
+								  COL_TYPE, pix,
 								  COL_FILE, file_part (dcc->file),
-								  COL_SIZE, size,
-								  COL_POS, pos,
-								  COL_PERC, perc,
-								  COL_SPEED, kbs,
-								  COL_ETA, eta,
 								  COL_NICK, dcc->nick,
 								  COL_DCC, dcc,
-								  COL_COLOR,
-								  dccstat[dcc->dccstat].color == 1 ?
-									NULL :
-									colors + dccstat[dcc->dccstat].color,
-									-1);
+								  -1);
+
+	dcc_row_status (&up, row, dcc, COL_STATUS, COL_COLOR);
+	dcc_row_text (&up, COL_SIZE, row->size, sizeof (row->size), size);
+	dcc_row_text (&up, COL_POS, row->pos, sizeof (row->pos), pos);
+	dcc_row_text (&up, COL_PERC, row->perc, sizeof (row->perc), perc);
+	dcc_row_text (&up, COL_SPEED, row->kbs, sizeof (row->kbs), kbs);
+	dcc_row_text (&up, COL_ETA, row->eta, sizeof (row->eta), eta);
+	dcc_row_apply (&up, store, row);
 }
 
 static void
-dcc_prepare_row_recv (struct DCC *dcc, GtkListStore *store, GtkTreeIter *iter,
+dcc_prepare_row_send (struct DCC *dcc, GtkListStore *store, struct dcc_row *row,
 							 gboolean update_only)
 {
-	static char size[16], pos[16], kbs[16], perc[14], eta[16];
-	float per;
-	int to_go;
+	if (!pix_up)
+	{
+		GtkIconTheme *icon_theme = gtk_icon_theme_get_default();
+		/* Add error handling to avoid GTK warnings about scale factor */
+		GError *error = NULL;
+		pix_up = gtk_icon_theme_load_icon(icon_theme, "go-up",
+														16, GTK_ICON_LOOKUP_USE_BUILTIN, &error);
+		if (error)
+		{
+			g_error_free(error);
+			pix_up = NULL;
+		}
+	}
+	/* percentage ack'ed */
+	dcc_prepare_row_file (dcc, store, row, update_only, pix_up, dcc->pos, dcc->ack);
+}
 
+static void
+dcc_prepare_row_recv (struct DCC *dcc, GtkListStore *store, struct dcc_row *row,
+							 gboolean update_only)
+{
 	if (!pix_dn)
 	{
 		GtkIconTheme *icon_theme = gtk_icon_theme_get_default();
@@ -271,118 +360,79 @@ dcc_prepare_row_recv (struct DCC *dcc, GtkListStore *store, GtkTreeIter *iter,
 			pix_dn = NULL;
 		}
 	}
-	proper_unit (dcc->size, size, sizeof (size));
-	if (dcc->dccstat == STAT_QUEUED)
-		proper_unit (dcc->resumable, pos, sizeof (pos));
-	else
-		proper_unit (dcc->pos, pos, sizeof (pos));
-	snprintf (kbs, sizeof (kbs), "%.1f", ((float)dcc->cps) / 1024);
 	/* percentage recv'ed */
-	per = (float) ((dcc->pos * 100.00) / dcc->size);
-	snprintf (perc, sizeof (perc), "%.0f%%", per);
-	if (dcc->cps != 0)
-	{
-		to_go = (dcc->size - dcc->pos) / dcc->cps;
-		snprintf (eta, sizeof (eta), "%.2d:%.2d:%.2d",
-					 to_go / 3600, (to_go / 60) % 60, to_go % 60);
-	} else
-		g_strlcpy (eta, "--:--:--", sizeof (eta));
-
-	if (update_only)
-		gtk_list_store_set (store, iter,
-								  COL_STATUS, _(dccstat[dcc->dccstat].name),
-								  COL_POS, pos,
-								  COL_PERC, perc,
-								  COL_SPEED, kbs,
-								  COL_ETA, eta,
-								  COL_COLOR,
-								  dccstat[dcc->dccstat].color == 1 ?
-									NULL :
-									colors + dccstat[dcc->dccstat].color,
-									-1);
-	else
-		gtk_list_store_set (store, iter,
-								  COL_TYPE, pix_dn,
-								  COL_STATUS, _(dccstat[dcc->dccstat].name),
-								  COL_FILE, file_part (dcc->file),
-								  COL_SIZE, size,
-								  COL_POS, pos,
-								  COL_PERC, perc,
-								  COL_SPEED, kbs,
-								  COL_ETA, eta,
-								  COL_NICK, dcc->nick,
-								  COL_DCC, dcc,
-								  COL_COLOR,
-								  dccstat[dcc->dccstat].color == 1 ?
-									NULL :
-									colors + dccstat[dcc->dccstat].color,
-									-1);
+	dcc_prepare_row_file (dcc, store, row, update_only, pix_dn,
+								 dcc->dccstat == STAT_QUEUED ? dcc->resumable : dcc->pos,
+								 dcc->pos);
 }
 
-static gboolean
-dcc_find_row (struct DCC *find_dcc, GtkTreeModel *model, GtkTreeIter *iter, int col)
+static void
+dcc_update_row (struct DCC *dcc, struct dcc_row *row)
 {
-	struct DCC *dcc;
-
-	if (gtk_tree_model_get_iter_first (model, iter))
+	switch (dcc->type)
 	{
-		do
-		{
-			gtk_tree_model_get (model, iter, col, &dcc, -1);
-			if (dcc == find_dcc)
-				return TRUE;
-		}
-		while (gtk_tree_model_iter_next (model, iter));
+	case TYPE_SEND:
+		dcc_prepare_row_send (dcc, dccfwin.store, row, TRUE);
+		break;
+	case TYPE_RECV:
+		dcc_prepare_row_recv (dcc, dccfwin.store, row, TRUE);
+		break;
+	default:
+		dcc_prepare_row_chat (dcc, dcccwin.store, row, TRUE);
 	}
-
-	return FALSE;
 }
 
-static void
-dcc_update_recv (struct DCC *dcc)
+static struct dccwindow *
+dcc_window_for (struct DCC *dcc)
 {
-	GtkTreeIter iter;
-
-	if (!dccfwin.window)
-		return;
-
-	if (!dcc_find_row (dcc, GTK_TREE_MODEL (dccfwin.store), &iter, COL_DCC))
-		return;
-
-	dcc_prepare_row_recv (dcc, dccfwin.store, &iter, TRUE);
+	if (dcc->type == TYPE_SEND || dcc->type == TYPE_RECV)
+		return &dccfwin;
+	return &dcccwin;
 }
 
-static void
-dcc_update_chat (struct DCC *dcc)
+static gboolean
+dcc_refresh_cb (gpointer unused)
 {
-	GtkTreeIter iter;
-
-	if (!dcccwin.window)
-		return;
+	GHashTableIter it;
+	struct DCC *dcc;
+	struct dcc_row *row;
 
-	if (!dcc_find_row (dcc, GTK_TREE_MODEL (dcccwin.store), &iter, CCOL_DCC))
-		return;
+	g_hash_table_iter_init (&it, dcc_dirty);
+	while (g_hash_table_iter_next (&it, (gpointer *) &dcc, NULL))
+	{
+		row = dcc_find_row (dcc_window_for (dcc), dcc);
+		if (row)
+			dcc_update_row (dcc, row);
+	}
+	g_hash_table_remove_all (dcc_dirty);
 
-	dcc_prepare_row_chat (dcc, dcccwin.store, &iter, TRUE);
+	dcc_refresh_tag = 0;
+	return G_SOURCE_REMOVE;
 }
 
+/* drops a window's rows when its store is cleared or goes away */
 static void
-dcc_update_send (struct DCC *dcc)
+dcc_forget_rows (struct dccwindow *win)
 {
-	GtkTreeIter iter;
-
-	if (!dccfwin.window)
-		return;
+	GHashTableIter it;
+	struct DCC *dcc;
 
-	if (!dcc_find_row (dcc, GTK_TREE_MODEL (dccfwin.store), &iter, COL_DCC))
+	if (!win->rows)
 		return;
 
-	dcc_prepare_row_send (dcc, dccfwin.store, &iter, TRUE);
+	if (dcc_dirty)
+	{
+		g_hash_table_iter_init (&it, win->rows);
+		while (g_hash_table_iter_next (&it, (gpointer *) &dcc, NULL))
+			g_hash_table_remove (dcc_dirty, dcc);
+	}
+	g_hash_table_remove_all (win->rows);
 }
 
 static void
 close_dcc_file_window (GtkWindow *win, gpointer data)
 {
+	dcc_forget_rows (&dccfwin);
 	dccfwin.window = NULL;
 }
 
@@ -390,16 +440,18 @@ static void
 dcc_append (struct DCC *dcc, GtkListStore *store, gboolean prepend)
 {
 	GtkTreeIter iter;
+	struct dcc_row *row;
 
 	if (prepend)
 		gtk_list_store_prepend (store, &iter);
 	else
 		gtk_list_store_append (store, &iter);
 
+	row = dcc_new_row (&dccfwin, dcc, &iter);
 	if (dcc->type == TYPE_RECV)
-		dcc_prepare_row_recv (dcc, store, &iter, FALSE);
+		dcc_prepare_row_recv (dcc, store, row, FALSE);
 	else
-		dcc_prepare_row_send (dcc, store, &iter, FALSE);
+		dcc_prepare_row_send (dcc, store, row, FALSE);
 }
 
 /* Returns aborted and completed transfers. */
@@ -454,6 +506,7 @@ dcc_fill_window (int flags)
 	GtkTreeIter iter;
 	int i = 0;
 
+	dcc_forget_rows (&dccfwin);
 	gtk_list_store_clear (GTK_LIST_STORE (dccfwin.store));
 
 	if (flags & VIEW_UPLOAD)
@@ -978,6 +1031,7 @@ abort_chat_clicked (GtkWidget * wid, gpointer none)
 static void
 dcc_chat_close_cb (void)
 {
+	dcc_forget_rows (&dcccwin);
 	dcccwin.window = NULL;
 }
 
@@ -985,13 +1039,15 @@ static void
 dcc_chat_append (struct DCC *dcc, GtkListStore *store, gboolean prepend)
 {
 	GtkTreeIter iter;
+	struct dcc_row *row;
 
 	if (prepend)
 		gtk_list_store_prepend (store, &iter);
 	else
 		gtk_list_store_append (store, &iter);
 
-	dcc_prepare_row_chat (dcc, store, &iter, FALSE);
+	row = dcc_new_row (&dcccwin, dcc, &iter);
+	dcc_prepare_row_chat (dcc, store, row, FALSE);
 }
 
 static void
@@ -1002,6 +1058,7 @@ dcc_chat_fill_win (void)
 	GtkTreeIter iter;
 	int i = 0;
 
+	dcc_forget_rows (&dcccwin);
 	gtk_list_store_clear (GTK_LIST_STORE (dcccwin.store));
 
 	list = dcc_list;
@@ -1143,49 +1200,48 @@ fe_dcc_add (struct DCC *dcc)
 	}
 }
 
+/* State changes show at once; progress ticks are coalesced and drawn by
+ * dcc_refresh_cb at DCC_REFRESH_MS. */
 void
 fe_dcc_update (struct DCC *dcc)
 {
-	switch (dcc->type)
-	{
-	case TYPE_SEND:
-		dcc_update_send (dcc);
-		break;
+	struct dccwindow *win = dcc_window_for (dcc);
+	struct dcc_row *row;
 
-	case TYPE_RECV:
-		dcc_update_recv (dcc);
-		break;
+	row = dcc_find_row (win, dcc);
+	if (!row)
+		return;
 
-	default:
-		dcc_update_chat (dcc);
+	if (row->dccstat != dcc->dccstat)
+	{
+		if (dcc_dirty)
+			g_hash_table_remove (dcc_dirty, dcc);
+		dcc_update_row (dcc, row);
+		if (win == &dccfwin)
+			update_clear_button_sensitivity ();
+		return;
 	}
 
-	if (dccfwin.window)
-		update_clear_button_sensitivity();
+	if (!dcc_dirty)
+		dcc_dirty = g_hash_table_new (g_direct_hash, g_direct_equal);
+	g_hash_table_add (dcc_dirty, dcc);
+	if (!dcc_refresh_tag)
+		dcc_refresh_tag = g_timeout_add (DCC_REFRESH_MS, dcc_refresh_cb, NULL);
 }
 
 void
 fe_dcc_remove (struct DCC *dcc)
 {
-	GtkTreeIter iter;
+	struct dccwindow *win = dcc_window_for (dcc);
+	struct dcc_row *row;
 
-	switch (dcc->type)
-	{
-	case TYPE_SEND:
-	case TYPE_RECV:
-		if (dccfwin.window)
-		{
-			if (dcc_find_row (dcc, GTK_TREE_MODEL (dccfwin.store), &iter, COL_DCC))
-				gtk_list_store_remove (dccfwin.store, &iter);
-		}
-		break;
+	if (dcc_dirty)
+		g_hash_table_remove (dcc_dirty, dcc);
 
-	default:	/* chat */
-		if (dcccwin.window)
-		{
-			if (dcc_find_row (dcc, GTK_TREE_MODEL (dcccwin.store), &iter, CCOL_DCC))
-				gtk_list_store_remove (dcccwin.store, &iter);
-		}
-		break;
+	row = dcc_find_row (win, dcc);
+	if (row)
+	{
+		gtk_list_store_remove (win->store, &row->iter);
+		g_hash_table_remove (win->rows, dcc);
 	}
 }
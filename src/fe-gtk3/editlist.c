@@ -97,6 +97,7 @@ editlist_save (GtkWidget *igad, gchar *file)
 		{
 			list_free (&popup_list);
 			list_loadconf (file, &popup_list, 0);
+			menu_invalidate ();
 		} else if (editlist_list == button_list)
 		{
 			GSList *list = sess_list;
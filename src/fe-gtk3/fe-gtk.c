@@ -721,6 +721,45 @@ fe_text_clear (struct session *sess, int lines)
 	pchat_textview_chat_clear (chat, lines);
 }
 
+void
+fe_text_history_begin (struct session *sess)
+{
+	pchat_chat_buffer_begin_prepend (sess->res->buffer);
+}
+
+void
+fe_text_history_end (struct session *sess)
+{
+	pchat_chat_buffer_end_prepend (sess->res->buffer,
+											 PCHAT_TEXTVIEW_CHAT (sess->gui->textview));
+}
+
+/* one line of an older page, between fe_text_history_begin/end; other
+   lines printed meanwhile still go to the bottom */
+void
+fe_print_history (struct session *sess, char *text, time_t stamp)
+{
+	PchatChatBuffer *buf = sess->res->buffer;
+
+	buf->prepending = TRUE;
+	PrintTextRaw (buf, text, prefs.pchat_text_indent, stamp);
+	buf->prepending = FALSE;
+}
+
+void
+fe_text_batch_begin (struct session *sess)
+{
+	pchat_chat_buffer_begin_batch (sess->res->buffer,
+											 PCHAT_TEXTVIEW_CHAT (sess->gui->textview));
+}
+
+void
+fe_text_batch_end (struct session *sess)
+{
+	pchat_chat_buffer_end_batch (sess->res->buffer,
+										  PCHAT_TEXTVIEW_CHAT (sess->gui->textview));
+}
+
 void
 fe_close_window (struct session *sess)
 {
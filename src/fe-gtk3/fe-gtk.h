@@ -88,6 +88,8 @@ struct server_gui
 
 	GRegex *chanlist_match_regex;	/* compiled regular expression here */
 	unsigned int have_regex;
+	GCancellable *chanlist_regex_cancel;	/* set while a compile is in flight */
+	guint chanlist_find_tag;		/* debounce for typing in the Find box */
 
 	guint chanlist_users_found_count;	/* users total for all channels */
 	guint chanlist_users_shown_count;	/* users total for displayed channels */
@@ -112,6 +114,7 @@ typedef struct restore_gui
 
 	/* information stored when this tab isn't front-most */
 	void *user_model;	/* for filling the GtkTreeView */
+	GHashTable *user_rows;	/* User -> GtkTreeIter during fe_userlist_batch_begin/end */
 	void *buffer;		/* PchatChatBuffer */
 	char *input_text;	/* input text buffer (while not-front tab) */
 	char *topic_text;	/* topic GtkEntry buffer */
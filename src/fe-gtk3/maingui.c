@@ -40,6 +40,7 @@
 #include "../common/util.h"
 #include "../common/text.h"
 #include "../common/chanopt.h"
+#include "../common/chathistory.h"
 #include "../common/cfgfiles.h"
 #include "../common/debug-log.h"
 
@@ -424,7 +425,7 @@ fe_set_title (session *sess)
 			snprintf (tbuf, sizeof (tbuf),
 						 DISPLAY_NAME": %s @ %s / %s (%s)",
 						 sess->server->nick, server_get_network (sess->server, TRUE),
-						 sess->channel, sess->current_modes ? sess->current_modes : "");
+						 sess->channel, chan_modes_get (sess) ? chan_modes_get (sess) : "");
 		}
 		else
 		{
@@ -1048,6 +1049,7 @@ mg_topdestroy_cb (GtkWidget *win, session *sess)
 	/* kill the text buffer */
 	pchat_chat_buffer_free (sess->res->buffer);
 	/* kill the user list */
+	g_clear_pointer (&sess->res->user_rows, g_hash_table_destroy);
 	g_object_unref (G_OBJECT (sess->res->user_model));
 
 	session_free (sess);	/* tell xchat.c about it */
@@ -1071,6 +1073,7 @@ mg_ircdestroy (session *sess)
 	/* kill the text buffer */
 	pchat_chat_buffer_free (sess->res->buffer);
 	/* kill the user list */
+	g_clear_pointer (&sess->res->user_rows, g_hash_table_destroy);
 	g_object_unref (G_OBJECT (sess->res->user_model));
 
 	session_free (sess);	/* tell xchat.c about it */
@@ -2420,6 +2423,36 @@ mg_update_xtext (GtkWidget *wid)
 	pchat_textview_chat_set_font (chat, prefs.pchat_text_font);
 }
 
+/* scrolled to the very top of a buffer: page in older chathistory */
+
+static void
+mg_textview_scrolled_cb (GtkAdjustment *adj, session_gui *gui)
+{
+	session *sess = NULL;
+	GSList *list;
+
+	if (gtk_adjustment_get_value (adj) > gtk_adjustment_get_lower (adj) ||
+		 gtk_adjustment_get_upper (adj) <= gtk_adjustment_get_page_size (adj))
+		return;
+
+	if (gui->is_tab)
+		sess = current_tab;
+	else
+	{
+		for (list = sess_list; list; list = list->next)
+		{
+			if (((session *) list->data)->gui == gui)
+			{
+				sess = list->data;
+				break;
+			}
+		}
+	}
+
+	if (sess && sess->gui == gui)
+		chathistory_request_before (sess);
+}
+
 static void
 mg_create_textarea (session *sess, GtkWidget *box)
 {
@@ -2448,6 +2481,8 @@ mg_create_textarea (session *sess, GtkWidget *box)
 	gtk_widget_set_margin_top (scrolledwindow, 0);
 	gtk_widget_set_margin_bottom (scrolledwindow, 0);
 	gtk_box_pack_start (GTK_BOX (box), scrolledwindow, TRUE, TRUE, 0);
+	g_signal_connect (gtk_scrolled_window_get_vadjustment (GTK_SCROLLED_WINDOW (scrolledwindow)),
+							"value-changed", G_CALLBACK (mg_textview_scrolled_cb), gui);
 
 	gui->textview = pchat_textview_chat_new ();
 	pchat_textview_chat_set_max_auto_indent (PCHAT_TEXTVIEW_CHAT (gui->textview), prefs.pchat_text_max_indent);
@@ -71,6 +71,15 @@
 
 static GSList *submenu_list;
 
+/* The nick popup is built once per configuration generation against these
+   placeholder targets; the nick they stand for is filled in on each popup. */
+static char nick_popup_target[] = "";
+static char nick_plugin_target[] = "";
+static char *nick_popup_nick = NULL;
+static char *nick_plugin_nick = NULL;
+static GSList *nick_notify_items = NULL;	/* "Add to notify" entries */
+static GSList *nick_toggle_items = NULL;	/* TOGGLE entries from popup.conf */
+
 enum
 {
 	M_MENUITEM,
@@ -235,6 +244,10 @@ popup_menu_cb (GtkWidget * item, char *cmd)
 
 	/* the userdata is set in menu_quick_item() */
 	nick = g_object_get_data (G_OBJECT (item), "u");
+	if (nick == nick_popup_target)
+		nick = nick_popup_nick;
+	else if (nick == nick_plugin_target)
+		nick = nick_plugin_nick;
 
 	if (!nick)	/* userlist popup menu */
 	{
@@ -491,9 +504,16 @@ menu_create (GtkWidget *menu, GSList *list, char *target, int check_path)
 
 		} else if (!g_ascii_strncasecmp (pop->name, "TOGGLE", 6))
 		{
+			GtkWidget *item;
+
 			childcount++;
-			menu_toggle_item (pop->name + 7, tempmenu, toggle_cb, pop->cmd,
+			item = menu_toggle_item (pop->name + 7, tempmenu, toggle_cb, pop->cmd,
 									cfg_get_bool (pop->cmd));
+			if (target == nick_popup_target)
+			{
+				g_object_set_data (G_OBJECT (item), "cfg", pop->cmd);
+				nick_toggle_items = g_slist_prepend (nick_toggle_items, item);
+			}
 
 		} else if (!g_ascii_strncasecmp (pop->name, "ENDSUB", 6))
 		{
@@ -513,12 +533,16 @@ menu_create (GtkWidget *menu, GSList *list, char *target, int check_path)
 		} else
 		{
 			char *icon, *label;
+			int notify_item = FALSE;
 
 			/* default command in xchat.c */
 			if (pop->cmd[0] == 'n' && !strcmp (pop->cmd, "notify -n ASK %s"))
 			{
+				/* the cached nick menu hides it per popup instead */
+				if (target == nick_popup_target)
+					notify_item = TRUE;
 				/* don't create this item if already in notify list */
-				if (!target || notify_is_in_list (current_sess->server, target))
+				else if (!target || notify_is_in_list (current_sess->server, target))
 				{
 					list = list->next;
 					continue;
@@ -529,7 +553,9 @@ menu_create (GtkWidget *menu, GSList *list, char *target, int check_path)
 
 			if (!check_path || pop->cmd[0] != '!')
 			{
-				menu_quick_item (pop->cmd, label, tempmenu, 0, target, icon);
+				GtkWidget *item = menu_quick_item (pop->cmd, label, tempmenu, 0, target, icon);
+				if (notify_item)
+					nick_notify_items = g_slist_prepend (nick_notify_items, item);
 			/* check if the program is in path, if not, leave it out! */
 			} else if (is_in_path (pop->cmd))
 			{
@@ -550,7 +576,21 @@ menu_create (GtkWidget *menu, GSList *list, char *target, int check_path)
 }
 
 static char *str_copy = NULL;		/* for all pop-up menus */
+static char *nick_copy = NULL;		/* nick the cached nick menu is showing */
+static GtkWidget *nick_menu = NULL;	/* cached nick menu */
 static GtkWidget *nick_submenu = NULL;	/* user info submenu */
+static GtkWidget *nick_info_item, *nick_info_sep;
+static GtkWidget *nick_count_item, *nick_count_sep;
+static guint nick_menu_gen = 0;		/* menu_gen the nick menu was built for */
+static guint menu_gen = 1;
+
+/* popup.conf or a /MENU entry changed, rebuild cached menus on next use */
+
+void
+menu_invalidate (void)
+{
+	menu_gen++;
+}
 
 static void
 menu_destroy (GtkWidget *menu, gpointer objtounref)
@@ -559,7 +599,6 @@ menu_destroy (GtkWidget *menu, gpointer objtounref)
 	g_object_unref (menu);
 	if (objtounref)
 		g_object_unref (G_OBJECT (objtounref));
-	nick_submenu = NULL;
 }
 
 static void
@@ -585,7 +624,7 @@ menu_nickinfo_cb (GtkWidget *menu, session *sess)
 		return;
 
 	/* issue a /WHOIS */
-	snprintf (buf, sizeof (buf), "WHOIS %s %s", str_copy, str_copy);
+	snprintf (buf, sizeof (buf), "WHOIS %s %s", nick_copy, nick_copy);
 	handle_command (sess, buf, FALSE);
 	/* and hide the output */
 	sess->server->skip_next_whois = 1;
@@ -688,20 +727,16 @@ menu_create_nickinfo_menu (struct User *user, GtkWidget *submenu)
 	return missing;
 }
 
-void
-fe_userlist_update (session *sess, struct User *user)
+/* replace the user info submenu items, returns boolean: Some data is missing */
+
+static gboolean
+menu_nickinfo_refill (struct User *user)
 {
 	GList *items, *next;
 
-	if (!nick_submenu || !str_copy)
-		return;
-
-	/* not the same nick as the menu? */
-	if (sess->server->p_cmp (user->nick, str_copy))
-		return;
-
 	/* get rid of the "show" signal */
-	g_signal_handlers_disconnect_by_func (nick_submenu, menu_nickinfo_cb, sess);
+	g_signal_handlers_disconnect_matched (nick_submenu, G_SIGNAL_MATCH_FUNC,
+													  0, 0, NULL, menu_nickinfo_cb, NULL);
 
 	/* destroy all the old items */
 	items = gtk_container_get_children (GTK_CONTAINER (nick_submenu));
@@ -713,59 +748,116 @@ fe_userlist_update (session *sess, struct User *user)
 	}
 
 	/* and re-create them with new info */
-	menu_create_nickinfo_menu (user, nick_submenu);
+	return menu_create_nickinfo_menu (user, nick_submenu);
+}
+
+void
+fe_userlist_update (session *sess, struct User *user)
+{
+	/* only while the nick menu is actually up */
+	if (!nick_menu || !nick_copy || !gtk_widget_get_visible (nick_menu))
+		return;
+
+	/* not the same nick as the menu? */
+	if (sess->server->p_cmp (user->nick, nick_copy))
+		return;
+
+	menu_nickinfo_refill (user);
+}
+
+/* build the parts of the nick menu that don't depend on the target */
+
+static void
+menu_nickmenu_build (void)
+{
+	if (nick_menu)
+	{
+		gtk_widget_destroy (nick_menu);
+		g_object_unref (nick_menu);
+	}
+	g_slist_free (nick_notify_items);
+	nick_notify_items = NULL;
+	g_slist_free (nick_toggle_items);
+	nick_toggle_items = NULL;
+
+	nick_menu = gtk_menu_new ();
+	g_object_ref_sink (nick_menu);
+
+	submenu_list = 0;	/* first time through, might not be 0 */
+
+	nick_count_item = menu_quick_item (0, "", nick_menu, 0, 0, 0);
+	nick_count_sep = menu_quick_item (0, 0, nick_menu, XCMENU_SHADED, 0, 0);
+	nick_submenu = menu_quick_sub ("", nick_menu, &nick_info_item, XCMENU_DOLIST, -1);
+	menu_quick_endsub ();
+	nick_info_sep = menu_quick_item (0, 0, nick_menu, XCMENU_SHADED, 0, 0);
+
+	menu_create (nick_menu, popup_list, nick_popup_target, FALSE);
+	menu_add_plugin_items (nick_menu, "\x5$NICK", nick_plugin_target);
+
+	nick_menu_gen = menu_gen;
 }
 
 void
 menu_nickmenu (session *sess, GdkEventButton *event, char *nick, int num_sel)
 {
 	char buf[512];
-	struct User *user;
-	GtkWidget *submenu, *menu = gtk_menu_new ();
+	struct User *user = NULL;
+	GSList *list;
+	char *cfg;
 
-	if (str_copy)
-		g_free (str_copy);
-	str_copy = g_strdup (nick);
+	g_free (nick_copy);
+	nick_copy = g_strdup (nick);
 
-	submenu_list = 0;	/* first time through, might not be 0 */
+	if (!nick_menu || nick_menu_gen != menu_gen)
+		menu_nickmenu_build ();
+
+	/* targets for the popup.conf and plugin entries */
+	nick_popup_nick = (num_sel > 1) ? NULL : nick_copy;
+	nick_plugin_nick = (num_sel == 0) ? nick_copy : NULL;	/* xtext click */
 
 	/* more than 1 nick selected? */
 	if (num_sel > 1)
 	{
 		snprintf (buf, sizeof (buf), _("%d nicks selected."), num_sel);
-		menu_quick_item (0, buf, menu, 0, 0, 0);
-		menu_quick_item (0, 0, menu, XCMENU_SHADED, 0, 0);
+		gtk_menu_item_set_label (GTK_MENU_ITEM (nick_count_item), buf);
 	} else
 	{
 		user = userlist_find (sess, nick);	/* lasttalk is channel specific */
 		if (!user)
 			user = userlist_find_global (current_sess->server, nick);
-		if (user)
-		{
-			nick_submenu = submenu = menu_quick_sub (nick, menu, NULL, XCMENU_DOLIST, -1);
-
-			if (menu_create_nickinfo_menu (user, submenu) ||
-				 !user->hostname || !user->realname || !user->servername)
-			{
-				g_signal_connect (G_OBJECT (submenu), "show", G_CALLBACK (menu_nickinfo_cb), sess);
-			}
+	}
+	gtk_widget_set_visible (nick_count_item, num_sel > 1);
+	gtk_widget_set_visible (nick_count_sep, num_sel > 1);
+	gtk_widget_set_visible (nick_info_item, user != NULL);
+	gtk_widget_set_visible (nick_info_sep, user != NULL);
 
-			menu_quick_endsub ();
-			menu_quick_item (0, 0, menu, XCMENU_SHADED, 0, 0);
+	if (user)
+	{
+		gtk_menu_item_set_label (GTK_MENU_ITEM (nick_info_item), nick);
+		if (menu_nickinfo_refill (user) ||
+			 !user->hostname || !user->realname || !user->servername)
+		{
+			g_signal_connect (G_OBJECT (nick_submenu), "show", G_CALLBACK (menu_nickinfo_cb), sess);
 		}
 	}
 
-	if (num_sel > 1)
-		menu_create (menu, popup_list, NULL, FALSE);
-	else
-		menu_create (menu, popup_list, str_copy, FALSE);
+	/* don't offer to add a nick that's already in the notify list */
+	for (list = nick_notify_items; list; list = list->next)
+		gtk_widget_set_visible (list->data, nick_popup_nick &&
+										!notify_is_in_list (current_sess->server, nick_popup_nick));
 
-	if (num_sel == 0)	/* xtext click */
-		menu_add_plugin_items (menu, "\x5$NICK", str_copy);
-	else	/* userlist treeview click */
-		menu_add_plugin_items (menu, "\x5$NICK", NULL);
+	/* settings may have changed since the last popup */
+	for (list = nick_toggle_items; list; list = list->next)
+	{
+		cfg = g_object_get_data (G_OBJECT (list->data), "cfg");
+		g_signal_handlers_block_by_func (list->data, toggle_cb, cfg);
+		gtk_check_menu_item_set_active (list->data, cfg_get_bool (cfg));
+		g_signal_handlers_unblock_by_func (list->data, toggle_cb, cfg);
+	}
 
-	menu_popup (menu, event, NULL);
+	if (event && event->window)
+		gtk_menu_set_screen (GTK_MENU (nick_menu), gdk_window_get_screen (event->window));
+	gtk_menu_popup_at_pointer (GTK_MENU (nick_menu), (GdkEvent*)event);
 }
 
 /* stuff for the View menu */
@@ -2174,6 +2266,7 @@ fe_menu_add (menu_entry *me)
 {
 	char *text;
 
+	menu_invalidate ();
 	menu_foreach_gui (me, menu_add_cb);
 
 	if (!me->markup)
@@ -2189,12 +2282,14 @@ fe_menu_add (menu_entry *me)
 void
 fe_menu_del (menu_entry *me)
 {
+	menu_invalidate ();
 	menu_foreach_gui (me, menu_del_cb);
 }
 
 void
 fe_menu_update (menu_entry *me)
 {
+	menu_invalidate ();
 	menu_foreach_gui (me, menu_update_cb);
 }
 
@@ -90,18 +90,230 @@ show_notification (const char *title, const char *text)
 	g_free (stripped_text);
 }
 
+/* Alerts are not shown immediately: they are queued per channel (or per
+ * nick for private messages) and flushed after a short coalescing window,
+ * so a burst of messages to the same target becomes one summary.  A token
+ * bucket caps how many notifications reach the desktop in total. */
+#define NOTIFY_COALESCE_MS	1000	/* window in which alerts are grouped */
+#define NOTIFY_RATE_BURST	5		/* notifications allowed back to back */
+#define NOTIFY_RATE_REFILL_MS	2000	/* one more token every 2 seconds */
+#define NOTIFY_MAX_GROUPS	16		/* distinct pending groups before overflow */
+
+typedef enum
+{
+	ALERT_HILIGHT,
+	ALERT_CHANNEL,
+	ALERT_PRIVATE,
+	ALERT_OVERFLOW
+} alert_kind;
+
+typedef struct
+{
+	char *key;
+	alert_kind kind;
+	char *nick;			/* last sender */
+	char *where;		/* channel or network, may be NULL */
+	char *text;			/* last message */
+	int count;
+	unsigned int many_nicks:1;	/* more than one sender in this group */
+} pending_alert;
+
+static GHashTable *pending_hash;	/* key -> pending_alert */
+static GQueue pending_queue = G_QUEUE_INIT;	/* pending_alert, oldest first */
+static guint flush_tag;
+static int rate_tokens = NOTIFY_RATE_BURST;
+static gint64 rate_last_refill;
+
+static void
+pending_alert_free (pending_alert *alert)
+{
+	g_free (alert->key);
+	g_free (alert->nick);
+	g_free (alert->where);
+	g_free (alert->text);
+	g_free (alert);
+}
+
+static gboolean
+rate_take_token (void)
+{
+	gint64 now = g_get_monotonic_time ();
+	gint64 refill = (gint64) NOTIFY_RATE_REFILL_MS * 1000;
+
+	if (rate_last_refill == 0)
+		rate_last_refill = now;
+
+	if (now - rate_last_refill >= refill)
+	{
+		gint64 gained = (now - rate_last_refill) / refill;
+
+		rate_tokens = MIN (NOTIFY_RATE_BURST, rate_tokens + (int) MIN (gained, NOTIFY_RATE_BURST));
+		rate_last_refill += gained * refill;
+	}
+
+	if (rate_tokens <= 0)
+		return FALSE;
+
+	rate_tokens--;
+	return TRUE;
+}
+
 static void
-show_notificationf (const char *text, const char *format, ...)
+show_pending_alert (pending_alert *alert)
 {
-	va_list args;
-	char *buf;
+	char *title;
+	char *text;
 
-	va_start (args, format);
-	buf = g_strdup_vprintf (format, args);
-	va_end (args);
+	if (alert->count == 1)
+	{
+		switch (alert->kind)
+		{
+		case ALERT_HILIGHT:
+			title = g_strdup_printf (_("Highlighted message from: %s (%s)"), alert->nick, alert->where);
+			break;
+		case ALERT_CHANNEL:
+			title = g_strdup_printf (_("Channel message from: %s (%s)"), alert->nick, alert->where);
+			break;
+		case ALERT_PRIVATE:
+			if (alert->where)
+				title = g_strdup_printf (_("Private message from: %s (%s)"), alert->nick, alert->where);
+			else
+				title = g_strdup_printf (_("Private message from: %s"), alert->nick);
+			break;
+		default:
+			title = g_strdup (_("New message"));
+			break;
+		}
+		show_notification (title, alert->text);
+		g_free (title);
+		return;
+	}
 
-	show_notification (buf, text);
-	g_free (buf);
+	switch (alert->kind)
+	{
+	case ALERT_HILIGHT:
+		title = g_strdup_printf (_("%d highlighted messages (%s)"), alert->count, alert->where);
+		break;
+	case ALERT_CHANNEL:
+		title = g_strdup_printf (_("%d channel messages (%s)"), alert->count, alert->where);
+		break;
+	case ALERT_PRIVATE:
+		if (alert->where)
+			title = g_strdup_printf (_("%d private messages from: %s (%s)"), alert->count, alert->nick, alert->where);
+		else
+			title = g_strdup_printf (_("%d private messages from: %s"), alert->count, alert->nick);
+		break;
+	default:
+		title = g_strdup_printf (_("%d more messages"), alert->count);
+		break;
+	}
+
+	if (alert->kind == ALERT_OVERFLOW)
+		text = g_strdup (_("Too many alerts at once, some were grouped together."));
+	else if (alert->many_nicks)
+		text = g_strdup_printf (_("%s and others: %s"), alert->nick, alert->text);
+	else
+		text = g_strdup_printf ("%s: %s", alert->nick, alert->text);
+
+	show_notification (title, text);
+	g_free (title);
+	g_free (text);
+}
+
+static gboolean
+flush_pending_cb (gpointer userdata)
+{
+	pending_alert *alert;
+
+	while ((alert = g_queue_peek_head (&pending_queue)) != NULL)
+	{
+		if (!rate_take_token ())
+			return G_SOURCE_CONTINUE;	/* try again once the bucket refills */
+
+		g_queue_pop_head (&pending_queue);
+		g_hash_table_remove (pending_hash, alert->key);
+		show_pending_alert (alert);
+		pending_alert_free (alert);
+	}
+
+	flush_tag = 0;
+	return G_SOURCE_REMOVE;
+}
+
+static void
+queue_alert (alert_kind kind, const char *nick, const char *where, const char *text)
+{
+	pending_alert *alert;
+	char *key;
+	int serv_id = 0;
+
+	if (!pending_hash)
+		pending_hash = g_hash_table_new (g_str_hash, g_str_equal);
+
+	/* Channel alerts group per channel, private ones per sender. The
+	   server id keeps same-named channels on two networks apart. */
+	pchat_get_prefs (ph, "id", NULL, &serv_id);
+	if (kind == ALERT_PRIVATE)
+		key = g_strdup_printf ("%d/%d/%s/%s", kind, serv_id, where ? where : "", nick);
+	else
+		key = g_strdup_printf ("%d/%d/%s", kind, serv_id, where ? where : "");
+
+	alert = g_hash_table_lookup (pending_hash, key);
+	if (!alert && g_hash_table_size (pending_hash) >= NOTIFY_MAX_GROUPS)
+	{
+		g_free (key);
+		key = g_strdup ("overflow");
+		kind = ALERT_OVERFLOW;
+		alert = g_hash_table_lookup (pending_hash, key);
+	}
+
+	if (alert)
+	{
+		g_free (key);
+		if (g_strcmp0 (alert->nick, nick) != 0)
+			alert->many_nicks = TRUE;
+		g_free (alert->nick);
+		g_free (alert->text);
+		alert->nick = g_strdup (nick);
+		alert->text = g_strdup (text);
+		alert->count++;
+	}
+	else
+	{
+		alert = g_new0 (pending_alert, 1);
+		alert->key = key;
+		alert->kind = kind;
+		alert->nick = g_strdup (nick);
+		alert->where = g_strdup (where);
+		alert->text = g_strdup (text);
+		alert->count = 1;
+		g_hash_table_insert (pending_hash, alert->key, alert);
+		g_queue_push_tail (&pending_queue, alert);
+	}
+
+	if (!flush_tag)
+		flush_tag = g_timeout_add (NOTIFY_COALESCE_MS, flush_pending_cb, NULL);
+}
+
+static void
+clear_pending_alerts (void)
+{
+	pending_alert *alert;
+
+	if (flush_tag)
+	{
+		g_source_remove (flush_tag);
+		flush_tag = 0;
+	}
+
+	while ((alert = g_queue_pop_head (&pending_queue)) != NULL)
+		pending_alert_free (alert);
+
+	if (pending_hash)
+	{
+		g_hash_table_destroy (pending_hash);
+		pending_hash = NULL;
+	}
 }
 
 static int
@@ -109,8 +321,7 @@ incoming_hilight_cb (char *word[], void *userdata)
 {
 	if (prefs.pchat_input_balloon_hilight && should_alert() && !is_ignored(word[1]))
 	{
-		show_notificationf (word[2], _("Highlighted message from: %s (%s)"), 
-		                    word[1], pchat_get_info (ph, "channel"));
+		queue_alert (ALERT_HILIGHT, word[1], pchat_get_info (ph, "channel"), word[2]);
 	}
 	return PCHAT_EAT_NONE;
 }
@@ -120,8 +331,7 @@ incoming_message_cb (char *word[], void *userdata)
 {
 	if (prefs.pchat_input_balloon_chans && should_alert())
 	{
-		show_notificationf (word[2], _("Channel message from: %s (%s)"), 
-		                    word[1], pchat_get_info (ph, "channel"));
+		queue_alert (ALERT_CHANNEL, word[1], pchat_get_info (ph, "channel"), word[2]);
 	}
 	return PCHAT_EAT_NONE;
 }
@@ -131,11 +341,7 @@ incoming_priv_cb (char *word[], void *userdata)
 {
 	if (prefs.pchat_input_balloon_priv && should_alert() && !is_ignored(word[1]))
 	{
-		const char *network = pchat_get_info (ph, "network");
-		if (network)
-			show_notificationf (word[2], _("Private message from: %s (%s)"), word[1], network);
-		else
-			show_notificationf (word[2], _("Private message from: %s"), word[1]);
+		queue_alert (ALERT_PRIVATE, word[1], pchat_get_info (ph, "network"), word[2]);
 	}
 	return PCHAT_EAT_NONE;
 }
@@ -199,5 +405,6 @@ notification_plugin_init (pchat_plugin *plugin_handle, char **plugin_name,
 void
 notification_plugin_deinit (void)
 {
+	clear_pending_alerts ();
 	notification_backend_deinit ();
 }
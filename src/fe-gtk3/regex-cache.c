@@ -0,0 +1,188 @@
+/* PChat
+ * Copyright (C) 2026 PChat-IRC contributors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <string.h>
+
+#include "regex-cache.h"
+
+#define REGEX_CACHE_MAX 8
+
+struct regex_entry
+{
+	char *pattern;
+	GRegexCompileFlags cflags;
+	GRegexMatchFlags mflags;
+	GRegex *re;
+};
+
+struct regex_job
+{
+	char *pattern;
+	GRegexCompileFlags cflags;
+	GRegexMatchFlags mflags;
+	GCancellable *cancel;
+	regex_ready_func ready;
+	gpointer data;
+	GRegex *re;
+	GError *err;
+};
+
+/* most recently used first; the worker thread fills it too */
+static GQueue regex_lru = G_QUEUE_INIT;
+G_LOCK_DEFINE_STATIC (regex_lru);
+
+static GThreadPool *regex_pool;
+
+static void
+regex_entry_free (struct regex_entry *entry)
+{
+	g_free (entry->pattern);
+	g_regex_unref (entry->re);
+	g_free (entry);
+}
+
+/* returns a new reference, or NULL if it isn't cached. Call locked. */
+
+static GRegex *
+regex_lru_find (const char *pattern, GRegexCompileFlags cflags, GRegexMatchFlags mflags)
+{
+	struct regex_entry *entry;
+	GList *link;
+
+	for (link = regex_lru.head; link; link = link->next)
+	{
+		entry = link->data;
+		if (entry->cflags == cflags && entry->mflags == mflags &&
+			 !strcmp (entry->pattern, pattern))
+		{
+			g_queue_unlink (&regex_lru, link);
+			g_queue_push_head_link (&regex_lru, link);
+			return g_regex_ref (entry->re);
+		}
+	}
+
+	return NULL;
+}
+
+/* compile pattern (with G_REGEX_OPTIMIZE) or take it from the cache,
+   returns a reference the caller must g_regex_unref() */
+
+GRegex *
+regex_cache_get (const char *pattern, GRegexCompileFlags cflags,
+					  GRegexMatchFlags mflags, GError **err)
+{
+	struct regex_entry *entry;
+	GRegex *re, *cached;
+
+	G_LOCK (regex_lru);
+	re = regex_lru_find (pattern, cflags, mflags);
+	G_UNLOCK (regex_lru);
+	if (re)
+		return re;
+
+	/* compile outside the lock, patterns can be slow to optimize */
+	re = g_regex_new (pattern, cflags | G_REGEX_OPTIMIZE, mflags, err);
+	if (!re)
+		return NULL;	/* errors aren't cached */
+
+	G_LOCK (regex_lru);
+	/* someone else may have compiled it meanwhile */
+	cached = regex_lru_find (pattern, cflags, mflags);
+	if (cached)
+	{
+		G_UNLOCK (regex_lru);
+		g_regex_unref (re);
+		return cached;
+	}
+
+	entry = g_new (struct regex_entry, 1);
+	entry->pattern = g_strdup (pattern);
+	entry->cflags = cflags;
+	entry->mflags = mflags;
+	entry->re = g_regex_ref (re);
+	g_queue_push_head (&regex_lru, entry);
+
+	while (regex_lru.length > REGEX_CACHE_MAX)
+		regex_entry_free (g_queue_pop_tail (&regex_lru));
+	G_UNLOCK (regex_lru);
+
+	return re;
+}
+
+static void
+regex_job_free (struct regex_job *job)
+{
+	g_free (job->pattern);
+	if (job->cancel)
+		g_object_unref (job->cancel);
+	if (job->re)
+		g_regex_unref (job->re);
+	if (job->err)
+		g_error_free (job->err);
+	g_free (job);
+}
+
+static gboolean
+regex_job_done (gpointer data)
+{
+	struct regex_job *job = data;
+
+	/* the input changed (or its window went away) while we compiled */
+	if (!job->cancel || !g_cancellable_is_cancelled (job->cancel))
+		job->ready (job->re, job->err, job->data);
+
+	regex_job_free (job);
+	return G_SOURCE_REMOVE;
+}
+
+static void
+regex_job_run (gpointer data, gpointer user_data)
+{
+	struct regex_job *job = data;
+
+	/* jobs superseded while still queued aren't worth compiling */
+	if (!job->cancel || !g_cancellable_is_cancelled (job->cancel))
+		job->re = regex_cache_get (job->pattern, job->cflags, job->mflags, &job->err);
+
+	g_idle_add (regex_job_done, job);
+}
+
+/* Compile on a worker thread and call ready from the main loop, unless
+   cancel was cancelled first. Jobs run one at a time, so a burst of
+   stale requests is skipped rather than compiled. */
+
+void
+regex_cache_compile_async (const char *pattern, GRegexCompileFlags cflags,
+									GRegexMatchFlags mflags, GCancellable *cancel,
+									regex_ready_func ready, gpointer data)
+{
+	struct regex_job *job;
+
+	job = g_new0 (struct regex_job, 1);
+	job->pattern = g_strdup (pattern);
+	job->cflags = cflags;
+	job->mflags = mflags;
+	job->cancel = cancel ? g_object_ref (cancel) : NULL;
+	job->ready = ready;
+	job->data = data;
+
+	if (!regex_pool)
+		regex_pool = g_thread_pool_new (regex_job_run, NULL, 1, FALSE, NULL);
+
+	g_thread_pool_push (regex_pool, job, NULL);
+}
@@ -0,0 +1,38 @@
+/* PChat
+ * Copyright (C) 2026 PChat-IRC contributors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/* Shared GRegex compilation for search boxes: compiled patterns are kept
+ * in a small LRU so retyping or re-running a search doesn't recompile,
+ * and regex_cache_compile_async() moves the compile off the UI thread. */
+
+#ifndef PCHAT_REGEX_CACHE_H
+#define PCHAT_REGEX_CACHE_H
+
+#include <gio/gio.h>
+
+/* re is NULL and err set if the pattern didn't compile. Both are freed
+   after the callback returns, g_regex_ref() re to keep it. */
+typedef void (*regex_ready_func) (GRegex *re, GError *err, gpointer data);
+
+GRegex *regex_cache_get (const char *pattern, GRegexCompileFlags cflags,
+								 GRegexMatchFlags mflags, GError **err);
+void regex_cache_compile_async (const char *pattern, GRegexCompileFlags cflags,
+										  GRegexMatchFlags mflags, GCancellable *cancel,
+										  regex_ready_func ready, gpointer data);
+
+#endif
@@ -570,6 +570,7 @@ servlist_move_item (GtkTreeView *view, GSList *list, gpointer item, int delta)
 		{
 			list = g_slist_remove (list, item);
 			list = g_slist_insert (list, item, pos);
+			servlist_index_invalidate ();
 
 			gtk_list_store_swap (GTK_LIST_STORE (store), &iter1, &iter2);
 		}
@@ -625,6 +626,7 @@ static void
 servlist_sort (GtkWidget *button, gpointer none)
 {
 	network_list=g_slist_sort(network_list,(GCompareFunc)servlist_compare);
+	servlist_index_invalidate ();
 	servlist_networks_populate (networks_tree, network_list);
 }
 
@@ -1207,6 +1209,7 @@ servlist_celledit_cb (GtkCellRendererText *cell, gchar *arg1, gchar *arg2,
 
 		netname = net->name;
 		net->name = g_strdup (arg2);
+		servlist_index_invalidate ();
 		gtk_list_store_set (GTK_LIST_STORE (model), &iter, 0, net->name, -1);
 		g_free (netname);
 	}
@@ -1390,6 +1393,7 @@ servlist_editserver_cb (GtkCellRendererText *cell, gchar *name, gchar *newval, g
 
 		servname = serv->hostname;
 		serv->hostname = servlist_sanitize_hostname (newval);
+		servlist_index_invalidate ();
 		gtk_list_store_set (GTK_LIST_STORE (model), &iter, 0, serv->hostname, -1);
 		g_free (servname);
 	}
@@ -14,8 +14,10 @@
 #include "textview-chat.h"
 #include "palette.h"
 #include "css-helpers.h"
+#include "regex-cache.h"
 #include "../common/pchat.h"
 #include "../common/util.h"
+#include "../common/trace.h"
 
 /* IRC color/format codes */
 #define IRC_BOLD        '\002'
@@ -765,9 +767,10 @@ flush_text_with_formatting (GtkTextBuffer *buffer, GtkTextIter *iter, GString *t
 
 /* Parse IRC color codes and apply formatting */
 static void
-pchat_textview_chat_append_with_formatting (PchatTextViewChat *chat, GtkTextBuffer *buffer, const gchar *text, gsize len)
+pchat_textview_chat_append_with_formatting (PchatTextViewChat *chat, PchatChatBuffer *buf, const gchar *text, gsize len)
 {
 	PchatTextViewChatPrivate *priv = chat->priv;
+	GtkTextBuffer *buffer = buf->buffer;
 	GtkTextIter iter;
 	const gchar *p = text;
 	const gchar *end = text + len;
@@ -775,8 +778,12 @@ pchat_textview_chat_append_with_formatting (PchatTextViewChat *chat, GtkTextBuff
 	gint fg_color = -1, bg_color = -1;
 	gboolean bold = FALSE, italic = FALSE, underline = FALSE;
 	gboolean strikethrough = FALSE, hidden = FALSE, reverse = FALSE;
+	gint64 span = trace_begin ();
 	
-	gtk_text_buffer_get_end_iter (buffer, &iter);
+	if (buf->prepend_mark && buf->prepending)
+		gtk_text_buffer_get_iter_at_mark (buffer, &iter, buf->prepend_mark);
+	else
+		gtk_text_buffer_get_end_iter (buffer, &iter);
 	
 	while (p < end)
 	{
@@ -893,6 +900,7 @@ pchat_textview_chat_append_with_formatting (PchatTextViewChat *chat, GtkTextBuff
 	/* Flush any remaining text */
 	flush_text_with_formatting (buffer, &iter, current_text, priv, GTK_WIDGET (chat), bold, italic, underline, strikethrough, hidden, reverse, fg_color, bg_color);
 	g_string_free (current_text, TRUE);
+	trace_end ("pchat_textview_chat_append", span);
 }
 
 /* Trim oldest lines from a buffer to enforce priv->max_lines. Cheap when no
@@ -903,7 +911,8 @@ prune_buffer_to_max_lines (PchatTextViewChatPrivate *priv, PchatChatBuffer *buf)
 	gint excess;
 	GtkTextIter start, end;
 
-	if (priv->max_lines <= 0 || buf->line_count <= priv->max_lines)
+	/* trimming from the top would throw away the history being paged in */
+	if (priv->max_lines <= 0 || buf->line_count <= priv->max_lines || buf->prepend_mark)
 		return;
 
 	excess = buf->line_count - priv->max_lines;
@@ -933,7 +942,7 @@ pchat_textview_chat_append (PchatTextViewChat *chat, const gchar *text, gsize le
 	/* Check if we're at bottom BEFORE appending text */
 	was_at_bottom = is_scrolled_to_bottom (GTK_TEXT_VIEW (chat));
 
-	pchat_textview_chat_append_with_formatting (chat, buf->buffer, text, len);
+	pchat_textview_chat_append_with_formatting (chat, buf, text, len);
 	buf->line_count++;
 	prune_buffer_to_max_lines (priv, buf);
 
@@ -954,6 +963,25 @@ pchat_chat_buffer_append (PchatChatBuffer *buf, PchatTextViewChat *chat,
 	if (len == 0)
 		len = strlen (text);
 
+	if (buf->prepend_mark && buf->prepending)
+	{
+		/* paging in history: no further back than max_lines, and the
+		 * view stays where it is */
+		if (chat->priv->max_lines > 0 && buf->line_count >= chat->priv->max_lines)
+			return;
+		pchat_textview_chat_append_with_formatting (chat, buf, text, len);
+		buf->line_count++;
+		return;
+	}
+
+	if (buf->batch_depth > 0)
+	{
+		/* scroll position and trimming are dealt with once, at end_batch */
+		pchat_textview_chat_append_with_formatting (chat, buf, text, len);
+		buf->line_count++;
+		return;
+	}
+
 	/* Check if this is the currently displayed buffer */
 	is_current_buffer = (buf == chat->priv->current_buffer);
 
@@ -961,7 +989,7 @@ pchat_chat_buffer_append (PchatChatBuffer *buf, PchatTextViewChat *chat,
 	if (is_current_buffer)
 		was_at_bottom = is_scrolled_to_bottom (GTK_TEXT_VIEW (chat));
 
-	pchat_textview_chat_append_with_formatting (chat, buf->buffer, text, len);
+	pchat_textview_chat_append_with_formatting (chat, buf, text, len);
 	buf->line_count++;
 	prune_buffer_to_max_lines (chat->priv, buf);
 
@@ -970,43 +998,67 @@ pchat_chat_buffer_append (PchatChatBuffer *buf, PchatTextViewChat *chat,
 		pchat_textview_chat_request_scroll (chat, TRUE);
 }
 
-void
-pchat_textview_chat_append_with_stamp (PchatTextViewChat *chat, PchatChatBuffer *buf,
-                                        const gchar *text, gsize len, time_t stamp)
+/* One display line: timestamp, left text (plus a space when indenting),
+ * right text and the newline. Short lines, which is nearly all of them,
+ * are put together on the stack. */
+#define CHAT_STAMP_MAX 32
+
+static void
+chat_buffer_append_line (PchatChatBuffer *buf, PchatTextViewChat *chat,
+                         const gchar *left_text, gsize left_len,
+                         const gchar *right_text, gsize right_len,
+                         time_t stamp)
 {
-	GString *full_text;
+	gchar stack_line[1024];
+	gchar *line = stack_line;
+	gsize need, pos = 0;
 
-	g_return_if_fail (PCHAT_IS_TEXTVIEW_CHAT (chat));
+	if (!left_text)
+		left_len = 0;
+	if (!right_text)
+		right_len = 0;
 
-	if (!buf)
-		return;
-
-	/* Pre-size: text + a bit for timestamp + newline. */
-	full_text = g_string_sized_new ((text ? len : 0) + 32);
+	need = CHAT_STAMP_MAX + left_len + 1 + right_len + 1;
+	if (need > sizeof (stack_line))
+		line = g_malloc (need);
 
 	/* Add timestamp if enabled */
 	if (chat->priv->show_timestamps && stamp != 0)
+		pos = stamp_format ("%H:%M:%S ", stamp, line, CHAT_STAMP_MAX);
+
+	/* Add left text */
+	if (left_len > 0)
 	{
-		struct tm tm_buf;
-#ifdef _WIN32
-		localtime_s (&tm_buf, &stamp);
-#else
-		localtime_r (&stamp, &tm_buf);
-#endif
-		gchar time_str[32];
-		gsize n = strftime (time_str, sizeof (time_str), "%H:%M:%S ", &tm_buf);
-		if (n)
-			g_string_append_len (full_text, time_str, n);
+		memcpy (line + pos, left_text, left_len);
+		pos += left_len;
+		if (chat->priv->indent)
+			line[pos++] = ' ';
 	}
 
-	/* Add text */
-	if (text && len > 0)
-		g_string_append_len (full_text, text, len);
+	/* Add right text */
+	if (right_len > 0)
+	{
+		memcpy (line + pos, right_text, right_len);
+		pos += right_len;
+	}
 
-	g_string_append_c (full_text, '\n');
+	line[pos++] = '\n';
 
-	pchat_chat_buffer_append (buf, chat, full_text->str, full_text->len);
-	g_string_free (full_text, TRUE);
+	pchat_chat_buffer_append (buf, chat, line, pos);
+	if (line != stack_line)
+		g_free (line);
+}
+
+void
+pchat_textview_chat_append_with_stamp (PchatTextViewChat *chat, PchatChatBuffer *buf,
+                                        const gchar *text, gsize len, time_t stamp)
+{
+	g_return_if_fail (PCHAT_IS_TEXTVIEW_CHAT (chat));
+
+	if (!buf)
+		return;
+
+	chat_buffer_append_line (buf, chat, NULL, 0, text, len, stamp);
 }
 
 void
@@ -1015,46 +1067,12 @@ pchat_textview_chat_append_indent (PchatTextViewChat *chat, PchatChatBuffer *buf
                                     const gchar *right_text, gsize right_len,
                                     time_t stamp)
 {
-	GString *full_text;
-
 	g_return_if_fail (PCHAT_IS_TEXTVIEW_CHAT (chat));
 
 	if (!buf)
 		return;
 
-	full_text = g_string_sized_new (left_len + right_len + 32);
-
-	/* Add timestamp if enabled */
-	if (chat->priv->show_timestamps && stamp != 0)
-	{
-		struct tm tm_buf;
-#ifdef _WIN32
-		localtime_s (&tm_buf, &stamp);
-#else
-		localtime_r (&stamp, &tm_buf);
-#endif
-		gchar time_str[32];
-		gsize n = strftime (time_str, sizeof (time_str), "%H:%M:%S ", &tm_buf);
-		if (n)
-			g_string_append_len (full_text, time_str, n);
-	}
-
-	/* Add left text */
-	if (left_text && left_len > 0)
-	{
-		g_string_append_len (full_text, left_text, left_len);
-		if (chat->priv->indent)
-			g_string_append_c (full_text, ' ');
-	}
-
-	/* Add right text */
-	if (right_text && right_len > 0)
-		g_string_append_len (full_text, right_text, right_len);
-
-	g_string_append_c (full_text, '\n');
-
-	pchat_chat_buffer_append (buf, chat, full_text->str, full_text->len);
-	g_string_free (full_text, TRUE);
+	chat_buffer_append_line (buf, chat, left_text, left_len, right_text, right_len, stamp);
 }
 
 void
@@ -1063,44 +1081,67 @@ pchat_chat_buffer_append_indent (PchatChatBuffer *buf, PchatTextViewChat *chat,
                                   const gchar *right_text, gsize right_len,
                                   time_t stamp)
 {
-	GString *full_text;
-
 	if (!buf || !chat)
 		return;
 
-	full_text = g_string_sized_new (left_len + right_len + 32);
+	chat_buffer_append_line (buf, chat, left_text, left_len, right_text, right_len, stamp);
+}
 
-	/* Add timestamp if enabled */
-	if (chat->priv->show_timestamps && stamp != 0)
-	{
-		struct tm tm_buf;
-#ifdef _WIN32
-		localtime_s (&tm_buf, &stamp);
-#else
-		localtime_r (&stamp, &tm_buf);
-#endif
-		gchar time_str[32];
-		gsize n = strftime (time_str, sizeof (time_str), "%H:%M:%S ", &tm_buf);
-		if (n)
-			g_string_append_len (full_text, time_str, n);
-	}
+/* History paging: between begin and end, lines appended with
+ * buf->prepending set go above the existing text, in the order they are
+ * appended. Other lines are appended at the bottom as usual. */
+void
+pchat_chat_buffer_begin_prepend (PchatChatBuffer *buf)
+{
+	GtkTextIter iter;
 
-	/* Add left text */
-	if (left_text && left_len > 0)
-	{
-		g_string_append_len (full_text, left_text, left_len);
-		if (chat->priv->indent)
-			g_string_append_c (full_text, ' ');
-	}
+	if (!buf || buf->prepend_mark)
+		return;
 
-	/* Add right text */
-	if (right_text && right_len > 0)
-		g_string_append_len (full_text, right_text, right_len);
+	/* Right gravity: the mark moves past each inserted line, so the next
+	 * one lands after it, and it finishes on the old first line. */
+	gtk_text_buffer_get_start_iter (buf->buffer, &iter);
+	buf->prepend_mark = gtk_text_buffer_create_mark (buf->buffer, NULL, &iter, FALSE);
+}
+
+void
+pchat_chat_buffer_end_prepend (PchatChatBuffer *buf, PchatTextViewChat *chat)
+{
+	if (!buf || !buf->prepend_mark)
+		return;
 
-	g_string_append_c (full_text, '\n');
+	/* keep the line the user was looking at on screen */
+	if (chat && chat->priv->current_buffer == buf)
+		gtk_text_view_scroll_to_mark (GTK_TEXT_VIEW (chat), buf->prepend_mark,
+		                              0.0, TRUE, 0.0, 0.0);
 
-	pchat_chat_buffer_append (buf, chat, full_text->str, full_text->len);
-	g_string_free (full_text, TRUE);
+	gtk_text_buffer_delete_mark (buf->buffer, buf->prepend_mark);
+	buf->prepend_mark = NULL;
+}
+
+/* A burst of appends (e.g. a paste being echoed): the scroll position is
+ * checked before the first line and the buffer trimmed after the last,
+ * instead of once per line. */
+void
+pchat_chat_buffer_begin_batch (PchatChatBuffer *buf, PchatTextViewChat *chat)
+{
+	if (!buf || !chat || buf->batch_depth++ > 0)
+		return;
+
+	buf->batch_at_bottom = buf == chat->priv->current_buffer &&
+	                       is_scrolled_to_bottom (GTK_TEXT_VIEW (chat));
+}
+
+void
+pchat_chat_buffer_end_batch (PchatChatBuffer *buf, PchatTextViewChat *chat)
+{
+	if (!buf || !chat || buf->batch_depth == 0 || --buf->batch_depth > 0)
+		return;
+
+	prune_buffer_to_max_lines (chat->priv, buf);
+
+	if (buf->batch_at_bottom && buf == chat->priv->current_buffer)
+		pchat_textview_chat_request_scroll (chat, TRUE);
 }
 
 void
@@ -1579,7 +1620,8 @@ pchat_chat_buffer_set_search_regex (PchatChatBuffer *buf, const gchar *pattern,
 	if (!case_sensitive)
 		flags |= G_REGEX_CASELESS;
 	
-	buf->search_re = g_regex_new (pattern, flags, 0, error);
+	/* repeated /lastlog -r runs reuse the compiled pattern */
+	buf->search_re = regex_cache_get (pattern, flags, 0, error);
 	if (buf->search_re)
 		buf->search_text = g_strdup (pattern);
 }
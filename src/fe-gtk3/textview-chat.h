@@ -42,7 +42,11 @@ struct _PchatChatBuffer
 	GtkTextBuffer *buffer;
 	GtkTextMark *end_mark;
 	GtkTextMark *marker_mark;  /* Marker line position */
+	GtkTextMark *prepend_mark; /* Where history paging inserts lines */
+	gboolean prepending;        /* The line being appended goes to prepend_mark */
 	gint line_count;
+	gint batch_depth;           /* > 0 between begin_batch/end_batch */
+	gboolean batch_at_bottom;   /* scroll to the end when the batch ends */
 	gint indent;                /* Current auto-indent width */
 	gboolean marker_seen;
 	gboolean show_marker;
@@ -90,6 +94,10 @@ void pchat_chat_buffer_append_indent (PchatChatBuffer *buf, PchatTextViewChat *c
                                        const gchar *right_text, gsize right_len,
                                        time_t stamp);
 void pchat_chat_buffer_clear (PchatChatBuffer *buf, gint lines);
+void pchat_chat_buffer_begin_prepend (PchatChatBuffer *buf);
+void pchat_chat_buffer_end_prepend (PchatChatBuffer *buf, PchatTextViewChat *chat);
+void pchat_chat_buffer_begin_batch (PchatChatBuffer *buf, PchatTextViewChat *chat);
+void pchat_chat_buffer_end_batch (PchatChatBuffer *buf, PchatTextViewChat *chat);
 
 /* Marker line support */
 void pchat_chat_buffer_set_marker (PchatChatBuffer *buf, PchatTextViewChat *chat);
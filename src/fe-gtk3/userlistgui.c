@@ -56,44 +56,18 @@ enum
 GdkPixbuf *
 get_user_icon (server *serv, struct User *user)
 {
-	char *pre;
-	int level;
-
 	if (!user)
 		return NULL;
 
-	/* these ones are hardcoded */
-	switch (user->prefix[0])
+	/* user->rank is worked out from the prefix whenever it changes */
+	switch (user->rank)
 	{
-		case 0: return NULL;
-		case '+': return pix_ulist_voice;
-		case '%': return pix_ulist_halfop;
-		case '@': return pix_ulist_op;
-	}
-
-	/* find out how many levels above Op this user is */
-	pre = strchr (serv->nick_prefixes, '@');
-	if (pre && pre != serv->nick_prefixes)
-	{
-		pre--;
-		level = 0;
-		while (1)
-		{
-			if (pre[0] == user->prefix[0])
-			{
-				switch (level)
-				{
-					case 0: return pix_ulist_owner;		/* 1 level above op */
-					case 1: return pix_ulist_founder;	/* 2 levels above op */
-					case 2: return pix_ulist_netop;		/* 3 levels above op */
-				}
-				break;	/* 4+, no icons */
-			}
-			level++;
-			if (pre == serv->nick_prefixes)
-				break;
-			pre--;
-		}
+		case USER_RANK_VOICE: return pix_ulist_voice;
+		case USER_RANK_HALFOP: return pix_ulist_halfop;
+		case USER_RANK_OP: return pix_ulist_op;
+		case USER_RANK_OWNER: return pix_ulist_owner;
+		case USER_RANK_FOUNDER: return pix_ulist_founder;
+		case USER_RANK_NETOP: return pix_ulist_netop;
 	}
 
 	return NULL;
@@ -239,13 +213,26 @@ fe_userlist_set_selected (struct session *sess)
 }
 
 static GtkTreeIter *
-find_row (GtkTreeView *treeview, GtkTreeModel *model, struct User *user,
-			 int *selected)
+find_row (GtkTreeView *treeview, GtkTreeModel *model, GHashTable *rows,
+			 struct User *user, int *selected)
 {
 	static GtkTreeIter iter;
+	GtkTreeIter *found;
 	struct User *row_user;
 
 	*selected = FALSE;
+	if (rows)
+	{
+		found = g_hash_table_lookup (rows, user);
+		if (!found)
+			return NULL;
+		iter = *found;
+		if (gtk_tree_view_get_model (treeview) == model &&
+			 gtk_tree_selection_iter_is_selected (gtk_tree_view_get_selection (treeview), &iter))
+			*selected = TRUE;
+		return &iter;
+	}
+
 	if (gtk_tree_model_get_iter_first (model, &iter))
 	{
 		do
@@ -289,10 +276,13 @@ fe_userlist_remove (session *sess, struct User *user)
 	int sel;
 
 	iter = find_row (GTK_TREE_VIEW (sess->gui->user_tree),
-						  sess->res->user_model, user, &sel);
+						  sess->res->user_model, sess->res->user_rows, user, &sel);
 	if (!iter)
 		return 0;
 
+	if (sess->res->user_rows)
+		g_hash_table_remove (sess->res->user_rows, user);
+
 /*	adj = gtk_tree_view_get_vadjustment (GTK_TREE_VIEW (sess->gui->user_tree));
 	val = adj->value;*/
 
@@ -319,16 +309,17 @@ fe_userlist_rehash (session *sess, struct User *user)
 	int nick_color = 0;
 
 	iter = find_row (GTK_TREE_VIEW (sess->gui->user_tree),
-						  sess->res->user_model, user, &sel);
+						  sess->res->user_model, sess->res->user_rows, user, &sel);
 	if (!iter)
 		return;
 
 	if (prefs.pchat_away_track && user->away)
 		nick_color = COL_AWAY;
 	else if (prefs.pchat_gui_ulist_color)
-		nick_color = text_color_of(user->nick);
+		nick_color = user->color;
 
 	gtk_list_store_set (GTK_LIST_STORE (sess->res->user_model), iter,
+							  COL_PIX, prefs.pchat_gui_ulist_icons ? get_user_icon (sess->server, user) : NULL,
 							  COL_HOST, user->hostname,
 							  COL_GDKCOLOR, nick_color ? &colors[nick_color] : NULL,
 							  -1);
@@ -346,7 +337,7 @@ fe_userlist_insert (session *sess, struct User *newuser, int row, gboolean sel)
 	if (prefs.pchat_away_track && newuser->away)
 		nick_color = COL_AWAY;
 	else if (prefs.pchat_gui_ulist_color)
-		nick_color = text_color_of(newuser->nick);
+		nick_color = newuser->color;
 
 	nick = newuser->nick;
 	if (!prefs.pchat_gui_ulist_icons)
@@ -377,6 +368,9 @@ gtk_list_store_insert_with_values (GTK_LIST_STORE (model), &iter, row,
 		g_free (nick);
 	}
 
+	if (sess->res->user_rows)
+		g_hash_table_insert (sess->res->user_rows, newuser, gtk_tree_iter_copy (&iter));
+
 	/* is it me? */
 	if (newuser->me && sess->gui->nick_box)
 	{
@@ -412,9 +406,45 @@ fe_userlist_move (session *sess, struct User *user, int new_row)
 void
 fe_userlist_clear (session *sess)
 {
+	if (sess->res->user_rows)
+		g_hash_table_remove_all (sess->res->user_rows);
 	gtk_list_store_clear (sess->res->user_model);
 }
 
+/* Between fe_userlist_batch_begin() and fe_userlist_batch_end(), rows are
+   found through a User -> iter index instead of walking the model, so a
+   netsplit or a large WHO reply updates the list in place. GtkListStore
+   iters stay valid across other rows' inserts and removals. */
+
+void
+fe_userlist_batch_begin (session *sess)
+{
+	GtkTreeModel *model = sess->res->user_model;
+	GtkTreeIter iter;
+	struct User *user;
+
+	if (sess->res->user_rows)
+		return;
+
+	sess->res->user_rows = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL,
+																 (GDestroyNotify) gtk_tree_iter_free);
+	if (gtk_tree_model_get_iter_first (model, &iter))
+	{
+		do
+		{
+			gtk_tree_model_get (model, &iter, COL_USER, &user, -1);
+			g_hash_table_insert (sess->res->user_rows, user, gtk_tree_iter_copy (&iter));
+		}
+		while (gtk_tree_model_iter_next (model, &iter));
+	}
+}
+
+void
+fe_userlist_batch_end (session *sess)
+{
+	g_clear_pointer (&sess->res->user_rows, g_hash_table_destroy);
+}
+
 static void
 userlist_dnd_drop (GtkTreeView *widget, GdkDragContext *context,
 						 gint x, gint y, GtkSelectionData *selection_data,
@@ -0,0 +1,471 @@
+/* PChat
+ * Copyright (C) 2026 PChat-IRC contributors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "../common/pchat.h"
+#include "../common/pchatc.h"
+#include "../common/fe.h"
+#include "../common/outbound.h"
+#include "../common/server.h"
+#include "../common/util.h"
+#include "control.h"
+
+#ifndef WIN32
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define CONTROL_MAX_PENDING (1024 * 1024)	/* unsent output before a client is dropped */
+#define CONTROL_MAX_LINE 8192					/* longest input line accepted */
+
+struct control_client
+{
+	int sok;
+	int iotag;
+	int wiotag;				/* waiting for the socket to drain */
+	GString *in;
+	GString *out;
+	gboolean dead;
+};
+
+static int listen_sok = -1;
+static int listen_tag;
+static char *listen_path;
+static GSList *clients;
+
+static void
+control_client_free (struct control_client *c)
+{
+	if (c->iotag)
+		fe_input_remove (c->iotag);
+	if (c->wiotag)
+		fe_input_remove (c->wiotag);
+	if (c->sok != -1)
+		close (c->sok);
+	g_string_free (c->in, TRUE);
+	g_string_free (c->out, TRUE);
+	g_free (c);
+}
+
+/* clients are only freed here, never while something may be iterating */
+static gboolean
+control_reap (gpointer unused)
+{
+	GSList *list, *next;
+	struct control_client *c;
+
+	for (list = clients; list; list = next)
+	{
+		next = list->next;
+		c = list->data;
+		if (c->dead)
+		{
+			clients = g_slist_remove (clients, c);
+			control_client_free (c);
+		}
+	}
+
+	return FALSE;
+}
+
+static void
+control_kill (struct control_client *c)
+{
+	if (c->dead)
+		return;
+	c->dead = TRUE;
+	fe_idle_add (control_reap, NULL);
+}
+
+static gboolean control_write_cb (GIOChannel *source, GIOCondition condition,
+											 struct control_client *c);
+
+static void
+control_flush (struct control_client *c)
+{
+	int n;
+
+	while (c->out->len && !c->dead)
+	{
+		n = send (c->sok, c->out->str, c->out->len, 0);
+		if (n > 0)
+		{
+			g_string_erase (c->out, 0, n);
+			continue;
+		}
+
+		if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+		{
+			if (!c->wiotag)
+				c->wiotag = fe_input_add (c->sok, FIA_WRITE, control_write_cb, c);
+			return;
+		}
+
+		control_kill (c);
+		return;
+	}
+
+	if (c->wiotag)
+	{
+		fe_input_remove (c->wiotag);
+		c->wiotag = 0;
+	}
+}
+
+static gboolean
+control_write_cb (GIOChannel *source, GIOCondition condition, struct control_client *c)
+{
+	control_flush (c);
+	return TRUE;
+}
+
+static void
+control_send (struct control_client *c, const char *data, gsize len)
+{
+	if (c->dead)
+		return;
+
+	if (c->out->len + len > CONTROL_MAX_PENDING)
+	{
+		control_kill (c);
+		return;
+	}
+
+	g_string_append_len (c->out, data, len);
+	control_flush (c);
+}
+
+/* "network" or "network/target" -> that network's server tab, or the tab */
+static session *
+control_find_session (char *ctx)
+{
+	GSList *list;
+	server *serv;
+	session *sess;
+	char *target;
+
+	target = strchr (ctx, '/');
+	if (target)
+		*target++ = 0;
+
+	for (list = serv_list; list; list = list->next)
+	{
+		serv = list->data;
+		if (g_ascii_strcasecmp (server_get_network (serv, TRUE), ctx) != 0)
+			continue;
+
+		if (!target || !*target)
+			return serv->server_session;
+
+		sess = find_channel (serv, target);
+		if (!sess)
+			sess = find_dialog (serv, target);
+		if (sess)
+			return sess;
+	}
+
+	return NULL;
+}
+
+static void
+control_command (struct control_client *c, char *line)
+{
+	session *sess = current_tab;
+	char *text = line;
+	char *sp;
+
+	if (line[0] == '@')
+	{
+		sp = strchr (line, ' ');
+		if (!sp)
+			return;
+		*sp = 0;
+		text = sp + 1;
+
+		sess = control_find_session (line + 1);
+		if (!sess)
+		{
+			control_send (c, "error: no such network or tab\n", 30);
+			return;
+		}
+	}
+
+	if (!sess && sess_list)
+		sess = sess_list->data;
+	if (!sess || !*text)
+		return;
+
+	handle_multiline (sess, text, FALSE, FALSE);
+}
+
+static gboolean
+control_read_cb (GIOChannel *source, GIOCondition condition, struct control_client *c)
+{
+	char buf[4096];
+	char *nl, *line;
+	gsize used;
+	int n;
+
+	if (c->dead)
+		return TRUE;
+
+	n = recv (c->sok, buf, sizeof (buf), 0);
+	if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+		return TRUE;
+	if (n < 1)
+	{
+		control_kill (c);
+		return TRUE;
+	}
+
+	g_string_append_len (c->in, buf, n);
+
+	used = 0;
+	while ((nl = memchr (c->in->str + used, '\n', c->in->len - used)))
+	{
+		*nl = 0;
+		line = c->in->str + used;
+		used = nl - c->in->str + 1;
+		if (nl > line && nl[-1] == '\r')
+			nl[-1] = 0;
+
+		/* a command may well end up closing this client (e.g. /quit) */
+		control_command (c, line);
+		if (c->dead)
+			return TRUE;
+	}
+	g_string_erase (c->in, 0, used);
+
+	if (c->in->len > CONTROL_MAX_LINE)
+		control_kill (c);
+
+	return TRUE;
+}
+
+static gboolean
+control_accept_cb (GIOChannel *source, GIOCondition condition, gpointer unused)
+{
+	struct control_client *c;
+	int sok;
+
+	sok = accept (listen_sok, NULL, NULL);
+	if (sok < 0)
+		return TRUE;
+
+	fcntl (sok, F_SETFL, O_NONBLOCK);
+
+	c = g_new0 (struct control_client, 1);
+	c->sok = sok;
+	c->in = g_string_new (NULL);
+	c->out = g_string_new (NULL);
+	c->iotag = fe_input_add (sok, FIA_READ, control_read_cb, c);
+	clients = g_slist_prepend (clients, c);
+
+	return TRUE;
+}
+
+/* is another process listening on addr? 1 if so, 0 if the path is free
+   or a stale socket, -1 (with errno set) if we can't tell */
+
+static int
+control_probe (struct sockaddr_un *addr)
+{
+	int sok, ret, err;
+
+	sok = socket (AF_UNIX, SOCK_STREAM, 0);
+	if (sok < 0)
+		return -1;
+
+	if (connect (sok, (struct sockaddr *) addr, sizeof (*addr)) == 0)
+		ret = 1;
+	else if (errno == ECONNREFUSED || errno == ENOENT)
+		ret = 0;
+	else
+		ret = -1;
+
+	err = errno;
+	close (sok);
+	errno = err;
+	return ret;
+}
+
+gboolean
+control_open (const char *path)
+{
+	struct sockaddr_un addr;
+	mode_t old_mask;
+
+	if (strlen (path) >= sizeof (addr.sun_path))
+	{
+		fprintf (stderr, "pchat: control socket path too long: %s\n", path);
+		return FALSE;
+	}
+
+	listen_sok = socket (AF_UNIX, SOCK_STREAM, 0);
+	if (listen_sok < 0)
+	{
+		perror ("pchat: control socket");
+		return FALSE;
+	}
+
+	memset (&addr, 0, sizeof (addr));
+	addr.sun_family = AF_UNIX;
+	g_strlcpy (addr.sun_path, path, sizeof (addr.sun_path));
+
+	/* only take the path over if nothing is listening on it, i.e. it was
+	   left behind by a previous run that didn't exit cleanly */
+	switch (control_probe (&addr))
+	{
+	case 0:
+		unlink (path);
+		break;
+	case 1:
+		fprintf (stderr, "pchat: already running, control socket %s is in use\n", path);
+		close (listen_sok);
+		listen_sok = -1;
+		return FALSE;
+	default:
+		fprintf (stderr, "pchat: control socket %s: %s\n", path, g_strerror (errno));
+		close (listen_sok);
+		listen_sok = -1;
+		return FALSE;
+	}
+
+	old_mask = umask (077);
+	if (bind (listen_sok, (struct sockaddr *) &addr, sizeof (addr)) < 0 ||
+		 listen (listen_sok, 16) < 0)
+	{
+		umask (old_mask);
+		fprintf (stderr, "pchat: control socket %s: %s\n", path, g_strerror (errno));
+		close (listen_sok);
+		listen_sok = -1;
+		return FALSE;
+	}
+	umask (old_mask);
+
+	fcntl (listen_sok, F_SETFL, O_NONBLOCK);
+	listen_tag = fe_input_add (listen_sok, FIA_READ, control_accept_cb, NULL);
+	listen_path = g_strdup (path);
+
+	return TRUE;
+}
+
+/* A control command can get here (/killall, closing the last tab) while
+   control_read_cb is still using its client, so clients are only shut
+   down and marked dead now; control_reap frees them later. */
+
+void
+control_close (void)
+{
+	GSList *list;
+	struct control_client *c;
+
+	for (list = clients; list; list = list->next)
+	{
+		c = list->data;
+		if (c->iotag)
+			fe_input_remove (c->iotag);
+		if (c->wiotag)
+			fe_input_remove (c->wiotag);
+		c->iotag = c->wiotag = 0;
+		if (c->sok != -1)
+			close (c->sok);
+		c->sok = -1;
+		control_kill (c);
+	}
+
+	if (listen_sok == -1)
+		return;
+
+	fe_input_remove (listen_tag);
+	close (listen_sok);
+	listen_sok = -1;
+	unlink (listen_path);
+	g_free (listen_path);
+	listen_path = NULL;
+}
+
+void
+control_print (session *sess, const char *text, time_t stamp)
+{
+	GSList *list;
+	GString *out;
+	char *stripped, *line;
+	const char *network = "", *tab = "";
+	gsize len;
+
+	if (!clients)
+		return;
+
+	if (sess)
+	{
+		network = server_get_network (sess->server, TRUE);
+		tab = sess->channel[0] ? sess->channel : sess->server->servername;
+	}
+	if (!stamp)
+		stamp = time (NULL);
+
+	/* one record per printed line */
+	stripped = strip_color (text, -1, STRIP_ALL);
+	out = g_string_sized_new (strlen (stripped) + 64);
+	line = stripped;
+	while (*line)
+	{
+		len = strcspn (line, "\n");
+		g_string_append_printf (out, "%" G_GINT64_FORMAT "\t%s\t%s\t%.*s\n",
+										(gint64) stamp, network, tab, (int) len, line);
+		line += len;
+		if (*line)
+			line++;
+	}
+	g_free (stripped);
+
+	for (list = clients; list; list = list->next)
+		control_send (list->data, out->str, out->len);
+
+	g_string_free (out, TRUE);
+}
+
+#else /* WIN32 */
+
+gboolean
+control_open (const char *path)
+{
+	fprintf (stderr, "pchat: the control socket is not available on Windows\n");
+	return FALSE;
+}
+
+void
+control_close (void)
+{
+}
+
+void
+control_print (session *sess, const char *text, time_t stamp)
+{
+}
+
+#endif
@@ -0,0 +1,44 @@
+/* PChat
+ * Copyright (C) 2026 PChat-IRC contributors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#ifndef PCHAT_FE_TEXT_CONTROL_H
+#define PCHAT_FE_TEXT_CONTROL_H
+
+/* Control socket for pchat-text --daemon (Unix only).
+ *
+ * Clients connect to a Unix stream socket (by default pchat.sock in the
+ * config directory, mode 0600) and send lines of input exactly as they
+ * would be typed into a tab. A leading "@network" or "@network/target"
+ * picks the tab; without it the line goes to the current one:
+ *
+ *     /server irc.libera.chat
+ *     @Libera /join #pchat
+ *     @Libera/#pchat hello there
+ *
+ * Everything PChat prints is streamed back to every client, one line
+ * each, formatting stripped:
+ *
+ *     <unix time> TAB <network> TAB <tab name> TAB <text> LF
+ *
+ * A client that falls too far behind is disconnected. */
+
+gboolean control_open (const char *path);
+void control_close (void);
+void control_print (session *sess, const char *text, time_t stamp);
+
+#endif
@@ -36,16 +36,23 @@
 #include <sys/types.h>
 #include <ctype.h>
 #include <glib-object.h>
-#include "../common/xchat.h"
-#include "../common/xchatc.h"
+#ifndef WIN32
+#include <signal.h>
+#include <glib-unix.h>
+#endif
+#include "../common/pchat.h"
+#include "../common/pchatc.h"
 #include "../common/cfgfiles.h"
 #include "../common/outbound.h"
 #include "../common/util.h"
 #include "../common/fe.h"
 #include "fe-text.h"
+#include "control.h"
 
 
 static int done = FALSE;		  /* finished ? */
+static gint arg_daemon = 0;	  /* --daemon: headless, driven by the control socket */
+static char *arg_control = NULL;
 
 
 static void
@@ -91,7 +98,7 @@ fe_new_window (struct session *sess, int focus)
 	if (!current_tab || focus)
 		current_tab = sess;
 
-	if (done_intro)
+	if (done_intro || arg_daemon)
 		return;
 	done_intro = 1;
 
@@ -134,7 +141,7 @@ fe_new_window (struct session *sess, int focus)
 static int
 get_stamp_str (time_t tim, char *dest, int size)
 {
-	return strftime_validated (dest, size, prefs.pchat_stamp_text_format, localtime (&tim));
+	return stamp_format (prefs.pchat_stamp_text_format, tim, dest, size);
 }
 
 static int
@@ -158,9 +165,8 @@ timecat (char *buf, size_t bufsize, time_t stamp)
 /*                       0  1  2  3  4  5  6  7   8   9   10 11  12  13  14 15 */
 static const short colconv[] = { 0, 7, 4, 2, 1, 3, 5, 11, 13, 12, 6, 16, 14, 15, 10, 7 };
 
-void
-fe_print_text (struct session *sess, char *text, time_t stamp,
-			   gboolean no_activity)
+static void
+term_print_text (char *text, time_t stamp)
 {
 	int dotime = FALSE;
 	char num[8];
@@ -335,9 +341,8 @@ fe_print_text (struct session *sess, char *text, time_t stamp,
 }
 #else
 /* The win32 version for cmd.exe */
-void
-fe_print_text (struct session *sess, char *text, time_t stamp,
-			   gboolean no_activity)
+static void
+term_print_text (char *text, time_t stamp)
 {
 	int dotime = FALSE;
 	int comma, k, i = 0, j = 0, len = strlen (text);
@@ -430,6 +435,17 @@ fe_print_text (struct session *sess, char *text, time_t stamp,
 }
 #endif
 
+void
+fe_print_text (struct session *sess, char *text, time_t stamp,
+			   gboolean no_activity)
+{
+	/* a daemon has no terminal to render to; control clients get the text */
+	if (arg_daemon)
+		control_print (sess, text, stamp);
+	else
+		term_print_text (text, stamp);
+}
+
 void
 fe_timeout_remove (int tag)
 {
@@ -442,6 +458,12 @@ fe_timeout_add (int interval, void *callback, void *userdata)
 	return g_timeout_add (interval, (GSourceFunc) callback, userdata);
 }
 
+int
+fe_timeout_add_seconds (int interval, void *callback, void *userdata)
+{
+	return g_timeout_add_seconds (interval, (GSourceFunc) callback, userdata);
+}
+
 void
 fe_input_remove (int tag)
 {
@@ -487,6 +509,8 @@ static const GOptionEntry gopt_entries[] =
 {
  {"no-auto",	'a', 0, G_OPTION_ARG_NONE,	&arg_dont_autoconnect, N_("Don't auto connect to servers"), NULL},
  {"cfgdir",	'd', 0, G_OPTION_ARG_STRING,	&arg_cfgdir, N_("Use a different config directory"), "PATH"},
+ {"daemon",	'D', 0, G_OPTION_ARG_NONE,	&arg_daemon, N_("Run headless, taking commands from the control socket"), NULL},
+ {"control",	 0,  0, G_OPTION_ARG_FILENAME,	&arg_control, N_("Control socket for --daemon (default: pchat.sock in the config directory)"), "PATH"},
  {"no-plugins",	'n', 0, G_OPTION_ARG_NONE,	&arg_skip_plugins, N_("Don't auto load any plugins"), NULL},
  {"plugindir",	'p', 0, G_OPTION_ARG_NONE,	&arg_show_autoload, N_("Show plugin/script auto-load directory"), NULL},
  {"configdir",	'u', 0, G_OPTION_ARG_NONE,	&arg_show_config, N_("Show user config directory"), NULL},
@@ -540,7 +564,7 @@ fe_args (int argc, char *argv[])
 		}
 		g_free (exe);
 #else
-		printf ("%s\n", XCHATLIBDIR);
+		printf ("%s\n", PCHATLIBDIR);
 #endif
 		return 0;
 	}
@@ -575,6 +599,15 @@ fe_init (void)
 	prefs.pchat_gui_slist_skip = 1;
 }
 
+#ifndef WIN32
+static gboolean
+daemon_quit_cb (gpointer unused)
+{
+	pchat_exit ();
+	return G_SOURCE_REMOVE;
+}
+#endif
+
 void
 fe_main (void)
 {
@@ -582,6 +615,31 @@ fe_main (void)
 
 	main_loop = g_main_loop_new(NULL, FALSE);
 
+	if (arg_daemon)
+	{
+		char *path;
+
+		if (arg_control)
+			path = g_strdup (arg_control);
+		else
+			path = g_build_filename (get_xdir (), "pchat.sock", NULL);
+		if (!control_open (path))
+		{
+			/* e.g. another daemon owns the socket; don't run a second
+				copy nobody can reach */
+			g_free (path);
+			exit (1);
+		}
+		g_free (path);
+
+#ifndef WIN32
+		g_unix_signal_add (SIGTERM, daemon_quit_cb, NULL);
+		g_unix_signal_add (SIGINT, daemon_quit_cb, NULL);
+#endif
+		g_main_loop_run (main_loop);
+		return;
+	}
+
 	/* Keyboard Entry Setup */
 #ifdef G_OS_WIN32
 	keyboard_input = g_io_channel_win32_new_fd(STDIN_FILENO);
@@ -625,7 +683,8 @@ fe_close_window (struct session *sess)
 void
 fe_beep (session *sess)
 {
-	putchar (7);
+	if (!arg_daemon)
+		putchar (7);
 }
 
 void
@@ -639,13 +698,14 @@ fe_set_topic (struct session *sess, char *topic, char *stripped_topic)
 void
 fe_cleanup (void)
 {
+	control_close ();
 }
 void
 fe_set_hilight (struct session *sess)
 {
 }
 void
-fe_set_tab_color (struct session *sess, int col)
+fe_set_tab_color (struct session *sess, tabcolor col)
 {
 }
 void
@@ -675,7 +735,7 @@ fe_chan_list_end (struct server *serv)
 {
 }
 gboolean
-fe_add_ban_list (struct session *sess, char *mask, char *who, char *when, int rplcode)
+fe_add_ban_list (struct session *sess, char *mask, char *who, char *when, time_t stamp, int rplcode)
 {
 	return 0;
 }
@@ -697,6 +757,28 @@ fe_text_clear (struct session *sess, int lines)
 {
 }
 void
+fe_text_history_begin (struct session *sess)
+{
+}
+void
+fe_text_history_end (struct session *sess)
+{
+}
+void
+fe_print_history (struct session *sess, char *text, time_t stamp)
+{
+	/* a terminal can't insert above what it printed */
+	fe_print_text (sess, text, stamp, TRUE);
+}
+void
+fe_text_batch_begin (struct session *sess)
+{
+}
+void
+fe_text_batch_end (struct session *sess)
+{
+}
+void
 fe_progressbar_start (struct session *sess)
 {
 }
@@ -730,6 +812,14 @@ fe_userlist_clear (struct session *sess)
 {
 }
 void
+fe_userlist_batch_begin (struct session *sess)
+{
+}
+void
+fe_userlist_batch_end (struct session *sess)
+{
+}
+void
 fe_userlist_set_selected (struct session *sess)
 {
 }
@@ -821,7 +911,7 @@ fe_userlist_hide (session * sess)
 {
 }
 void
-fe_lastlog (session *sess, session *lastlog_sess, char *sstr, gtk_xtext_search_flags flags)
+fe_lastlog (session *sess, session *lastlog_sess, char *sstr, int flags)
 {
 }
 void
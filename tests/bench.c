@@ -0,0 +1,560 @@
+/* PChat
+ * Copyright (C) 2026 PChat-IRC contributors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/* pchat-bench: microbenchmarks for the hot utilities in pchatcommon.
+ *
+ * Links the real common library behind a do-nothing frontend (bench-fe.c),
+ * so config, text events and ignores are loaded exactly as at startup;
+ * pass -d to point it at a scratch config directory. Inputs are generated
+ * from --seed, so two runs with the same seed time the same work.
+ *
+ * Each case is calibrated to about 10ms per round and timed over several
+ * rounds; the fastest round is reported, as ns/op and allocations/op
+ * (allocation counting needs glibc and reads "-" elsewhere). --json
+ * prints one object for comparing results across commits.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+
+#include "pchat.h"
+#include "pchatc.h"
+#include "fe.h"
+#include "util.h"
+#include "casefold.h"
+#include "tree.h"
+#include "text.h"
+#include "url.h"
+#include "ignore.h"
+#include "inbound.h"
+#include "outbound.h"
+
+#define BENCH_ROUND_USEC 10000		/* calibrated length of one timed round */
+#define BENCH_NICKS 4096
+#define BENCH_LINES 1024
+#define BENCH_IGNORES 32
+
+typedef struct
+{
+	const char *name;
+	void (*run) (guint64 iters);
+} bench_case;
+
+static gint bench_seed = 1;
+static gint bench_rounds = 7;
+static gboolean bench_json = FALSE;
+static char *bench_filter = NULL;
+static char *bench_cfgdir = NULL;	/* already handled by main (); accepted so parsing succeeds */
+
+static const GOptionEntry bench_options[] =
+{
+	{"cfgdir", 'd', 0, G_OPTION_ARG_STRING, &bench_cfgdir, "Use a different config directory", "PATH"},
+	{"seed", 's', 0, G_OPTION_ARG_INT, &bench_seed, "Seed for the generated inputs (default 1)", "N"},
+	{"rounds", 'r', 0, G_OPTION_ARG_INT, &bench_rounds, "Timed rounds per case; the fastest is reported (default 7)", "N"},
+	{"filter", 'f', 0, G_OPTION_ARG_STRING, &bench_filter, "Only run cases whose name contains this", "TEXT"},
+	{"json", 'j', 0, G_OPTION_ARG_NONE, &bench_json, "Print results as JSON", NULL},
+	{NULL}
+};
+
+/* inputs */
+static char *nicks[BENCH_NICKS];
+static char *nicks_upper[BENCH_NICKS];
+static char *hosts[BENCH_NICKS];
+static char *lines[BENCH_LINES];
+static char *lines_upper[BENCH_LINES];
+static char *paste;			/* ~10 KB of lines, as one message */
+static char *raw_lines[BENCH_LINES];
+static char *invalid_lines[BENCH_LINES];
+static gsize invalid_lens[BENCH_LINES];
+static char *masks[BENCH_IGNORES];
+static char alert_masks[256];
+static tree *nick_tree;
+static session *bench_sess;
+
+/* results are folded into this so the work can't be optimized away */
+static volatile gsize bench_sink;
+
+/* allocation counting */
+#ifdef __GLIBC__
+#define BENCH_COUNT_ALLOCS
+extern void *__libc_malloc (size_t size);
+extern void *__libc_calloc (size_t n, size_t size);
+extern void *__libc_realloc (void *ptr, size_t size);
+
+/* plain counter: the benchmarks run on the main thread and nothing else is
+ * started in this process */
+static guint64 alloc_count;
+
+void *
+malloc (size_t size)
+{
+	alloc_count++;
+	return __libc_malloc (size);
+}
+
+void *
+calloc (size_t n, size_t size)
+{
+	alloc_count++;
+	return __libc_calloc (n, size);
+}
+
+void *
+realloc (void *ptr, size_t size)
+{
+	alloc_count++;
+	return __libc_realloc (ptr, size);
+}
+#endif
+
+static char *
+random_word (GRand *rand, int min, int max, const char *alphabet)
+{
+	int len = g_rand_int_range (rand, min, max + 1);
+	int alen = strlen (alphabet);
+	char *word = g_malloc (len + 1);
+	int i;
+
+	for (i = 0; i < len; i++)
+		word[i] = alphabet[g_rand_int_range (rand, 0, alen)];
+	word[len] = 0;
+	return word;
+}
+
+static int
+bench_nick_cmp (const void *a, const void *b, void *data)
+{
+	return rfc_casecmp (a, b);
+}
+
+static void
+bench_inputs (void)
+{
+	static const char nickchars[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789[]\\`_^{|}-";
+	static const char wordchars[] = "abcdefghijklmnopqrstuvwxyz";
+	static const char *const decorations[] =
+	{
+		"", "", "", "\00304", "\002", "\00312,01", "\035", "\017",
+		" https://example.org/a/b?c=d", " www.example.net", " #pchat", " irc://irc.example.org/chan",
+	};
+	GRand *rand = g_rand_new_with_seed (bench_seed);
+	GString *line = g_string_new (NULL);
+	int i;
+
+	nick_tree = tree_new (bench_nick_cmp, NULL);
+	for (i = 0; i < BENCH_NICKS; i++)
+	{
+		char *user = random_word (rand, 3, 10, wordchars);
+		char *host = random_word (rand, 4, 16, wordchars);
+
+		nicks[i] = random_word (rand, 3, 15, nickchars);
+		nicks_upper[i] = g_ascii_strup (nicks[i], -1);
+		hosts[i] = g_strdup_printf ("%s!~%s@%s.example.net", nicks[i], user, host);
+		tree_insert (nick_tree, nicks[i]);
+		g_free (user);
+		g_free (host);
+	}
+
+	for (i = 0; i < BENCH_LINES; i++)
+	{
+		int words = g_rand_int_range (rand, 3, 40);
+		int w;
+
+		g_string_truncate (line, 0);
+		for (w = 0; w < words; w++)
+		{
+			char *word = random_word (rand, 1, 10, wordchars);
+
+			if (w)
+				g_string_append_c (line, ' ');
+			if (g_rand_int_range (rand, 0, 8) == 0)
+				g_string_append (line, decorations[g_rand_int_range (rand, 0, G_N_ELEMENTS (decorations))]);
+			else if (g_rand_int_range (rand, 0, 50) == 0)
+				g_string_append (line, nicks[g_rand_int_range (rand, 0, BENCH_NICKS)]);
+			else
+				g_string_append (line, word);
+			g_free (word);
+		}
+		lines[i] = g_strdup (line->str);
+		lines_upper[i] = g_ascii_strup (line->str, -1);
+		raw_lines[i] = g_strdup_printf (":%s PRIVMSG #pchat :%s", hosts[i % BENCH_NICKS], line->str);
+
+		/* every fourth line has a stray Latin-1 byte */
+		if (i % 4 == 0)
+			line->str[g_rand_int_range (rand, 0, line->len)] = (char) 0xe9;
+		invalid_lines[i] = g_strdup (line->str);
+		invalid_lens[i] = line->len;
+	}
+
+	for (i = 0; i < BENCH_IGNORES; i++)
+	{
+		char *host = random_word (rand, 4, 12, wordchars);
+
+		switch (i % 4)
+		{
+		case 0:
+			masks[i] = g_strdup_printf ("%s!*@*", nicks[g_rand_int_range (rand, 0, BENCH_NICKS)]);
+			break;
+		case 1:
+			masks[i] = g_strdup_printf ("*!*@%s.example.net", host);
+			break;
+		case 2:
+			masks[i] = g_strdup_printf ("*!~%s*@*", host);
+			break;
+		default:
+			masks[i] = g_strdup_printf ("*%s*", host);
+			break;
+		}
+		ignore_add (masks[i], IG_PRIV | IG_NOTI | IG_CHAN, FALSE);
+		g_free (host);
+	}
+
+	g_snprintf (alert_masks, sizeof (alert_masks), "%s,%s*,*%s,pchat,release",
+					nicks[1], nicks[2], nicks[3]);
+
+	g_string_truncate (line, 0);
+	for (i = 0; line->len < 10240; i++)
+	{
+		g_string_append (line, lines[i % BENCH_LINES]);
+		g_string_append_c (line, ' ');
+	}
+	paste = g_strdup (line->str);
+
+	g_string_free (line, TRUE);
+	g_rand_free (rand);
+}
+
+/* cases: each runs exactly iters operations */
+
+static void
+run_tree_insert (guint64 iters)
+{
+	tree *t = tree_new (bench_nick_cmp, NULL);
+	guint64 i;
+
+	for (i = 0; i < iters; i++)
+	{
+		if (i % BENCH_NICKS == 0 && i)
+		{
+			tree_destroy (t);
+			t = tree_new (bench_nick_cmp, NULL);
+		}
+		tree_insert (t, nicks[i % BENCH_NICKS]);
+	}
+	bench_sink += tree_size (t);
+	tree_destroy (t);
+}
+
+static void
+run_tree_find (guint64 iters)
+{
+	guint64 i;
+	int pos;
+
+	for (i = 0; i < iters; i++)
+		bench_sink += GPOINTER_TO_SIZE (tree_find (nick_tree, nicks_upper[(i * 7) % BENCH_NICKS], bench_nick_cmp, NULL, &pos));
+}
+
+static void
+run_match (guint64 iters)
+{
+	guint64 i;
+
+	for (i = 0; i < iters; i++)
+		bench_sink += match (masks[i % BENCH_IGNORES], hosts[(i * 13) % BENCH_NICKS]);
+}
+
+static void
+run_rfc_casecmp (guint64 iters)
+{
+	guint64 i;
+
+	for (i = 0; i < iters; i++)
+		bench_sink += rfc_casecmp (nicks[i % BENCH_NICKS], nicks_upper[i % BENCH_NICKS]);
+}
+
+static void
+run_rfc_casecmp_long (guint64 iters)
+{
+	guint64 i;
+
+	for (i = 0; i < iters; i++)
+		bench_sink += rfc_casecmp (lines[i % BENCH_LINES], lines_upper[i % BENCH_LINES]);
+}
+
+static void
+run_rfc_ncasecmp (guint64 iters)
+{
+	guint64 i;
+
+	for (i = 0; i < iters; i++)
+		bench_sink += rfc_ncasecmp (nicks[i % BENCH_NICKS], nicks_upper[i % BENCH_NICKS], 8);
+}
+
+static void
+run_str_ihash (guint64 iters)
+{
+	guint64 i;
+
+	for (i = 0; i < iters; i++)
+		bench_sink += str_ihash (nicks[i % BENCH_NICKS]);
+}
+
+static void
+run_casefold_hash (guint64 iters)
+{
+	guint64 i;
+
+	for (i = 0; i < iters; i++)
+		bench_sink += casefold_hash (nicks[i % BENCH_NICKS]);
+}
+
+static void
+run_stamp_format (guint64 iters)
+{
+	char stamp[128];
+	guint64 i;
+
+	/* a busy channel: many lines per second */
+	for (i = 0; i < iters; i++)
+		bench_sink += stamp_format ("[%H:%M:%S] ", 1700000000 + (time_t) (i / 64), stamp, sizeof (stamp));
+}
+
+static void
+run_text_split (guint64 iters)
+{
+	text_split ts;
+	guint64 i;
+
+	for (i = 0; i < iters; i++)
+	{
+		text_split_init (&ts, bench_sess, paste, 13);
+		while (text_split_next (&ts))
+			bench_sink += ts.len;
+	}
+}
+
+static void
+run_strip_color (guint64 iters)
+{
+	guint64 i;
+
+	for (i = 0; i < iters; i++)
+	{
+		char *out = strip_color (lines[i % BENCH_LINES], -1, STRIP_ALL);
+		bench_sink += out[0];
+		g_free (out);
+	}
+}
+
+static void
+run_format_event (guint64 iters)
+{
+	char out[4096];
+	char *args[PDIWORDS];
+	guint64 i;
+
+	memset (args, 0, sizeof (args));
+	args[3] = "@";
+	args[4] = "";
+	for (i = 0; i < iters; i++)
+	{
+		args[1] = nicks[i % BENCH_NICKS];
+		args[2] = lines[i % BENCH_LINES];
+		format_event (bench_sess, XP_TE_CHANMSG, args, out, sizeof (out), 0);
+		bench_sink += out[0];
+	}
+}
+
+static void
+run_url_check_line (guint64 iters)
+{
+	guint64 i;
+
+	for (i = 0; i < iters; i++)
+		url_check_line (raw_lines[i % BENCH_LINES]);
+}
+
+static void
+run_fixup_utf8 (guint64 iters)
+{
+	guint64 i;
+	gsize len;
+
+	for (i = 0; i < iters; i++)
+	{
+		char *out = text_fixup_invalid_utf8 (invalid_lines[i % BENCH_LINES], invalid_lens[i % BENCH_LINES], &len);
+		bench_sink += len;
+		g_free (out);
+	}
+}
+
+static void
+run_alert_match_text (guint64 iters)
+{
+	guint64 i;
+
+	for (i = 0; i < iters; i++)
+		bench_sink += alert_match_text (lines[i % BENCH_LINES], alert_masks);
+}
+
+static void
+run_ignore_check (guint64 iters)
+{
+	guint64 i;
+
+	for (i = 0; i < iters; i++)
+		bench_sink += ignore_check (hosts[i % BENCH_NICKS], IG_CHAN);
+}
+
+static const bench_case cases[] =
+{
+	{"tree_insert", run_tree_insert},
+	{"tree_find", run_tree_find},
+	{"match", run_match},
+	{"rfc_casecmp", run_rfc_casecmp},
+	{"rfc_casecmp_long", run_rfc_casecmp_long},
+	{"rfc_ncasecmp", run_rfc_ncasecmp},
+	{"str_ihash", run_str_ihash},
+	{"casefold_hash", run_casefold_hash},
+	{"stamp_format", run_stamp_format},
+	{"text_split_10k", run_text_split},
+	{"strip_color", run_strip_color},
+	{"format_event", run_format_event},
+	{"url_check_line", run_url_check_line},
+	{"text_fixup_invalid_utf8", run_fixup_utf8},
+	{"alert_match_text", run_alert_match_text},
+	{"ignore_check", run_ignore_check},
+};
+
+static gint64
+bench_time (const bench_case *bc, guint64 iters)
+{
+	gint64 start = g_get_monotonic_time ();
+
+	bc->run (iters);
+	return g_get_monotonic_time () - start;
+}
+
+static void
+bench_run (const bench_case *bc, gboolean first)
+{
+	guint64 iters = 1;
+	gint64 best = G_MAXINT64;
+	double allocs = -1;
+	int round;
+
+	/* warm up and find an iteration count that takes about one round */
+	while (bench_time (bc, iters) < BENCH_ROUND_USEC && iters < G_GUINT64_CONSTANT (1) << 40)
+		iters *= 2;
+
+	for (round = 0; round < MAX (bench_rounds, 1); round++)
+	{
+		gint64 elapsed;
+#ifdef BENCH_COUNT_ALLOCS
+		guint64 before = alloc_count;
+#endif
+
+		elapsed = bench_time (bc, iters);
+#ifdef BENCH_COUNT_ALLOCS
+		allocs = (double) (alloc_count - before) / iters;
+#endif
+		best = MIN (best, elapsed);
+	}
+
+	if (bench_json)
+	{
+		printf ("%s\n    {\"name\": \"%s\", \"ns_per_op\": %.2f, \"allocs_per_op\": ",
+				  first ? "" : ",", bc->name, best * 1000.0 / iters);
+		if (allocs < 0)
+			printf ("null");
+		else
+			printf ("%.3f", allocs);
+		printf (", \"iterations\": %" G_GUINT64_FORMAT "}", iters);
+	}
+	else
+	{
+		printf ("%-26s %12.1f ns/op", bc->name, best * 1000.0 / iters);
+		if (allocs < 0)
+			printf ("  %10s allocs/op\n", "-");
+		else
+			printf ("  %10.3f allocs/op\n", allocs);
+	}
+	fflush (stdout);
+}
+
+int
+fe_args (int argc, char *argv[])
+{
+	GOptionContext *context;
+	GError *error = NULL;
+
+	context = g_option_context_new (NULL);
+	g_option_context_set_summary (context, "Microbenchmarks for pchatcommon.");
+	g_option_context_add_main_entries (context, bench_options, NULL);
+	if (!g_option_context_parse (context, &argc, &argv, &error))
+	{
+		fprintf (stderr, "%s\n", error->message);
+		g_error_free (error);
+		g_option_context_free (context);
+		return 1;
+	}
+	g_option_context_free (context);
+
+	/* nothing may reach out of the process while we time things */
+	arg_skip_plugins = TRUE;
+	arg_dont_autoconnect = TRUE;
+	prefs.pchat_gui_slist_skip = TRUE;
+	prefs.pchat_url_grabber = FALSE;
+	prefs.pchat_url_logging = FALSE;
+	return -1;
+}
+
+void
+fe_init (void)
+{
+}
+
+void
+fe_main (void)
+{
+	gboolean first = TRUE;
+	guint i;
+
+	bench_sess = new_ircwindow (NULL, NULL, SESS_SERVER, 0);
+	bench_inputs ();
+
+	if (bench_json)
+		printf ("{\n  \"seed\": %d,\n  \"version\": \"%s\",\n  \"casefold\": \"%s\",\n  \"results\": [",
+				  bench_seed, PACKAGE_VERSION, casefold_impl ());
+	else
+		printf ("casefold: %s\n", casefold_impl ());
+	for (i = 0; i < G_N_ELEMENTS (cases); i++)
+	{
+		if (bench_filter && !strstr (cases[i].name, bench_filter))
+			continue;
+		bench_run (&cases[i], first);
+		first = FALSE;
+	}
+	if (bench_json)
+		printf ("\n  ]\n}\n");
+
+	exit (0);
+}
@@ -0,0 +1,1099 @@
+/* PChat
+ * Copyright (C) 2026 PChat-IRC contributors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/* synth-ircd: a synthetic IRC server for load and soak testing.
+ *
+ * Speaks just enough IRC and IRCv3 (CAP 302, SASL PLAIN, server-time,
+ * batch, multi-prefix, userhost-in-names, extended-join, WHOX) to drive
+ * the client through the real connect/parse/GUI path on loopback, and
+ * generates traffic from a few configurable scenarios:
+ *
+ *   - every registered client is force-joined to --channels channels of
+ *     --members members each, which produces a NAMES burst per channel
+ *   - --flood lines/second of channel PRIVMSGs (0 = off, -1 = as fast as
+ *     the client reads), with the occasional highlight, colour code and URL
+ *   - a netsplit of --split-size members every --split-interval seconds,
+ *     rejoining two seconds later (batched when the client acked "batch")
+ *   - --mode-count op/voice/ban changes every --mode-interval seconds
+ *
+ * Output is generated only while the client keeps up, so a slow client
+ * sees backpressure rather than an unbounded send queue here.
+ *
+ *   synth-ircd --port 6667 --members 50000 --flood 2000 --split-interval 30
+ *   pchat-text --daemon ... then /server 127.0.0.1 6667
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <glib.h>
+
+#define SERVER_NAME "synth.irc"
+#define NETWORK_NAME "Synth"
+#define MAX_CLIENTS 64
+#define HIGH_WATER (256 * 1024)	/* stop generating above this much unsent output */
+#define MAX_LINE 8192
+#define NAMES_LINE 400				/* payload bytes per RPL_NAMREPLY */
+#define MODES_PER_LINE 4			/* advertised as MODES= */
+#define TICK_MS 10
+
+enum
+{
+	CAP_MULTI_PREFIX = 1 << 0,
+	CAP_SERVER_TIME = 1 << 1,
+	CAP_BATCH = 1 << 2,
+	CAP_MESSAGE_TAGS = 1 << 3,
+	CAP_SASL = 1 << 4,
+	CAP_EXTENDED_JOIN = 1 << 5,
+	CAP_USERHOST_NAMES = 1 << 6,
+	CAP_AWAY_NOTIFY = 1 << 7,
+	CAP_ACCOUNT_NOTIFY = 1 << 8,
+	CAP_ACCOUNT_TAG = 1 << 9
+};
+
+static const struct
+{
+	const char *name;
+	const char *value;			/* advertised with CAP LS 302, or NULL */
+	guint bit;
+} synth_caps[] =
+{
+	{"multi-prefix", NULL, CAP_MULTI_PREFIX},
+	{"server-time", NULL, CAP_SERVER_TIME},
+	{"batch", NULL, CAP_BATCH},
+	{"message-tags", NULL, CAP_MESSAGE_TAGS},
+	{"sasl", "PLAIN", CAP_SASL},
+	{"extended-join", NULL, CAP_EXTENDED_JOIN},
+	{"userhost-in-names", NULL, CAP_USERHOST_NAMES},
+	{"away-notify", NULL, CAP_AWAY_NOTIFY},
+	{"account-notify", NULL, CAP_ACCOUNT_NOTIFY},
+	{"account-tag", NULL, CAP_ACCOUNT_TAG},
+};
+
+typedef struct
+{
+	char *name;
+	int members;				/* members are u0000000 .. u<members-1> */
+	int split_first;			/* first split-off member, -1 while whole */
+	int split_count;
+	gint64 split_until;
+} synth_chan;
+
+typedef struct
+{
+	int fd;
+	GString *in;
+	GString *out;
+	char *nick;
+	guint caps;
+	guint cap_negotiating:1;
+	guint got_user:1;
+	guint registered:1;
+	guint sasl_pending:1;
+	guint closing:1;
+	GPtrArray *chans;
+	gint64 next_split;
+	gint64 next_modes;
+	gint64 last_tick;
+	double flood_credit;
+	guint batch_id;
+	guint64 lines;
+	guint64 lines_reported;
+	guint rng;
+} synth_client;
+
+/* options */
+static char *opt_bind = "127.0.0.1";
+static gint opt_port = 6667;
+static gint opt_channels = 1;
+static gint opt_members = 50000;
+static gint opt_flood = 0;
+static gint opt_split_interval = 0;
+static gint opt_split_size = 5000;
+static gint opt_mode_interval = 0;
+static gint opt_mode_count = 400;
+static gboolean opt_sasl_fail = FALSE;
+static gboolean opt_quiet = FALSE;
+
+static const GOptionEntry synth_options[] =
+{
+	{"bind", 'b', 0, G_OPTION_ARG_STRING, &opt_bind, "Address to listen on (default 127.0.0.1)", "ADDR"},
+	{"port", 'p', 0, G_OPTION_ARG_INT, &opt_port, "Port to listen on (default 6667)", "PORT"},
+	{"channels", 'c', 0, G_OPTION_ARG_INT, &opt_channels, "Channels each client is joined to (default 1)", "N"},
+	{"members", 'm', 0, G_OPTION_ARG_INT, &opt_members, "Members per channel (default 50000)", "N"},
+	{"flood", 'f', 0, G_OPTION_ARG_INT, &opt_flood, "Channel messages per second (0 = off, -1 = as fast as the client reads)", "N"},
+	{"split-interval", 's', 0, G_OPTION_ARG_INT, &opt_split_interval, "Seconds between netsplits (0 = off)", "SECS"},
+	{"split-size", 0, 0, G_OPTION_ARG_INT, &opt_split_size, "Members lost per netsplit (default 5000)", "N"},
+	{"mode-interval", 0, 0, G_OPTION_ARG_INT, &opt_mode_interval, "Seconds between mass mode changes (0 = off)", "SECS"},
+	{"mode-count", 0, 0, G_OPTION_ARG_INT, &opt_mode_count, "Mode changes per burst (default 400)", "N"},
+	{"sasl-fail", 0, 0, G_OPTION_ARG_NONE, &opt_sasl_fail, "Reject every SASL attempt", NULL},
+	{"quiet", 'q', 0, G_OPTION_ARG_NONE, &opt_quiet, "Don't print throughput", NULL},
+	{NULL}
+};
+
+static synth_client *clients[MAX_CLIENTS];
+static volatile sig_atomic_t quit_requested = 0;
+
+static guint
+synth_rand (synth_client *c)
+{
+	/* xorshift: cheap and reproducible per client */
+	c->rng ^= c->rng << 13;
+	c->rng ^= c->rng >> 17;
+	c->rng ^= c->rng << 5;
+	return c->rng;
+}
+
+static void
+client_vsend (synth_client *c, const char *batch, const char *fmt, va_list ap)
+{
+	gboolean tags = FALSE;
+
+	if (c->caps & CAP_SERVER_TIME)
+	{
+		gint64 now = g_get_real_time ();
+		time_t secs = now / G_USEC_PER_SEC;
+		struct tm tm;
+		char buf[32];
+
+		gmtime_r (&secs, &tm);
+		strftime (buf, sizeof (buf), "%Y-%m-%dT%H:%M:%S", &tm);
+		g_string_append_printf (c->out, "@time=%s.%03dZ", buf,
+										(int) (now % G_USEC_PER_SEC / 1000));
+		tags = TRUE;
+	}
+	if (batch && (c->caps & CAP_BATCH))
+	{
+		g_string_append_printf (c->out, "%sbatch=%s", tags ? ";" : "@", batch);
+		tags = TRUE;
+	}
+	if (tags)
+		g_string_append_c (c->out, ' ');
+
+	g_string_append_vprintf (c->out, fmt, ap);
+	g_string_append (c->out, "\r\n");
+	c->lines++;
+}
+
+static void
+client_send (synth_client *c, const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start (ap, fmt);
+	client_vsend (c, NULL, fmt, ap);
+	va_end (ap);
+}
+
+static void
+client_send_batched (synth_client *c, const char *batch, const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start (ap, fmt);
+	client_vsend (c, batch, fmt, ap);
+	va_end (ap);
+}
+
+static void
+member_nick (char *buf, gsize len, int i)
+{
+	g_snprintf (buf, len, "u%07d", i);
+}
+
+static void
+member_mask (char *buf, gsize len, int i)
+{
+	g_snprintf (buf, len, "u%07d!~u%d@host%d.synth", i, i, i % 997);
+}
+
+/* members are ops every 100th, voiced every 10th */
+static const char *
+member_prefix (synth_client *c, int i)
+{
+	if (i % 100 == 0)
+		return (c->caps & CAP_MULTI_PREFIX) ? "@+" : "@";
+	if (i % 10 == 0)
+		return "+";
+	return "";
+}
+
+static synth_chan *
+client_find_chan (synth_client *c, const char *name)
+{
+	guint i;
+
+	for (i = 0; i < c->chans->len; i++)
+	{
+		synth_chan *ch = g_ptr_array_index (c->chans, i);
+		if (g_ascii_strcasecmp (ch->name, name) == 0)
+			return ch;
+	}
+	return NULL;
+}
+
+static gboolean
+member_present (synth_chan *ch, int i)
+{
+	return ch->split_first < 0 || i < ch->split_first ||
+			 i >= ch->split_first + ch->split_count;
+}
+
+static void
+send_names (synth_client *c, synth_chan *ch)
+{
+	GString *line = g_string_sized_new (NAMES_LINE + 64);
+	char nick[64];
+	int i;
+
+	g_string_append_printf (line, "@%s", c->nick);	/* ourselves */
+	for (i = 0; i < ch->members; i++)
+	{
+		if (!member_present (ch, i))
+			continue;
+		if (line->len >= NAMES_LINE)
+		{
+			client_send (c, ":%s 353 %s = %s :%s", SERVER_NAME, c->nick, ch->name, line->str);
+			g_string_truncate (line, 0);
+		}
+		if (line->len)
+			g_string_append_c (line, ' ');
+		if (c->caps & CAP_USERHOST_NAMES)
+			member_mask (nick, sizeof (nick), i);
+		else
+			member_nick (nick, sizeof (nick), i);
+		g_string_append (line, member_prefix (c, i));
+		g_string_append (line, nick);
+	}
+	if (line->len)
+		client_send (c, ":%s 353 %s = %s :%s", SERVER_NAME, c->nick, ch->name, line->str);
+	client_send (c, ":%s 366 %s %s :End of /NAMES list.", SERVER_NAME, c->nick, ch->name);
+	g_string_free (line, TRUE);
+}
+
+static void
+join_chan (synth_client *c, const char *name)
+{
+	synth_chan *ch = client_find_chan (c, name);
+
+	if (!ch)
+	{
+		ch = g_new0 (synth_chan, 1);
+		ch->name = g_strdup (name);
+		ch->members = opt_members;
+		ch->split_first = -1;
+		g_ptr_array_add (c->chans, ch);
+	}
+
+	if (c->caps & CAP_EXTENDED_JOIN)
+		client_send (c, ":%s!~%s@127.0.0.1 JOIN %s * :%s", c->nick, c->nick, ch->name, c->nick);
+	else
+		client_send (c, ":%s!~%s@127.0.0.1 JOIN %s", c->nick, c->nick, ch->name);
+	client_send (c, ":%s 332 %s %s :Synthetic load channel, %d members",
+					 SERVER_NAME, c->nick, ch->name, ch->members);
+	client_send (c, ":%s 333 %s %s ChanServ %ld", SERVER_NAME, c->nick, ch->name,
+					 (long) time (NULL));
+	send_names (c, ch);
+}
+
+static void
+chan_free (synth_chan *ch)
+{
+	g_free (ch->name);
+	g_free (ch);
+}
+
+static void
+send_who (synth_client *c, synth_chan *ch, const char *whox)
+{
+	char nick[64];
+	int i;
+
+	for (i = 0; i < ch->members; i++)
+	{
+		if (!member_present (ch, i))
+			continue;
+		member_nick (nick, sizeof (nick), i);
+
+		if (whox)
+		{
+			/* WHOX: fields in the fixed order the spec gives, token first */
+			GString *line = g_string_new (NULL);
+			const char *token = strchr (whox, ',');
+			char *fields = g_strndup (whox, token ? token - whox : strlen (whox));
+
+			g_string_printf (line, ":%s 354 %s", SERVER_NAME, c->nick);
+			if (strchr (fields, 't'))
+				g_string_append_printf (line, " %s", token ? token + 1 : "0");
+			if (strchr (fields, 'c'))
+				g_string_append_printf (line, " %s", ch->name);
+			if (strchr (fields, 'u'))
+				g_string_append_printf (line, " ~u%d", i);
+			if (strchr (fields, 'i'))
+				g_string_append (line, " 255.255.255.255");
+			if (strchr (fields, 'h'))
+				g_string_append_printf (line, " host%d.synth", i % 997);
+			if (strchr (fields, 's'))
+				g_string_append_printf (line, " leaf%d.synth", i % 8);
+			if (strchr (fields, 'n'))
+				g_string_append_printf (line, " %s", nick);
+			if (strchr (fields, 'f'))
+				g_string_append_printf (line, " %s%s", (i % 7) ? "H" : "G", member_prefix (c, i));
+			if (strchr (fields, 'd'))
+				g_string_append (line, " 1");
+			if (strchr (fields, 'l'))
+				g_string_append_printf (line, " %d", i % 3600);
+			if (strchr (fields, 'a'))
+			{
+				if (i % 3)
+					g_string_append_printf (line, " acct%d", i);
+				else
+					g_string_append (line, " 0");
+			}
+			if (strchr (fields, 'r'))
+				g_string_append_printf (line, " :Synthetic user %d", i);
+			client_send (c, "%s", line->str);
+			g_free (fields);
+			g_string_free (line, TRUE);
+		}
+		else
+		{
+			client_send (c, ":%s 352 %s %s ~u%d host%d.synth leaf%d.synth %s %s%s :1 Synthetic user %d",
+							 SERVER_NAME, c->nick, ch->name, i, i % 997, i % 8, nick,
+							 (i % 7) ? "H" : "G", member_prefix (c, i), i);
+		}
+	}
+	client_send (c, ":%s 315 %s %s :End of /WHO list.", SERVER_NAME, c->nick, ch->name);
+}
+
+static void
+client_welcome (synth_client *c)
+{
+	int i;
+
+	c->registered = TRUE;
+	client_send (c, ":%s 001 %s :Welcome to the %s synthetic network %s", SERVER_NAME, c->nick, NETWORK_NAME, c->nick);
+	client_send (c, ":%s 002 %s :Your host is %s, running synth-ircd", SERVER_NAME, c->nick, SERVER_NAME);
+	client_send (c, ":%s 003 %s :This server was created just now", SERVER_NAME, c->nick);
+	client_send (c, ":%s 004 %s %s synth-ircd iowx bklmnopstv bklov", SERVER_NAME, c->nick, SERVER_NAME);
+	client_send (c, ":%s 005 %s CASEMAPPING=rfc1459 CHANMODES=beI,k,l,imnpst CHANTYPES=# MODES=%d NETWORK=%s NICKLEN=30 PREFIX=(ov)@+ WHOX :are supported by this server",
+					 SERVER_NAME, c->nick, MODES_PER_LINE, NETWORK_NAME);
+	client_send (c, ":%s 375 %s :- %s Message of the day -", SERVER_NAME, c->nick, SERVER_NAME);
+	client_send (c, ":%s 372 %s :- Synthetic load; nothing here is real.", SERVER_NAME, c->nick);
+	client_send (c, ":%s 376 %s :End of /MOTD command.", SERVER_NAME, c->nick);
+
+	for (i = 1; i <= opt_channels; i++)
+	{
+		char name[32];
+
+		g_snprintf (name, sizeof (name), "#synth%d", i);
+		join_chan (c, name);
+	}
+
+	c->next_split = opt_split_interval > 0 ? g_get_monotonic_time () + opt_split_interval * G_USEC_PER_SEC : 0;
+	c->next_modes = opt_mode_interval > 0 ? g_get_monotonic_time () + opt_mode_interval * G_USEC_PER_SEC : 0;
+}
+
+static void
+client_try_register (synth_client *c)
+{
+	if (!c->registered && !c->cap_negotiating && !c->sasl_pending && c->nick && c->got_user)
+		client_welcome (c);
+}
+
+static void
+handle_cap (synth_client *c, char **word, int words)
+{
+	const char *sub = words > 1 ? word[1] : "";
+	GString *list;
+	guint i;
+
+	if (!g_ascii_strcasecmp (sub, "LS"))
+	{
+		gboolean v302 = words > 2 && atoi (word[2]) >= 302;
+
+		c->cap_negotiating = TRUE;
+		list = g_string_new (NULL);
+		for (i = 0; i < G_N_ELEMENTS (synth_caps); i++)
+		{
+			if (list->len)
+				g_string_append_c (list, ' ');
+			g_string_append (list, synth_caps[i].name);
+			if (v302 && synth_caps[i].value)
+				g_string_append_printf (list, "=%s", synth_caps[i].value);
+		}
+		client_send (c, ":%s CAP * LS :%s", SERVER_NAME, list->str);
+		g_string_free (list, TRUE);
+	}
+	else if (!g_ascii_strcasecmp (sub, "REQ") && words > 2)
+	{
+		char **reqs = g_strsplit (word[2], " ", 0);
+		guint add = 0, del = 0;
+		char **r;
+
+		c->cap_negotiating = TRUE;
+		for (r = reqs; *r; r++)
+		{
+			gboolean neg = **r == '-';
+			const char *name = neg ? *r + 1 : *r;
+
+			if (!*name)
+				continue;
+			for (i = 0; i < G_N_ELEMENTS (synth_caps); i++)
+				if (!strcmp (synth_caps[i].name, name))
+					break;
+			if (i == G_N_ELEMENTS (synth_caps))
+			{
+				client_send (c, ":%s CAP %s NAK :%s", SERVER_NAME, c->nick ? c->nick : "*", word[2]);
+				g_strfreev (reqs);
+				return;
+			}
+			if (neg)
+				del |= synth_caps[i].bit;
+			else
+				add |= synth_caps[i].bit;
+		}
+		g_strfreev (reqs);
+		client_send (c, ":%s CAP %s ACK :%s", SERVER_NAME, c->nick ? c->nick : "*", word[2]);
+		c->caps = (c->caps | add) & ~del;
+	}
+	else if (!g_ascii_strcasecmp (sub, "LIST"))
+	{
+		list = g_string_new (NULL);
+		for (i = 0; i < G_N_ELEMENTS (synth_caps); i++)
+		{
+			if (!(c->caps & synth_caps[i].bit))
+				continue;
+			if (list->len)
+				g_string_append_c (list, ' ');
+			g_string_append (list, synth_caps[i].name);
+		}
+		client_send (c, ":%s CAP %s LIST :%s", SERVER_NAME, c->nick ? c->nick : "*", list->str);
+		g_string_free (list, TRUE);
+	}
+	else if (!g_ascii_strcasecmp (sub, "END"))
+	{
+		c->cap_negotiating = FALSE;
+		client_try_register (c);
+	}
+}
+
+static void
+handle_authenticate (synth_client *c, const char *arg)
+{
+	const char *nick = c->nick ? c->nick : "*";
+
+	if (!(c->caps & CAP_SASL))
+		return;
+
+	if (!g_ascii_strcasecmp (arg, "PLAIN"))
+	{
+		c->sasl_pending = TRUE;
+		client_send (c, "AUTHENTICATE +");
+	}
+	else if (!strcmp (arg, "*"))
+	{
+		c->sasl_pending = FALSE;
+		client_send (c, ":%s 906 %s :SASL authentication aborted", SERVER_NAME, nick);
+	}
+	else if (c->sasl_pending)
+	{
+		c->sasl_pending = FALSE;
+		if (opt_sasl_fail)
+		{
+			client_send (c, ":%s 904 %s :SASL authentication failed", SERVER_NAME, nick);
+		}
+		else
+		{
+			client_send (c, ":%s 900 %s %s!~%s@127.0.0.1 %s :You are now logged in as %s",
+							 SERVER_NAME, nick, nick, nick, nick, nick);
+			client_send (c, ":%s 903 %s :SASL authentication successful", SERVER_NAME, nick);
+		}
+	}
+	else
+	{
+		client_send (c, ":%s 908 %s PLAIN :are available SASL mechanisms", SERVER_NAME, nick);
+		client_send (c, ":%s 904 %s :SASL authentication failed", SERVER_NAME, nick);
+	}
+}
+
+/* splits "CMD a b :trailing" into at most 16 words; word[n-1] keeps the
+ * trailing parameter whole */
+static int
+split_line (char *line, char **word)
+{
+	int n = 0;
+
+	if (*line == '@')
+	{
+		line = strchr (line, ' ');
+		if (!line)
+			return 0;
+		while (*line == ' ')
+			line++;
+	}
+	if (*line == ':')
+	{
+		line = strchr (line, ' ');
+		if (!line)
+			return 0;
+	}
+	while (line && *line && n < 16)
+	{
+		while (*line == ' ')
+			line++;
+		if (!*line)
+			break;
+		if (*line == ':')
+		{
+			word[n++] = line + 1;
+			break;
+		}
+		word[n++] = line;
+		line = strchr (line, ' ');
+		if (line)
+			*line++ = 0;
+	}
+	return n;
+}
+
+static void
+client_command (synth_client *c, char *line)
+{
+	char *word[16];
+	int words = split_line (line, word);
+	const char *nick;
+
+	if (words == 0)
+		return;
+	nick = c->nick ? c->nick : "*";
+
+	if (!g_ascii_strcasecmp (word[0], "CAP"))
+		handle_cap (c, word, words);
+	else if (!g_ascii_strcasecmp (word[0], "AUTHENTICATE") && words > 1)
+		handle_authenticate (c, word[1]);
+	else if (!g_ascii_strcasecmp (word[0], "NICK") && words > 1)
+	{
+		if (c->registered)
+			client_send (c, ":%s!~%s@127.0.0.1 NICK :%s", c->nick, c->nick, word[1]);
+		g_free (c->nick);
+		c->nick = g_strdup (word[1]);
+		client_try_register (c);
+	}
+	else if (!g_ascii_strcasecmp (word[0], "USER"))
+	{
+		c->got_user = TRUE;
+		client_try_register (c);
+	}
+	else if (!g_ascii_strcasecmp (word[0], "PING"))
+		client_send (c, ":%s PONG %s :%s", SERVER_NAME, SERVER_NAME, words > 1 ? word[1] : "");
+	else if (!g_ascii_strcasecmp (word[0], "PONG") || !g_ascii_strcasecmp (word[0], "PASS") ||
+				!g_ascii_strcasecmp (word[0], "PRIVMSG") || !g_ascii_strcasecmp (word[0], "NOTICE") ||
+				!g_ascii_strcasecmp (word[0], "ISON") || !g_ascii_strcasecmp (word[0], "USERHOST"))
+		;
+	else if (!c->registered)
+		client_send (c, ":%s 451 %s :You have not registered", SERVER_NAME, nick);
+	else if (!g_ascii_strcasecmp (word[0], "JOIN") && words > 1)
+	{
+		char **names = g_strsplit (word[1], ",", 0);
+		char **n;
+
+		for (n = names; *n; n++)
+			if (**n == '#')
+				join_chan (c, *n);
+		g_strfreev (names);
+	}
+	else if (!g_ascii_strcasecmp (word[0], "PART") && words > 1)
+	{
+		synth_chan *ch = client_find_chan (c, word[1]);
+
+		if (ch)
+		{
+			client_send (c, ":%s!~%s@127.0.0.1 PART %s", c->nick, c->nick, ch->name);
+			g_ptr_array_remove (c->chans, ch);
+		}
+	}
+	else if (!g_ascii_strcasecmp (word[0], "NAMES") && words > 1)
+	{
+		synth_chan *ch = client_find_chan (c, word[1]);
+
+		if (ch)
+			send_names (c, ch);
+		else
+			client_send (c, ":%s 366 %s %s :End of /NAMES list.", SERVER_NAME, nick, word[1]);
+	}
+	else if (!g_ascii_strcasecmp (word[0], "WHO") && words > 1)
+	{
+		synth_chan *ch = client_find_chan (c, word[1]);
+		const char *whox = words > 2 && word[2][0] == '%' ? word[2] + 1 : NULL;
+
+		if (ch)
+			send_who (c, ch, whox);
+		else
+			client_send (c, ":%s 315 %s %s :End of /WHO list.", SERVER_NAME, nick, word[1]);
+	}
+	else if (!g_ascii_strcasecmp (word[0], "MODE") && words > 1)
+	{
+		if (word[1][0] != '#')
+			client_send (c, ":%s 221 %s +i", SERVER_NAME, nick);
+		else if (words == 2)
+		{
+			client_send (c, ":%s 324 %s %s +nt", SERVER_NAME, nick, word[1]);
+			client_send (c, ":%s 329 %s %s %ld", SERVER_NAME, nick, word[1], (long) time (NULL) - 86400);
+		}
+		else if (!strcmp (word[2], "b") || !strcmp (word[2], "+b"))
+			client_send (c, ":%s 368 %s %s :End of channel ban list", SERVER_NAME, nick, word[1]);
+	}
+	else if (!g_ascii_strcasecmp (word[0], "QUIT"))
+	{
+		client_send (c, "ERROR :Closing link (Quit: %s)", words > 1 ? word[1] : "");
+		c->closing = TRUE;
+	}
+	else
+		client_send (c, ":%s 421 %s %s :Unknown command", SERVER_NAME, nick, word[0]);
+}
+
+static void
+gen_flood (synth_client *c, double seconds)
+{
+	static const char *const texts[] =
+	{
+		"lorem ipsum dolor sit amet, consectetur adipiscing elit",
+		"has anyone seen the build logs from last night?",
+		"\00304red\003 \00312blue\003 \002bold\002 \035italic\035 \037underline\037",
+		"check https://example.org/synth/%u for details",
+		"%s: ping, are you around?",
+		"a slightly longer line that wraps in narrow windows, so the text view has to lay it out over several rows when the window is small",
+	};
+	int budget;
+
+	if (opt_flood == 0 || c->chans->len == 0)
+		return;
+
+	if (opt_flood < 0)
+		budget = G_MAXINT;
+	else
+	{
+		c->flood_credit += opt_flood * seconds;
+		if (c->flood_credit > opt_flood)
+			c->flood_credit = opt_flood;	/* at most a second of catch-up */
+		budget = (int) c->flood_credit;
+		c->flood_credit -= budget;
+	}
+
+	while (budget-- > 0 && c->out->len < HIGH_WATER)
+	{
+		synth_chan *ch = g_ptr_array_index (c->chans, synth_rand (c) % c->chans->len);
+		guint r = synth_rand (c);
+		int who = r % MAX (ch->members, 1);
+		char mask[96];
+		char text[512];
+
+		if (!member_present (ch, who))
+			continue;
+		member_mask (mask, sizeof (mask), who);
+		switch ((r >> 16) % 50)
+		{
+		case 0:
+			g_snprintf (text, sizeof (text), texts[4], c->nick);
+			break;
+		case 1:
+			g_snprintf (text, sizeof (text), texts[3], r);
+			break;
+		case 2:
+			g_strlcpy (text, texts[2], sizeof (text));
+			break;
+		case 3:
+			g_strlcpy (text, texts[5], sizeof (text));
+			break;
+		default:
+			g_strlcpy (text, texts[(r >> 8) % 2], sizeof (text));
+			break;
+		}
+		client_send (c, ":%s PRIVMSG %s :%s", mask, ch->name, text);
+	}
+}
+
+static void
+gen_split (synth_client *c, gint64 now)
+{
+	guint i;
+	int j;
+
+	for (i = 0; i < c->chans->len; i++)
+	{
+		synth_chan *ch = g_ptr_array_index (c->chans, i);
+		char mask[96];
+		char batch[16];
+
+		if (ch->split_first >= 0)
+		{
+			if (now < ch->split_until)
+				continue;
+
+			/* rejoin */
+			g_snprintf (batch, sizeof (batch), "j%u", ++c->batch_id);
+			if (c->caps & CAP_BATCH)
+				client_send (c, ":%s BATCH +%s netjoin hub.synth leaf.synth", SERVER_NAME, batch);
+			for (j = ch->split_first; j < ch->split_first + ch->split_count; j++)
+			{
+				member_mask (mask, sizeof (mask), j);
+				if (c->caps & CAP_EXTENDED_JOIN)
+					client_send_batched (c, batch, ":%s JOIN %s acct%d :Synthetic user %d", mask, ch->name, j, j);
+				else
+					client_send_batched (c, batch, ":%s JOIN %s", mask, ch->name);
+			}
+			if (c->caps & CAP_BATCH)
+				client_send (c, ":%s BATCH -%s", SERVER_NAME, batch);
+			ch->split_first = -1;
+			continue;
+		}
+
+		if (c->next_split == 0 || now < c->next_split || ch->members < 2)
+			continue;
+
+		ch->split_count = MIN (opt_split_size, ch->members / 2);
+		ch->split_first = synth_rand (c) % (ch->members - ch->split_count + 1);
+		ch->split_until = now + 2 * G_USEC_PER_SEC;
+
+		g_snprintf (batch, sizeof (batch), "s%u", ++c->batch_id);
+		if (c->caps & CAP_BATCH)
+			client_send (c, ":%s BATCH +%s netsplit hub.synth leaf.synth", SERVER_NAME, batch);
+		for (j = ch->split_first; j < ch->split_first + ch->split_count; j++)
+		{
+			member_mask (mask, sizeof (mask), j);
+			client_send_batched (c, batch, ":%s QUIT :hub.synth leaf.synth", mask);
+		}
+		if (c->caps & CAP_BATCH)
+			client_send (c, ":%s BATCH -%s", SERVER_NAME, batch);
+	}
+
+	if (c->next_split && now >= c->next_split)
+		c->next_split = now + opt_split_interval * G_USEC_PER_SEC;
+}
+
+static void
+gen_modes (synth_client *c, gint64 now)
+{
+	guint i;
+
+	if (c->next_modes == 0 || now < c->next_modes)
+		return;
+	c->next_modes = now + opt_mode_interval * G_USEC_PER_SEC;
+
+	for (i = 0; i < c->chans->len; i++)
+	{
+		synth_chan *ch = g_ptr_array_index (c->chans, i);
+		int done = 0;
+
+		while (done < opt_mode_count)
+		{
+			char modes[2 * MODES_PER_LINE + 2];
+			GString *args = g_string_new (NULL);
+			char sign = 0;
+			int m = 0, k;
+
+			for (k = 0; k < MODES_PER_LINE && done < opt_mode_count; k++, done++)
+			{
+				guint r = synth_rand (c);
+				char want = (r & 1) ? '+' : '-';
+
+				if (want != sign)
+					modes[m++] = sign = want;
+				switch ((r >> 1) % 3)
+				{
+				case 0:
+					modes[m++] = 'o';
+					g_string_append_printf (args, " u%07d", (int) ((r >> 3) % MAX (ch->members, 1)));
+					break;
+				case 1:
+					modes[m++] = 'v';
+					g_string_append_printf (args, " u%07d", (int) ((r >> 3) % MAX (ch->members, 1)));
+					break;
+				default:
+					modes[m++] = 'b';
+					g_string_append_printf (args, " *!*@host%u.synth", (r >> 3) % 997);
+					break;
+				}
+			}
+			modes[m] = 0;
+			client_send (c, ":ChanServ!ChanServ@services.synth MODE %s %s%s", ch->name, modes, args->str);
+			g_string_free (args, TRUE);
+		}
+	}
+}
+
+static void
+client_generate (synth_client *c)
+{
+	gint64 now = g_get_monotonic_time ();
+	double dt = (now - c->last_tick) / (double) G_USEC_PER_SEC;
+
+	c->last_tick = now;
+	if (!c->registered || c->closing || c->out->len >= HIGH_WATER)
+		return;
+
+	gen_split (c, now);
+	gen_modes (c, now);
+	gen_flood (c, dt);
+}
+
+static void
+client_free (synth_client *c)
+{
+	close (c->fd);
+	g_string_free (c->in, TRUE);
+	g_string_free (c->out, TRUE);
+	g_ptr_array_free (c->chans, TRUE);
+	g_free (c->nick);
+	g_free (c);
+}
+
+static synth_client *
+client_new (int fd)
+{
+	synth_client *c = g_new0 (synth_client, 1);
+
+	c->fd = fd;
+	c->in = g_string_sized_new (1024);
+	c->out = g_string_sized_new (HIGH_WATER);
+	c->chans = g_ptr_array_new_with_free_func ((GDestroyNotify) chan_free);
+	c->last_tick = g_get_monotonic_time ();
+	c->rng = 2463534242u ^ (guint) fd;
+	return c;
+}
+
+/* returns FALSE when the client has gone */
+static gboolean
+client_read (synth_client *c)
+{
+	char buf[16384];
+	char *eol;
+	gsize start = 0;
+	ssize_t len;
+
+	len = recv (c->fd, buf, sizeof (buf), 0);
+	if (len == 0 || (len < 0 && errno != EAGAIN && errno != EINTR))
+		return FALSE;
+	if (len < 0)
+		return TRUE;
+
+	g_string_append_len (c->in, buf, len);
+	while ((eol = memchr (c->in->str + start, '\n', c->in->len - start)))
+	{
+		*eol = 0;
+		if (eol > c->in->str + start && eol[-1] == '\r')
+			eol[-1] = 0;
+		client_command (c, c->in->str + start);
+		start = eol + 1 - c->in->str;
+	}
+	g_string_erase (c->in, 0, start);
+
+	if (c->in->len > MAX_LINE)
+		return FALSE;
+	return TRUE;
+}
+
+static gboolean
+client_write (synth_client *c)
+{
+	ssize_t len;
+
+	if (c->out->len == 0)
+		return !c->closing;
+
+	len = send (c->fd, c->out->str, c->out->len, MSG_NOSIGNAL);
+	if (len < 0)
+		return errno == EAGAIN || errno == EINTR;
+	g_string_erase (c->out, 0, len);
+	return !(c->closing && c->out->len == 0);
+}
+
+static int
+listen_socket (void)
+{
+	struct sockaddr_in addr;
+	int fd, on = 1;
+
+	fd = socket (AF_INET, SOCK_STREAM, 0);
+	if (fd < 0)
+		return -1;
+	setsockopt (fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof (on));
+
+	memset (&addr, 0, sizeof (addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons (opt_port);
+	if (inet_pton (AF_INET, opt_bind, &addr.sin_addr) != 1 ||
+		 bind (fd, (struct sockaddr *) &addr, sizeof (addr)) < 0 ||
+		 listen (fd, 16) < 0)
+	{
+		close (fd);
+		return -1;
+	}
+	fcntl (fd, F_SETFL, O_NONBLOCK);
+	return fd;
+}
+
+static void
+accept_client (int lfd)
+{
+	int fd, i;
+
+	fd = accept (lfd, NULL, NULL);
+	if (fd < 0)
+		return;
+	for (i = 0; i < MAX_CLIENTS; i++)
+	{
+		if (!clients[i])
+		{
+			fcntl (fd, F_SETFL, O_NONBLOCK);
+			clients[i] = client_new (fd);
+			return;
+		}
+	}
+	close (fd);
+}
+
+static void
+report (gint64 *last_report)
+{
+	gint64 now = g_get_monotonic_time ();
+	double secs = (now - *last_report) / (double) G_USEC_PER_SEC;
+	int i;
+
+	if (opt_quiet || secs < 5.0)
+		return;
+	*last_report = now;
+
+	for (i = 0; i < MAX_CLIENTS; i++)
+	{
+		synth_client *c = clients[i];
+
+		if (!c || !c->registered)
+			continue;
+		printf ("%s: %.0f lines/s, %" G_GSIZE_FORMAT " bytes queued\n", c->nick,
+				  (c->lines - c->lines_reported) / secs, c->out->len);
+		c->lines_reported = c->lines;
+	}
+	fflush (stdout);
+}
+
+static void
+on_signal (int sig)
+{
+	quit_requested = 1;
+}
+
+int
+main (int argc, char *argv[])
+{
+	GOptionContext *context;
+	GError *error = NULL;
+	struct pollfd pfd[MAX_CLIENTS + 1];
+	synth_client *polled[MAX_CLIENTS + 1];
+	gint64 last_report;
+	int lfd, i;
+
+	context = g_option_context_new (NULL);
+	g_option_context_set_summary (context, "Synthetic IRC server for client load and soak testing.");
+	g_option_context_add_main_entries (context, synth_options, NULL);
+	if (!g_option_context_parse (context, &argc, &argv, &error))
+	{
+		fprintf (stderr, "%s\n", error->message);
+		return 1;
+	}
+	g_option_context_free (context);
+
+	lfd = listen_socket ();
+	if (lfd < 0)
+	{
+		fprintf (stderr, "synth-ircd: can't listen on %s:%d: %s\n", opt_bind, opt_port, g_strerror (errno));
+		return 1;
+	}
+
+	signal (SIGINT, on_signal);
+	signal (SIGTERM, on_signal);
+	signal (SIGPIPE, SIG_IGN);
+	if (!opt_quiet)
+		printf ("synth-ircd listening on %s:%d\n", opt_bind, opt_port);
+	last_report = g_get_monotonic_time ();
+
+	while (!quit_requested)
+	{
+		int n = 1;
+
+		pfd[0].fd = lfd;
+		pfd[0].events = POLLIN;
+		for (i = 0; i < MAX_CLIENTS; i++)
+		{
+			synth_client *c = clients[i];
+
+			if (!c)
+				continue;
+			client_generate (c);
+			pfd[n].fd = c->fd;
+			pfd[n].events = POLLIN | (c->out->len ? POLLOUT : 0);
+			polled[n] = c;
+			n++;
+		}
+
+		if (poll (pfd, n, TICK_MS) < 0 && errno != EINTR)
+			break;
+
+		if (pfd[0].revents & POLLIN)
+			accept_client (lfd);
+
+		for (i = 1; i < n; i++)
+		{
+			synth_client *c = polled[i];
+			gboolean alive = TRUE;
+			int slot;
+
+			if (pfd[i].revents & (POLLIN | POLLHUP | POLLERR))
+				alive = client_read (c);
+			if (alive && (pfd[i].revents & POLLOUT))
+				alive = client_write (c);
+			if (alive)
+				continue;
+
+			for (slot = 0; slot < MAX_CLIENTS; slot++)
+				if (clients[slot] == c)
+					clients[slot] = NULL;
+			client_free (c);
+		}
+
+		report (&last_report);
+	}
+
+	for (i = 0; i < MAX_CLIENTS; i++)
+		if (clients[i])
+			client_free (clients[i]);
+	close (lfd);
+	return 0;
+}